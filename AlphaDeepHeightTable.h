@@ -0,0 +1,165 @@
+/**
+ * AlphaDeepHeightTable.h provides a precomputed table of the alpha-deep
+ * heights of a Scapegoat Tree, floor(log_{1/alpha}(size)), so that checking a
+ * depth against the alpha-deep height of a subtree takes no floating point
+ * math on the tree's hot paths.
+ *
+ * Authors: Ryan Guan (rzgn) and Tyler Packard (TPackard), 2021
+ */
+
+#ifndef ALPHA_DEEP_HEIGHT_TABLE_H
+#define ALPHA_DEEP_HEIGHT_TABLE_H
+
+#include <algorithm>  // for std::upper_bound
+#include <cmath>      // for ceil, floor, log, pow
+#include <cstddef>    // for std::size_t
+#include <cstdint>    // for SIZE_MAX
+#include <vector>     // for the table of thresholds
+
+/**
+ * Table of the sizes at which the alpha-deep height increases: the k-th entry
+ * is the smallest size whose alpha-deep height is at least k. The entries are
+ * found by evaluating the floating point formula itself around an estimate,
+ * so the table gives exactly the same heights as the formula.
+ *
+ * The table only covers sizes up to some limit, since for alpha close to 1
+ * covering every possible size would take a very large table. Trees extend
+ * it (by doubling the limit) whenever their maximum size grows past it.
+ */
+class AlphaDeepHeightTable {
+  public:
+    /**
+     * Constructs an empty table, to be replaced before use.
+     */
+    AlphaDeepHeightTable() = default;
+
+    /**
+     * Constructs the table for the given alpha, which must be within (0.5, 1),
+     * covering small sizes.
+     */
+    explicit AlphaDeepHeightTable(double alpha) : alpha(alpha) {
+      thresholds.push_back(1);  // A single node is 0 alpha-deep.
+      cover(kInitialCoveredSize);
+    }
+
+    /**
+     * Makes sure that the table covers all sizes up to the given size.
+     *
+     * Time complexity: amortized O(1) per unit of growth in size
+     */
+    void cover(size_t size) {
+      if (size > coveredSize) extend(size);
+    }
+
+    /**
+     * Returns the alpha-deep height == floor(log_{1/alpha}(size))
+     * for a subtree of given size.
+     *
+     * Precondition: size is covered by the table.
+     * Time complexity: O(log log_{1/alpha}(size))
+     */
+    size_t height(size_t size) const {
+      return std::upper_bound(thresholds.begin(), thresholds.end(), size)
+           - thresholds.begin() - 1;
+    }
+
+    /**
+     * Returns whether depth > the alpha-deep height of a subtree of given size.
+     *
+     * Precondition: size is covered by the table.
+     * Time complexity: O(1)
+     */
+    bool exceeds(size_t depth, size_t size) const {
+      return depth >= thresholds.size() || size < thresholds[depth];
+    }
+
+  private:
+    static constexpr size_t kInitialCoveredSize = 1024;
+
+    double alpha = 0;
+    std::vector<size_t> thresholds;
+
+    // Every threshold up to this size is in the table.
+    size_t coveredSize = 0;
+
+    /**
+     * Returns floor(log_{1/alpha}(size)), evaluated exactly as the tree
+     * always has.
+     */
+    size_t formulaHeight(size_t size) const {
+      return static_cast<size_t>(floor(log(size) / log(1 / alpha)));
+    }
+
+    /**
+     * Appends thresholds until the table covers the given size, or twice
+     * the previously covered size if that is larger.
+     */
+    void extend(size_t size) {
+      size_t target = coveredSize > SIZE_MAX / 2 ? SIZE_MAX : 2 * coveredSize;
+      if (target < size) target = size;
+
+      while (coveredSize < target) {
+        size_t height = thresholds.size();
+        if (formulaHeight(SIZE_MAX) < height) {
+          // No size is as alpha-deep as this: every threshold is in the table.
+          coveredSize = SIZE_MAX;
+          return;
+        }
+
+        double estimate = ceil(pow(1 / alpha, static_cast<double>(height)));
+        size_t threshold = findThreshold(height, estimate);
+        thresholds.push_back(threshold);
+
+        // The next threshold may equal this one, so only smaller sizes are covered.
+        coveredSize = threshold - 1;
+      }
+    }
+
+    /**
+     * Returns the smallest size whose alpha-deep height is at least the given
+     * height, found by galloping away from the estimate until the threshold
+     * is bracketed, then binary searching the bracket.
+     *
+     * Precondition: thresholds holds every smaller threshold, and some size
+     *    has the given alpha-deep height.
+     */
+    size_t findThreshold(size_t height, double estimate) const {
+      // Invariant: formulaHeight(low) < height <= formulaHeight(high), where
+      // the threshold may equal the previous one when alpha is large.
+      size_t low = thresholds.back() - 1;
+      size_t high = SIZE_MAX;
+
+      size_t guess = estimate >= static_cast<double>(SIZE_MAX) ? SIZE_MAX
+                   : static_cast<size_t>(estimate);
+      if (guess <= low) guess = low + 1;
+
+      if (formulaHeight(guess) >= height) {
+        high = guess;
+        for (size_t step = 1; high - low > step; step *= 2) {
+          if (formulaHeight(high - step) < height) {
+            low = high - step;
+            break;
+          }
+          high -= step;
+        }
+      } else {
+        low = guess;
+        for (size_t step = 1; high - low > step; step *= 2) {
+          if (formulaHeight(low + step) >= height) {
+            high = low + step;
+            break;
+          }
+          low += step;
+        }
+      }
+
+      while (high - low > 1) {
+        size_t mid = low + (high - low) / 2;
+        if (formulaHeight(mid) >= height) high = mid;
+        else low = mid;
+      }
+      return high;
+    }
+};
+
+#endif // ALPHA_DEEP_HEIGHT_TABLE_H
@@ -0,0 +1,381 @@
+/**
+ * Authors: Ryan Guan (rzgn) and Tyler Packard (TPackard), 2021
+ */
+
+#include "BlockScapegoatTree.h"
+
+#include <algorithm>  // for std::max, std::min, std::lower_bound, std::copy, std::copy_backward
+#include <stdexcept>  // for std::invalid_argument
+#include <iostream>   // for std::cout, flush
+#include <iomanip>    // for std::setw
+
+
+BlockScapegoatTree::BlockScapegoatTree(double alpha) {
+  // Tree's alpha value must be larger than 0.5 and smaller than 1.
+  if (alpha <= kMinAlpha || alpha >= kMaxAlpha) {
+    throw std::invalid_argument("Alpha not in range (0.5, 1)!");
+  }
+  this->alpha = alpha;
+  alphaDeepHeights = AlphaDeepHeightTable(alpha);
+}
+
+void BlockScapegoatTree::clear() {
+  // Nodes need no destructors, so dropping the pool's chunks frees them all.
+  pool.clear();
+  root = nullptr;
+  size = numNodes = maxNodes = 0;
+}
+
+bool BlockScapegoatTree::search(int key) const {
+  Node* curr = root;
+  while (curr) {
+    if      (key < curr->keys[0])               curr = curr->left;
+    else if (key > curr->keys[curr->count - 1]) curr = curr->right;
+    else {
+      // The block spans the key: compare it with every key in the block,
+      // without branching, so that the compiler can vectorize the scan.
+      bool found = false;
+      for (int i = 0; i < curr->count; i++) {
+        found |= curr->keys[i] == key;
+      }
+      return found;
+    }
+  }
+  return false;
+}
+
+bool BlockScapegoatTree::insert(int key) {
+  // Stack of ancestors of the new node, if any, sized to never need the heap.
+  InsertionPath insertionPath(getMaxPathLength());
+  insertionPath.push(nullptr);      // The "root's parent"
+
+  // Find the node whose block spans the key, or else the last node on the
+  // way down, which the key would be the new smallest or largest key of.
+  Node* spanning = nullptr;
+  Node* curr = root;
+  while (curr) {
+    insertionPath.push(curr);
+    if      (key < curr->keys[0])               curr = curr->left;
+    else if (key > curr->keys[curr->count - 1]) curr = curr->right;
+    else {
+      spanning = curr;
+      break;
+    }
+  }
+
+  if (! spanning) {
+    Node* last = insertionPath.top();
+    if (last && static_cast<size_t>(last->count) < kBlockCapacity) {
+      insertIntoBlock(last, key);
+    } else {
+      attachLeaf(key, insertionPath, ! last || key < last->keys[0]);
+    }
+    size++;
+    return true;
+  }
+
+  int* end = spanning->keys + spanning->count;
+  int* position = std::lower_bound(spanning->keys, end, key);
+  if (*position == key) return false;  // Key already present
+  size++;
+
+  if (static_cast<size_t>(spanning->count) < kBlockCapacity) {
+    insertIntoBlock(spanning, key);
+    return true;
+  }
+
+  // The block is full: its largest key makes room, and becomes the smallest
+  // key of the right subtree instead.
+  int evicted = spanning->keys[--spanning->count];
+  insertIntoBlock(spanning, key);
+  if (! spanning->right) {
+    attachLeaf(evicted, insertionPath, false);
+    return true;
+  }
+
+  Node* next = spanning->right;
+  insertionPath.push(next);
+  while (next->left) {
+    next = next->left;
+    insertionPath.push(next);
+  }
+  if (static_cast<size_t>(next->count) < kBlockCapacity) {
+    insertIntoBlock(next, evicted);
+  } else {
+    attachLeaf(evicted, insertionPath, true);
+  }
+  return true;
+}
+
+void BlockScapegoatTree::insertIntoBlock(Node *node, int key) {
+  int* end = node->keys + node->count;
+  int* position = std::lower_bound(node->keys, end, key);
+  std::copy_backward(position, end, end + 1);
+  *position = key;
+  node->count++;
+}
+
+void BlockScapegoatTree::attachLeaf(int key, InsertionPath& insertionPath, bool asLeft) {
+  // Make the node to insert.
+  Node* leaf = pool.allocate();
+  leaf->left = leaf->right = nullptr;
+  leaf->count = 1;
+  leaf->keys[0] = key;
+
+  // Wire the new node into the tree.
+  Node* parent = insertionPath.top();
+  if (! parent) {
+    root = leaf;
+  } else if (asLeft) {
+    parent->left = leaf;
+  } else {
+    parent->right = leaf;
+  }
+
+  // Update tree information.
+  numNodes++;
+  if (numNodes > maxNodes) {
+    maxNodes = numNodes;
+    alphaDeepHeights.cover(maxNodes + 1);
+  }
+
+  // If the new node is too deep, find a scapegoat among its ancestors and
+  // rebuild. Its depth equals the number of ancestors on the path, below
+  // the root's (nullptr) parent.
+  size_t insertionHeight = insertionPath.size() - 1;
+  if (insertionHeight >= 1 && alphaDeepHeights.exceeds(insertionHeight, numNodes)) {
+    rebuild(findScapegoat(insertionPath));
+  }
+}
+
+BlockScapegoatTree::Scapegoat BlockScapegoatTree::findScapegoat(InsertionPath& insertionPath) {
+  // Retrieve parent (curr) and grandparent (parent) of the new node.
+  Node *curr = insertionPath.top();
+  insertionPath.pop();
+  Node *parent = insertionPath.top();
+  insertionPath.pop();
+
+  // Track current subtree size and index
+  // (i where curr is the i-th ancestor of the new node).
+  size_t currSize = countNodes(curr);
+  size_t currIndex = 1;
+
+  while (parent) {
+    // Found scapegoat if we exhausted the stack,
+    // or if index is greater than alpha-deep height.
+    if (alphaDeepHeights.exceeds(currIndex, currSize)) {
+      break;
+    }
+
+    // Update the size without revisiting any nodes already visited.
+    if (parent->left == curr) {
+      currSize += 1 + countNodes(parent->right);
+    } else {
+      currSize += 1 + countNodes(parent->left);
+    }
+
+    // Get the next ancestor from the stack.
+    curr = parent;
+    parent = insertionPath.top();
+    insertionPath.pop();
+
+    currIndex++;
+  }
+
+  return { curr, parent, currSize };
+}
+
+size_t BlockScapegoatTree::countNodes(const Node *node) {
+  if (! node) return 0;
+  return 1 + countNodes(node->left) + countNodes(node->right);
+}
+
+bool BlockScapegoatTree::remove(int key) {
+  // Find the node whose block spans the key, and its parent.
+  Node* parent = nullptr;
+  Node* curr = root;
+  while (curr) {
+    if      (key < curr->keys[0])               { parent = curr; curr = curr->left; }
+    else if (key > curr->keys[curr->count - 1]) { parent = curr; curr = curr->right; }
+    else break;
+  }
+  if (! curr) return false;
+
+  int* end = curr->keys + curr->count;
+  int* position = std::lower_bound(curr->keys, end, key);
+  if (*position != key) return false;  // Deletion failed if the key doesn't exist
+
+  std::copy(position + 1, end, position);
+  curr->count--;
+  size--;
+  if (curr->count == 0) removeEmptyNode(curr, parent);
+
+  // Finally, rebuild the entire tree if necessary.
+  rebuildIfShrunk();
+  return true;
+}
+
+void BlockScapegoatTree::removeEmptyNode(Node *node, Node *parent) {
+  if (node->left && node->right) {
+    // Refill the block with the largest key of the left subtree, which still
+    // comes before every key of the right subtree.
+    Node* predecessorParent = node;
+    Node* predecessor = node->left;
+    while (predecessor->right) {
+      predecessorParent = predecessor;
+      predecessor = predecessor->right;
+    }
+    node->keys[0] = predecessor->keys[--predecessor->count];
+    node->count = 1;
+    if (predecessor->count > 0) return;
+
+    // The predecessor's block has emptied, and it has no right child.
+    node = predecessor;
+    parent = predecessorParent;
+  }
+
+  // Replace the node with its only child, or nullptr if it is a leaf.
+  Node* child = node->left ? node->left : node->right;
+  if (! parent) {
+    root = child;
+  } else if (parent->left == node) {
+    parent->left = child;
+  } else /* if (parent->right == node) */ {
+    parent->right = child;
+  }
+  pool.deallocate(node);
+  numNodes--;
+}
+
+void BlockScapegoatTree::rebuildIfShrunk() {
+  // (A lone block may hold few keys: repacking it would change nothing.)
+  bool sparse = numNodes > 1 && size * kSparseRatio < numNodes * kBlockCapacity;
+  if (numNodes <= alpha * maxNodes || sparse) {
+    rebuild( { root, nullptr, numNodes } );
+  }
+}
+
+void BlockScapegoatTree::rebuild(Scapegoat scapegoat) {
+  // Copy the subtree's keys in order, releasing its nodes along the way.
+  rebuildKeys.clear();
+  InsertionPath ancestors(getMaxPathLength());
+  Node* rest = scapegoat.scapegoat;
+  while (rest || ! ancestors.empty()) {
+    while (rest) {
+      ancestors.push(rest);
+      rest = rest->left;
+    }
+    Node* node = ancestors.top();
+    ancestors.pop();
+
+    rebuildKeys.insert(rebuildKeys.end(), node->keys, node->keys + node->count);
+    rest = node->right;
+    pool.deallocate(node);
+  }
+
+  // Repack the keys into blocks of about kPackedBlockSize keys, but never
+  // into more blocks than before, so that the rebuilt subtree is shorter
+  // than the one it replaces.
+  size_t numKeys = rebuildKeys.size();
+  size_t numBlocks = (numKeys + kPackedBlockSize - 1) / kPackedBlockSize;
+  numBlocks = std::min(numBlocks, scapegoat.treeSize);
+  Node* subtreeRoot = buildBlocks(rebuildKeys.data(), numKeys, numBlocks, 0, numBlocks);
+  numNodes = numNodes - scapegoat.treeSize + numBlocks;
+
+  // Wire the rebuilt subtree back into the tree.
+  if (! scapegoat.parent) {
+    root = subtreeRoot;
+    maxNodes = numNodes;
+  } else if (scapegoat.scapegoat == scapegoat.parent->left) {
+    scapegoat.parent->left = subtreeRoot;
+  } else /* if (scapegoat.scapegoat == scapegoat.parent->right) */ {
+    scapegoat.parent->right = subtreeRoot;
+  }
+}
+
+BlockScapegoatTree::Node *BlockScapegoatTree::buildBlocks(
+    const int *keys, size_t numKeys, size_t numBlocks, size_t firstBlock, size_t lastBlock) {
+  if (firstBlock == lastBlock) return nullptr;
+
+  // Block i starts at key i * numKeys / numBlocks, computed without overflow.
+  size_t keysPerBlock = numKeys / numBlocks;
+  size_t extraKeys = numKeys % numBlocks;
+  auto blockStart = [&](size_t block) {
+    return block * keysPerBlock + std::min(block, extraKeys);
+  };
+
+  size_t middle = firstBlock + (lastBlock - firstBlock) / 2;
+  Node* node = pool.allocate();
+  const int* first = keys + blockStart(middle);
+  const int* last = keys + blockStart(middle + 1);
+  std::copy(first, last, node->keys);
+  node->count = static_cast<int>(last - first);
+
+  node->left = buildBlocks(keys, numKeys, numBlocks, firstBlock, middle);
+  node->right = buildBlocks(keys, numKeys, numBlocks, middle + 1, lastBlock);
+  return node;
+}
+
+bool BlockScapegoatTree::verify() const {
+  // Only the tree as a whole is guaranteed to be loosely alpha-height 
+  // balanced: nodes are only made once blocks overflow, so a subtree can 
+  // grow deep in nodes while it takes most keys into its blocks.
+  VerificationData treeProperties = verifyHelper(root);
+  int maxHeight = alphaDeepHeights.height(std::max<size_t>(maxNodes, 1)) + 1;
+  return treeProperties.height <= maxHeight && treeProperties.ordered
+      && treeProperties.numNodes == numNodes && treeProperties.numKeys == size;
+}
+
+BlockScapegoatTree::VerificationData BlockScapegoatTree::verifyHelper(const Node *node) const {
+  // Base case: if tree is empty, it is empty and ordered.
+  if (! node) {
+    return { true, 0, 0, -1, 0, 0 };
+  }
+
+  VerificationData left = verifyHelper(node->left);
+  VerificationData right = verifyHelper(node->right);
+
+  // Check that the block is sorted and lies between the subtrees' keys.
+  bool ordered = left.ordered && right.ordered
+      && node->count >= 1 && static_cast<size_t>(node->count) <= kBlockCapacity;
+  for (int i = 1; ordered && i < node->count; i++) {
+    ordered = node->keys[i - 1] < node->keys[i];
+  }
+  int minKey = node->keys[0];
+  int maxKey = ordered ? node->keys[node->count - 1] : minKey;
+  if (node->left) {
+    ordered = ordered && left.maxKey < minKey;
+    minKey = left.minKey;
+  }
+  if (node->right) {
+    ordered = ordered && right.minKey > maxKey;
+    maxKey = right.maxKey;
+  }
+
+  size_t numNodes = left.numNodes + right.numNodes + 1;
+  size_t numKeys = left.numKeys + right.numKeys + node->count;
+  int height = std::max(left.height, right.height) + 1;
+  return { ordered, numNodes, numKeys, height, minKey, maxKey };
+}
+
+void BlockScapegoatTree::printDebugInfo() const {
+  printDebugInfoRec(root, 0);
+  std::cout << std::flush;
+}
+
+void BlockScapegoatTree::printDebugInfoRec(const Node* root, unsigned indent) const {
+  if (! root) {
+    std::cout << std::setw(indent) << "" << "null" << '\n';
+  } else {
+    std::cout << std::setw(indent) << "" << "Node       " << root << '\n';
+    std::cout << std::setw(indent) << "" << "Keys:      ";
+    for (int i = 0; i < root->count; i++) {
+      std::cout << root->keys[i] << ' ';
+    }
+    std::cout << '\n';
+    std::cout << std::setw(indent) << "" << "Left Child:" << '\n';
+    printDebugInfoRec(root->left,  indent + 4);
+    std::cout << std::setw(indent) << "" << "Right Child:" << '\n';
+    printDebugInfoRec(root->right, indent + 4);
+  }
+}
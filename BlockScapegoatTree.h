@@ -0,0 +1,273 @@
+/**
+ * BlockScapegoatTree.h provides the interface for a Scapegoat Tree for
+ * integers whose nodes each hold a small sorted block of keys, filling a
+ * cache line, instead of a single key.
+ *
+ * Every key in a node's left subtree is smaller than every key in its block,
+ * and every key in its right subtree is larger, as in a T-tree. A search
+ * compares the key with the ends of one block per level, and only scans the
+ * block that spans it. Keys take about 8 bytes each instead of 24, and the
+ * tree is about log_2(8) = 3 levels shorter, so a lookup misses the cache
+ * that many fewer times.
+ *
+ * Balance works as in ScapegoatTree, on the number of nodes rather than keys:
+ * a key inserted into a node with room adds no node, and a new node deeper
+ * than the alpha-deep height of the tree's node count makes the tree rebuild
+ * its scapegoat, repacking the subtree's keys into evenly filled blocks.
+ * Nothing is ever rotated.
+ *
+ * Authors: Ryan Guan (rzgn) and Tyler Packard (TPackard), 2021
+ */
+
+#ifndef BLOCK_SCAPEGOAT_TREE_H
+#define BLOCK_SCAPEGOAT_TREE_H
+
+#include <cstddef>  // for std::size_t
+#include <vector>   // for the keys of a subtree being rebuilt
+
+#include "AlphaDeepHeightTable.h"
+#include "NodePool.h"
+#include "NodeStack.h"  // for scapegoat-node-finding stack
+
+/**
+ * Class representing a Scapegoat Tree of key blocks.
+ */
+class BlockScapegoatTree {
+  public:
+    /**
+     * Constructs a new, empty scapegoat tree with the provided alpha value.
+     * Throws std::invalid_argument if alpha is not within (0.5, 1).
+     *
+     * Time complexity: O(1)
+     */
+    explicit BlockScapegoatTree(double alpha);
+
+    /**
+     * Removes every key from the tree and frees its nodes' memory.
+     *
+     * Time complexity: O(N / chunk size)
+     */
+    void clear();
+
+    /**
+     * Returns whether the given key is present in the tree.
+     *
+     * Time complexity: O(log N)
+     */
+    bool search(int key) const;
+
+    /**
+     * Inserts the given key into the tree. If the element was added, this
+     * function returns true. If the element already existed, this function
+     * returns false and does not modify the tree.
+     *
+     * Time complexity: amortized O(log N), worst-case O(N)
+     * Space complexity: O(log N)
+     */
+    bool insert(int key);
+
+    /**
+     * Removes the given key from the tree. Returns true if the key was
+     * removed, or false if it was not present. Rebuilds the whole tree once
+     * nodes have gone (as ScapegoatTree does), or once blocks have emptied
+     * out to less than a quarter full on average.
+     *
+     * Time complexity: amortized O(log N), worst-case O(N)
+     */
+    bool remove(int key);
+
+    /**
+     * Returns whether the tree is loosely alpha-height balanced, that is, no
+     * taller than the alpha-deep height of its largest node count since the
+     * last rebuild of the whole tree plus one, with sorted blocks in search 
+     * tree order.
+     */
+    bool verify() const;
+
+    /**
+     * Prints a pre-order traversal of the tree in a nice format for debugging.
+     */
+    void printDebugInfo() const;
+
+  private:
+    // Helper structs:
+
+    // The most keys a block can hold, so that a node fills a 64-byte cache line.
+    static constexpr size_t kBlockCapacity = 11;
+
+    /**
+     * Rebuilds pack this many keys per block, leaving room for later
+     * insertions to land in existing blocks.
+     */
+    static constexpr size_t kPackedBlockSize = 8;
+
+    /**
+     * The whole tree is rebuilt once blocks hold less than 1 / kSparseRatio
+     * of their capacity on average.
+     */
+    static constexpr size_t kSparseRatio = 4;
+
+    /**
+     * Represents a node holding a block of count keys in increasing order,
+     * between the keys of its left and right subtrees.
+     */
+    struct alignas(64) Node {
+      Node*  left;
+      Node*  right;
+
+      int    count;  // The number of keys in the block, between 1 and kBlockCapacity
+      int    keys[kBlockCapacity];
+    };
+
+    /**
+     * Contains information about the "scapegoat node" useful for a rebuild.
+     */
+    struct Scapegoat {
+      Node* scapegoat;  // The node at the root of the imbalanced subtree
+      Node* parent;     // The parent of the imbalanced subtree, nullptr if scapegoat == root
+
+      size_t treeSize;  // The number of nodes in the scapegoat node's subtree
+    };
+
+    /**
+     * Stack of the ancestors of an inserted node. Blocks make the tree short,
+     * so paths this long cover any tree with alpha up to about 0.75.
+     */
+    static constexpr size_t kInlinePathCapacity = 128;
+    using InsertionPath = NodeStack<Node, kInlinePathCapacity>;
+
+    /**
+     * Data used to verify the correctness of a subtree.
+     */
+    struct VerificationData {
+      bool ordered;   // Whether or not the blocks are sorted and in search tree order.
+
+      size_t numNodes;  // Number of nodes in the subtree.
+      size_t numKeys;   // Number of keys in the subtree.
+      int height;       // Height of the subtree (-1 if the tree is empty)
+      int minKey;       // Smallest key in the subtree, if not empty
+      int maxKey;       // Largest key in the subtree, if not empty
+    };
+
+
+    // Attributes of the tree:
+
+    NodePool<Node> pool;  // Owns the memory of every node in the tree.
+
+    Node* root = nullptr;
+    size_t size = 0;      // Current number of keys in the tree.
+    size_t numNodes = 0;  // Current number of nodes in the tree.
+    size_t maxNodes = 0;  // Max number of nodes since last rebuild of the whole tree.
+
+    static constexpr double kMinAlpha = 0.5;
+    static constexpr double kMaxAlpha = 1.0;
+    double alpha;
+
+    /**
+     * The node counts at which the alpha-deep height increases, covering
+     * counts up to at least maxNodes + 1.
+     */
+    AlphaDeepHeightTable alphaDeepHeights;
+
+    // Scratch buffer for the keys of a subtree being rebuilt, kept between rebuilds.
+    std::vector<int> rebuildKeys;
+
+
+    // Helper functions:
+
+    /**
+     * Returns an upper bound on the number of nodes on any root-to-leaf path
+     * after the next insertion, plus one for the root's (nullptr) parent.
+     */
+    size_t getMaxPathLength() const {
+      return alphaDeepHeights.height(maxNodes + 1) + 3;
+    }
+
+    /**
+     * Insert subroutine:
+     * Inserts the given key into the block of the given node, which must
+     * have room for it and not hold it already.
+     */
+    static void insertIntoBlock(Node *node, int key);
+
+    /**
+     * Insert subroutine:
+     * Adds a new node holding only the given key as the left (if asLeft) or
+     * right child of the node on top of the given insertion path (or as the
+     * root, if that is nullptr), then rebuilds a scapegoat if the new node
+     * is too deep.
+     */
+    void attachLeaf(int key, InsertionPath& insertionPath, bool asLeft);
+
+    /**
+     * Insert subroutine:
+     * Given the ancestors of a too deep new node, in order of descending depth
+     * on top of the stack, returns the deepest ancestor such that its height
+     * along the path is > the alpha-deep height of its node count, along with
+     * its parent and node count. See ScapegoatTree::findScapegoat.
+     *
+     * Time complexity: O(number of nodes in the scapegoat's subtree)
+     */
+    Scapegoat findScapegoat(InsertionPath& insertionPath);
+
+    /**
+     * Returns the number of nodes in the subtree rooted at the given node.
+     *
+     * Time complexity: O(number of nodes in the subtree)
+     */
+    static size_t countNodes(const Node *node);
+
+    /**
+     * Remove subroutine:
+     * Takes the given node, whose block has emptied, out of the tree. A node
+     * with two children takes the largest key of its left subtree instead,
+     * and the node that key came from goes if its block empties in turn.
+     *
+     * Parameters: parent is node's parent, or nullptr if node is the root.
+     */
+    void removeEmptyNode(Node *node, Node *parent);
+
+    /**
+     * Remove subroutine:
+     * Rebuilds the whole tree if it has lost too many nodes since the last
+     * rebuild of the whole tree, or if its blocks have become sparse.
+     */
+    void rebuildIfShrunk();
+
+    /**
+     * Rebuilds the subtree rooted at the given scapegoat node into a
+     * perfectly balanced tree of evenly filled blocks, with no more nodes
+     * than before, and rewires it to its parent.
+     *
+     * Time complexity: O(number of keys in the subtree)
+     * Space complexity: O(number of keys in the subtree), in rebuildKeys
+     */
+    void rebuild(Scapegoat scapegoat);
+
+    /**
+     * Rebuild subroutine:
+     * Returns the root of a perfectly balanced tree of the blocks numbered
+     * [firstBlock, lastBlock) out of numBlocks blocks among which the
+     * numKeys keys are spread evenly, in order.
+     *
+     * Time complexity: O(number of keys in the blocks)
+     * Space complexity: O(log numBlocks), in recursive calls
+     */
+    Node* buildBlocks(const int *keys, size_t numKeys, size_t numBlocks,
+                      size_t firstBlock, size_t lastBlock);
+
+    /**
+     * Verify helper:
+     * Returns the properties of the subtree rooted at the given node.
+     */
+    VerificationData verifyHelper(const Node *node) const;
+
+    /**
+     * PrintDebugInfo helper.
+     * Prints information about this root and its subtrees
+     * at the given level of indentation.
+     */
+    void printDebugInfoRec(const Node* root, unsigned indent) const;
+};
+
+#endif // BLOCK_SCAPEGOAT_TREE_H
@@ -0,0 +1,413 @@
+/**
+ * FrozenScapegoatTree.h provides an immutable snapshot of a generic Scapegoat
+ * Tree, made by ScapegoatTree::freeze(), for read-mostly workloads.
+ *
+ * The snapshot is a perfectly balanced search tree over the same keys, laid
+ * out in one contiguous array in van Emde Boas order: the top half of the
+ * levels is laid out recursively first, followed by each subtree hanging
+ * below it, also laid out recursively. Every root-to-leaf path then touches
+ * O(log_B N) cache lines for any cache line size B, instead of about one per
+ * level once the tree outgrows the cache. Children are referred to by 32-bit
+ * indices into the array rather than pointers, so nodes are smaller too.
+ *
+ * Authors: Ryan Guan (rzgn) and Tyler Packard (TPackard), 2021
+ */
+
+#ifndef FROZEN_SCAPEGOAT_TREE_H
+#define FROZEN_SCAPEGOAT_TREE_H
+
+#include <cstddef>    // for std::size_t, std::ptrdiff_t
+#include <cstdint>    // for std::uint32_t
+#include <functional> // for std::less
+#include <iterator>   // for std::bidirectional_iterator_tag, std::reverse_iterator
+#include <limits>     // for std::numeric_limits
+#include <memory>     // for std::allocator, std::allocator_traits
+#include <stdexcept>  // for std::length_error
+#include <utility>    // for std::pair
+#include <vector>     // for the node array and the in-order index
+
+#include "GenericScapegoatTree.h"
+
+template<typename T, typename Compare, typename Allocator>
+class FrozenScapegoatTree : private ComparatorHolder<Compare> {
+  // Trees freeze themselves through the private constructor.
+  template<typename, typename, typename, typename>
+  friend class ScapegoatTree;
+
+  public:
+    /**
+     * Constructs an empty snapshot.
+     */
+    explicit FrozenScapegoatTree(const Compare& compare = Compare(),
+                                 const Allocator& allocator = Allocator())
+      : ComparatorHolder<Compare>(compare), nodes(NodeAllocator(allocator)),
+        inOrder(IndexAllocator(allocator)) {}
+
+    /**
+     * Bidirectional iterator over the keys of the snapshot in increasing
+     * order. Snapshots never change, so iterators stay valid as long as the
+     * snapshot does.
+     */
+    class const_iterator;
+    using iterator = const_iterator;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+    using reverse_iterator = const_reverse_iterator;
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const   { return const_iterator(this, inOrder.size()); }
+
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+    const_reverse_iterator rend() const   { return const_reverse_iterator(begin()); }
+
+    /**
+     * Returns whether the given key is present in the snapshot. The
+     * transparent overload takes a value of any type the comparator can
+     * compare to keys, as for ScapegoatTree.
+     *
+     * Time complexity: O(log N), in O(log_B N) cache misses
+     */
+    bool search(const T& key) const {
+      return findBound(key, BoundKind::kEqual) != inOrder.size();
+    }
+
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    bool search(const K& key) const {
+      return findBound(key, BoundKind::kEqual) != inOrder.size();
+    }
+
+    /**
+     * Same as search, including the overload for transparent comparators.
+     */
+    bool contains(const T& key) const {
+      return search(key);
+    }
+
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    bool contains(const K& key) const {
+      return search(key);
+    }
+
+    /**
+     * Returns an iterator to the key equivalent to the given key, or end()
+     * if there is none.
+     *
+     * Time complexity: O(log N)
+     */
+    const_iterator find(const T& key) const {
+      return const_iterator(this, findBound(key, BoundKind::kEqual));
+    }
+
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    const_iterator find(const K& key) const {
+      return const_iterator(this, findBound(key, BoundKind::kEqual));
+    }
+
+    /**
+     * Returns an iterator to the smallest key which does not come before the
+     * given key, or end() if there is none.
+     *
+     * Time complexity: O(log N)
+     */
+    const_iterator lower_bound(const T& key) const {
+      return const_iterator(this, findBound(key, BoundKind::kLower));
+    }
+
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    const_iterator lower_bound(const K& key) const {
+      return const_iterator(this, findBound(key, BoundKind::kLower));
+    }
+
+    /**
+     * Returns an iterator to the smallest key which comes after the given
+     * key, or end() if there is none.
+     *
+     * Time complexity: O(log N)
+     */
+    const_iterator upper_bound(const T& key) const {
+      return const_iterator(this, findBound(key, BoundKind::kUpper));
+    }
+
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    const_iterator upper_bound(const K& key) const {
+      return const_iterator(this, findBound(key, BoundKind::kUpper));
+    }
+
+    /**
+     * Returns the range of keys equivalent to the given key:
+     * { lower_bound(key), upper_bound(key) }.
+     *
+     * Time complexity: O(log N)
+     */
+    std::pair<const_iterator, const_iterator> equal_range(const T& key) const {
+      return equalRange(key);
+    }
+
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    std::pair<const_iterator, const_iterator> equal_range(const K& key) const {
+      return equalRange(key);
+    }
+
+    /**
+     * Returns the number of keys in the snapshot.
+     */
+    size_t size() const { return inOrder.size(); }
+    bool empty() const  { return inOrder.empty(); }
+
+    /**
+     * Returns the most keys a snapshot can hold, as nodes refer to each other
+     * by 32-bit index.
+     */
+    static constexpr size_t max_size() { return std::numeric_limits<std::uint32_t>::max(); }
+
+  private:
+    // Helper structs:
+
+    /**
+     * A node of the snapshot. The root is always at index 0, so it can never
+     * be a child, and index 0 stands for no child instead.
+     */
+    struct Node {
+      T              key;
+
+      std::uint32_t  left;
+      std::uint32_t  right;
+      std::uint32_t  rank;  // The number of smaller keys in the snapshot
+    };
+
+    static constexpr std::uint32_t kNoChild = 0;
+
+    /**
+     * The keys at positions [lo, hi) in sorted order, which form a subtree
+     * rooted at the middle one, keys[lo + (hi - lo) / 2].
+     */
+    struct Range {
+      size_t lo;
+      size_t hi;
+
+      size_t middle() const { return lo + (hi - lo) / 2; }
+      bool empty() const    { return lo == hi; }
+    };
+
+    /**
+     * The key findBound looks for, relative to the given value.
+     */
+    enum class BoundKind {
+      kEqual,  // An equivalent key
+      kLower,  // The smallest key not before the value
+      kUpper   // The smallest key after the value
+    };
+
+    using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+    using IndexAllocator =
+        typename std::allocator_traits<Allocator>::template rebind_alloc<std::uint32_t>;
+
+
+    // Attributes of the snapshot:
+
+    std::vector<Node, NodeAllocator> nodes;  // In van Emde Boas order, root first
+    std::vector<std::uint32_t, IndexAllocator> inOrder;  // Node indices in order of keys
+
+
+    /**
+     * Freeze subroutine:
+     * Lays out a balanced tree holding the given keys, which must be sorted
+     * and unique. The keys are copied.
+     *
+     * Throws std::length_error if there are too many keys for 32-bit indices.
+     *
+     * Time complexity: O(N log log N)
+     */
+    FrozenScapegoatTree(const Compare& compare, const Allocator& allocator,
+                        const std::vector<const T*>& keys)
+        : FrozenScapegoatTree(compare, allocator) {
+      size_t numKeys = keys.size();
+      if (numKeys > max_size()) {
+        throw std::length_error("Too many keys to freeze a scapegoat tree");
+      }
+      if (numKeys == 0) return;
+
+      // Find the order of the subtrees' roots in the array first, then the
+      // index of every key, which the children's indices are read from.
+      std::vector<Range> layout;
+      layout.reserve(numKeys);
+      layOut({ 0, numKeys }, getBalancedHeight(numKeys) + 1, layout, nullptr);
+
+      inOrder.resize(numKeys);
+      for (size_t i = 0; i < numKeys; i++) {
+        inOrder[layout[i].middle()] = static_cast<std::uint32_t>(i);
+      }
+
+      nodes.reserve(numKeys);
+      for (const Range& subtree : layout) {
+        size_t middle = subtree.middle();
+        Range left = { subtree.lo, middle };
+        Range right = { middle + 1, subtree.hi };
+        nodes.push_back(Node{ *keys[middle],
+                              left.empty()  ? kNoChild : inOrder[left.middle()],
+                              right.empty() ? kNoChild : inOrder[right.middle()],
+                              static_cast<std::uint32_t>(middle) });
+      }
+    }
+
+    /**
+     * Freeze subroutine:
+     * Appends the roots of the top `height` levels of the given subtree to
+     * layout in van Emde Boas order, and the subtrees hanging below those
+     * levels, from left to right, to below (if not nullptr).
+     *
+     * Time complexity: O(size of the top levels * log height)
+     */
+    static void layOut(Range subtree, size_t height, std::vector<Range>& layout,
+                       std::vector<Range>* below) {
+      if (subtree.empty()) return;
+
+      // Two levels or fewer are laid out top to bottom.
+      size_t middle = subtree.middle();
+      Range children[2] = { { subtree.lo, middle }, { middle + 1, subtree.hi } };
+      if (height <= 2) {
+        layout.push_back(subtree);
+        for (const Range& child : children) {
+          if (height == 1) {
+            if (below) below->push_back(child);
+          } else if (! child.empty()) {
+            layout.push_back(child);
+            size_t childMiddle = child.middle();
+            if (below) {
+              below->push_back({ child.lo, childMiddle });
+              below->push_back({ childMiddle + 1, child.hi });
+            }
+          }
+        }
+        return;
+      }
+
+      // Otherwise, lay out the top half of the levels, then each subtree
+      // hanging below them.
+      size_t topHeight = height / 2;
+      std::vector<Range> middleSubtrees;
+      middleSubtrees.reserve(size_t(1) << topHeight);
+      layOut(subtree, topHeight, layout, &middleSubtrees);
+      for (const Range& middleSubtree : middleSubtrees) {
+        layOut(middleSubtree, height - topHeight, layout, below);
+      }
+    }
+
+    /**
+     * Returns floor(log_2(size)), the height of a 1/2-weight-balanced tree
+     * of given (nonzero) size.
+     */
+    static size_t getBalancedHeight(size_t size) {
+      size_t height = 0;
+      while (size >>= 1) height++;
+      return height;
+    }
+
+    /**
+     * Find, lower_bound and upper_bound subroutine:
+     * Returns the rank of the key of the given kind, or size() if there is
+     * none.
+     *
+     * Time complexity: O(log N)
+     */
+    template<typename K>
+    size_t findBound(const K& key, BoundKind kind) const {
+      size_t bound = inOrder.size();
+      if (nodes.empty()) return bound;
+
+      const Node* curr = &nodes[0];
+      while (true) {
+        int order = compareThreeWay(this->comparator(), key, curr->key);
+        std::uint32_t next;
+        if (order < 0 || (order == 0 && kind != BoundKind::kUpper)) {
+          if (kind != BoundKind::kEqual || order == 0) bound = curr->rank;
+          if (order == 0) break;
+          next = curr->left;
+        } else {
+          next = curr->right;
+        }
+        if (next == kNoChild) break;
+        curr = &nodes[next];
+      }
+      return bound;
+    }
+
+    /**
+     * Equal_range subroutine:
+     * Keys are unique, so the range holds at most the lower bound.
+     *
+     * Time complexity: O(log N)
+     */
+    template<typename K>
+    std::pair<const_iterator, const_iterator> equalRange(const K& key) const {
+      size_t first = findBound(key, BoundKind::kLower);
+      size_t last = first;
+      if (last != inOrder.size() &&
+          compareThreeWay(this->comparator(), key, nodes[inOrder[last]].key) == 0) {
+        last++;
+      }
+      return { const_iterator(this, first), const_iterator(this, last) };
+    }
+
+  public:
+    /**
+     * Iterator over the keys of a snapshot, holding the rank of its key.
+     * Stepping to the next key reads the in-order index of nodes, so a full
+     * scan reads the array once in key order.
+     */
+    class const_iterator {
+      public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type        = T;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const T*;
+        using reference         = const T&;
+
+        const_iterator() = default;
+
+        reference operator*() const  { return tree->nodes[tree->inOrder[rank]].key; }
+        pointer   operator->() const { return &**this; }
+
+        const_iterator& operator++() { rank++; return *this; }
+        const_iterator& operator--() { rank--; return *this; }
+
+        const_iterator operator++(int) {
+          const_iterator old = *this;
+          rank++;
+          return old;
+        }
+
+        const_iterator operator--(int) {
+          const_iterator old = *this;
+          rank--;
+          return old;
+        }
+
+        bool operator==(const const_iterator& other) const { return rank == other.rank; }
+        bool operator!=(const const_iterator& other) const { return rank != other.rank; }
+
+      private:
+        friend class FrozenScapegoatTree;
+
+        const FrozenScapegoatTree* tree = nullptr;
+        size_t rank = 0;  // The number of smaller keys, size() past the largest one
+
+        const_iterator(const FrozenScapegoatTree* tree, size_t rank)
+          : tree(tree), rank(rank) {}
+    };
+};
+
+template<typename T, typename Compare, typename Allocator, typename Options>
+FrozenScapegoatTree<T, Compare, Allocator>
+ScapegoatTree<T, Compare, Allocator, Options>::freeze() const {
+  // Read the keys with the same in-order flatten a rebuild uses.
+  std::vector<const T*> keys;
+  keys.reserve(size);
+  Flattener flattener(root, getMaxPathLength());
+  for (size_t i = 0; i < size; i++) {
+    keys.push_back(&flattener.next()->key);
+  }
+  return FrozenScapegoatTree<T, Compare, Allocator>(
+      this->comparator(), pool.getAllocator(), keys);
+}
+
+#endif // FROZEN_SCAPEGOAT_TREE_H
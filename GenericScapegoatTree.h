@@ -1,128 +1,1212 @@
 /**
  * GenericScapegoatTree.h is a template Scapegoat Tree that stores
- * objects of generic types along with an optional "less-than" function 
- * which must provide a strict ordering of the contained type.
+ * objects of generic types along with an optional "less-than" comparator 
+ * which must provide a strict ordering of the contained type, and an optional
+ * allocator from which the tree's node pool obtains its memory.
+ * 
+ * The comparator is a function object type (std::less<T> by default), so that
+ * comparisons can be inlined, and comparators without state take up no room 
+ * in the tree. Trees built from a plain comparison function, as in 
+ * ScapegoatTree<T, bool (*)(const T&, const T&)>, still work: the function's
+ * type is deduced when one is passed to the constructor, as in 
+ * ScapegoatTree tree(alpha, isLessThan). Trees with the default comparator
+ * no longer take a comparison function, so that they hold no room for one.
+ * 
+ * Further compile-time options are passed as an Options struct: see 
+ * DefaultScapegoatOptions.
  * 
  * Authors: Ryan Guan (rzgn) and Tyler Packard (TPackard), 2021
  * 
  * Stanford CS166 project partners: Nali Welinder and Parker Jou
  */ 
 
-#include <cstddef>    // for std::size_t
-#include <stack>      // for scapegoat-node-finding stack
-#include <cmath>      // for floor, log
+#ifndef GENERIC_SCAPEGOAT_TREE_H
+#define GENERIC_SCAPEGOAT_TREE_H
+
+#include <algorithm>  // for std::max, std::stable_sort, std::unique, std::adjacent_find, std::set_union
+#include <chrono>     // for std::chrono::steady_clock
+#include <cstddef>    // for std::size_t, std::ptrdiff_t
+#include <functional> // for std::less
 #include <stdexcept>  // for std::invalid_argument
+#include <string>     // for std::basic_string, which compares through its compare member
+#include <string_view>  // for std::basic_string_view, likewise
 #include <iostream>   // for std::cout, flush
 #include <iomanip>    // for std::setw
+#include <iterator>   // for std::iterator_traits, std::distance, std::make_move_iterator, std::back_inserter, std::bidirectional_iterator_tag
+#include <memory>     // for std::allocator
+#include <new>        // for placement new
+#include <type_traits>  // for std::conditional_t, std::is_trivially_destructible, std::is_empty, std::void_t, std::decay_t, std::conjunction
+#include <utility>    // for std::move, std::forward, std::declval
+#include <vector>     // for bulk-loaded and batch-inserted keys
+
+#if defined(__cpp_impl_three_way_comparison) && __has_include(<compare>)
+#include <compare>    // for operator <=>
+#ifdef __cpp_lib_three_way_comparison
+#define SCAPEGOAT_HAS_THREE_WAY_COMPARISON
+#endif
+#endif
+
+#include "AlphaDeepHeightTable.h"
+#include "NodePool.h"
+#include "NodeStack.h"  // for scapegoat-node-finding stack and iterator paths
+#include "RebuildListener.h"
+#include "RebuildStats.h"
 
 /**
  * Default comparison function: uses < to compare two objects of generic type.
- * As a result, either a comparison function must be specified when creating
- * the tree, or the contained type should overload operator <.
+ * Trees compared through function pointers use it unless another comparison
+ * function is specified when creating the tree.
  */ 
 template<typename T>
 bool defaultIsLessThan(const T& lhs, const T& rhs) {
   return lhs < rhs;
 }
 
+/**
+ * Detects comparators which can also compare a value of type K to a key of
+ * type T three ways, through a compare(lhs, rhs) member returning a negative
+ * value, zero or a positive value when lhs comes before, is equal to or 
+ * comes after rhs.
+ */ 
+template<typename Compare, typename K, typename T, typename = void>
+struct HasThreeWayCompare : std::false_type {};
+
+template<typename Compare, typename K, typename T>
+struct HasThreeWayCompare<Compare, K, T, std::void_t<decltype(
+    std::declval<const Compare&>().compare(std::declval<const K&>(), 
+                                           std::declval<const T&>()) < 0)>> 
+  : std::true_type {};
+
+/**
+ * Tells whether keys of type T compare themselves to other values three ways
+ * through a compare(other) member agreeing with <, as std::string and 
+ * std::string_view do. Members named compare mean other things in other 
+ * types, so only these opt in; specialize this trait to opt in another type.
+ */ 
 template<typename T>
-class ScapegoatTree {
+struct ComparesThroughMember : std::false_type {};
+
+template<typename Char, typename Traits, typename Allocator>
+struct ComparesThroughMember<std::basic_string<Char, Traits, Allocator>> : std::true_type {};
+
+template<typename Char, typename Traits>
+struct ComparesThroughMember<std::basic_string_view<Char, Traits>> : std::true_type {};
+
+/**
+ * Detects keys which compare themselves to a value of type K (by default,
+ * another key) through a compare(other) member returning an integer other
+ * than bool. Only probed for types which opt in through ComparesThroughMember.
+ */ 
+template<typename T, typename K = T, typename = void>
+struct HasCompareMember : std::false_type {};
+
+template<typename T, typename K>
+struct HasCompareMember<T, K, std::void_t<decltype(
+    std::declval<const T&>().compare(std::declval<const K&>()))>> {
+  using Result = decltype(std::declval<const T&>().compare(std::declval<const K&>()));
+  static constexpr bool value = 
+      std::is_integral<Result>::value && ! std::is_same<Result, bool>::value;
+};
+
+/**
+ * Converts the result of a three-way comparison to a negative value, 
+ * zero or a positive value.
+ */ 
+template<typename Order>
+int toOrder(Order order) {
+  return order < 0 ? -1 : order > 0 ? 1 : 0;
+}
+
+/**
+ * Returns a negative value, zero or a positive value when lhs comes before,
+ * is equal to or comes after rhs according to the given less-than comparator,
+ * in a single comparison if possible: through the comparator's own 
+ * compare(lhs, rhs) if it has one, and for std::less, through the compare 
+ * member of rhs if its type opts in (see ComparesThroughMember) or operator
+ * <=>. Otherwise, this takes two calls to the comparator when the values are
+ * equal.
+ */ 
+template<typename Compare, typename K, typename T>
+int compareThreeWay(const Compare& compare, const K& lhs, const T& rhs) {
+  constexpr bool comparesWithLess = 
+      std::is_same<Compare, std::less<T>>::value || std::is_same<Compare, std::less<>>::value;
+
+  if constexpr (HasThreeWayCompare<Compare, K, T>::value) {
+    return toOrder(compare.compare(lhs, rhs));
+  } else if constexpr (comparesWithLess && 
+      std::conjunction<ComparesThroughMember<T>, HasCompareMember<T, K>>::value) {
+    return -toOrder(rhs.compare(lhs));
+#ifdef SCAPEGOAT_HAS_THREE_WAY_COMPARISON
+  } else if constexpr (comparesWithLess && std::three_way_comparable_with<K, T>) {
+    return toOrder(lhs <=> rhs);
+#endif
+  } else {
+    if (compare(lhs, rhs)) return -1;
+    return compare(rhs, lhs) ? 1 : 0;
+  }
+}
+
+/**
+ * Holds the comparator of a scapegoat tree. Comparators without state, such
+ * as std::less, are held as an empty base class so that they take up no room.
+ */ 
+template<typename Compare, 
+         bool IsEmpty = std::is_empty<Compare>::value && ! std::is_final<Compare>::value>
+class ComparatorHolder {
+  public:
+    explicit ComparatorHolder(const Compare& compare) : compare(compare) {}
+
+    const Compare& comparator() const { return compare; }
+
+  private:
+    Compare compare;
+};
+
+template<typename Compare>
+class ComparatorHolder<Compare, true> : private Compare {
+  public:
+    explicit ComparatorHolder(const Compare& compare) : Compare(compare) {}
+
+    const Compare& comparator() const { return *this; }
+};
+
+/**
+ * Compile-time options of a scapegoat tree. To change an option, derive
+ * from this struct and hide the corresponding member.
+ */ 
+struct DefaultScapegoatOptions {
+  /**
+   * Whether every node stores the size of its subtree, giving up the 
+   * "no additional information per node" property. Sizes are kept up to date
+   * along insertion and removal paths, so finding a scapegoat takes 
+   * O(log N) time instead of O(size of the scapegoat's subtree).
+   */
+  static constexpr bool kTrackSubtreeSizes = false;
+
+  /**
+   * Whether the tree counts its rebuilds, their sizes and their time, as 
+   * reported by stats(). See RebuildStats.h.
+   */
+  static constexpr bool kCollectStats = false;
+
+  /**
+   * Whether a RebuildListener can be told of each rebuild right before and
+   * after it happens, through setRebuildListener. See RebuildListener.h.
+   */
+  static constexpr bool kRebuildEvents = false;
+};
+
+/**
+ * Options for a scapegoat tree whose nodes store their subtree sizes.
+ */ 
+struct SizeAugmentedOptions : DefaultScapegoatOptions {
+  static constexpr bool kTrackSubtreeSizes = true;
+};
+
+template<typename K, typename V, typename Compare, typename Allocator, typename Options>
+class ScapegoatMap;
+
+template<typename T, typename Compare, typename Allocator>
+class FrozenScapegoatTree;
+
+template<typename T, typename Compare = std::less<T>, 
+         typename Allocator = std::allocator<T>,
+         typename Options = DefaultScapegoatOptions>
+class ScapegoatTree : private ComparatorHolder<Compare>,
+                      private RebuildStatsHolder<Options::kCollectStats>,
+                      private RebuildListenerHolder<Options::kRebuildEvents> {
+  // Maps keep their entries in a tree, and reach into its nodes.
+  template<typename, typename, typename, typename, typename>
+  friend class ScapegoatMap;
+
   public:
     /**
      * Constructs a new, empty scapegoat tree with the provided alpha value
-     * and provided comparison function.
+     * and provided comparator, which may also be a comparison function when
+     * Compare is a function pointer type. Nodes are allocated in chunks
+     * obtained from the provided allocator.
      * 
      * Throws std::invalid_argument if alpha is not within (0.5, 1).
      */
-    ScapegoatTree(double alpha, bool isLessThan(const T&, const T&)) {
+    ScapegoatTree(double alpha, const Compare& compare,
+                  const Allocator& allocator = Allocator())
+      : ComparatorHolder<Compare>(compare), pool(allocator) {
       checkInvalidAlpha(alpha);
       this->alpha = alpha;
-      this->isLessThan = isLessThan;
+      this->alphaDeepHeights = AlphaDeepHeightTable(alpha);
     }
 
     /**
      * Constructs a new, empty scapegoat tree with the provided alpha value
-     * and the < operator as the comparison function.
+     * and a default-constructed comparator, or defaultIsLessThan when Compare
+     * is a function pointer type. Nodes are allocated in chunks obtained 
+     * from the provided allocator.
      * 
      * Throws std::invalid_argument if alpha is not within (0.5, 1).
      */
-    ScapegoatTree(double alpha) {
-      checkInvalidAlpha(alpha);
-      this->alpha = alpha;
-      this->isLessThan = &defaultIsLessThan;
+    ScapegoatTree(double alpha, const Allocator& allocator = Allocator())
+      : ScapegoatTree(alpha, getDefaultComparator(), allocator) {}
+
+    /**
+     * Trees whose Compare is the default std::less<T> cannot be ordered by a
+     * comparison function, as ScapegoatTree<T>(alpha, isLessThan) once was:
+     * they would have to hold it and check for it on every comparison. Leave
+     * out the template arguments instead, as in 
+     * ScapegoatTree tree(alpha, isLessThan), so that Compare is deduced as
+     * the function's pointer type.
+     */
+    template<typename C = Compare, 
+             typename = std::enable_if_t<std::is_same<C, std::less<T>>::value>>
+    ScapegoatTree(double alpha, bool (*isLessThan)(const T&, const T&),
+                  const Allocator& allocator = Allocator()) = delete;
+
+    /**
+     * Constructs a new scapegoat tree with the provided alpha value and 
+     * provided comparator, holding the keys in the range [first, last). 
+     * See assign.
+     * 
+     * Throws std::invalid_argument if alpha is not within (0.5, 1).
+     */
+    template<typename InputIt>
+    ScapegoatTree(double alpha, InputIt first, InputIt last,
+                  const Compare& compare,
+                  const Allocator& allocator = Allocator())
+      : ScapegoatTree(alpha, compare, allocator) {
+      assign(first, last);
+    }
+
+    /**
+     * Constructs a new scapegoat tree with the provided alpha value and 
+     * a default comparator, holding the keys in the range [first, last). 
+     * See assign.
+     * 
+     * Throws std::invalid_argument if alpha is not within (0.5, 1).
+     */
+    template<typename InputIt>
+    ScapegoatTree(double alpha, InputIt first, InputIt last,
+                  const Allocator& allocator = Allocator())
+      : ScapegoatTree(alpha, allocator) {
+      assign(first, last);
+    }
+
+    /**
+     * Frees all memory allocated by this scapegoat tree. Nodes live in the
+     * tree's node pool, so unless keys need destructors to run, this frees 
+     * whole chunks instead of walking the tree.
+     * 
+     * Time complexity: O(N / chunk size) for trivially destructible keys, 
+     * O(N) otherwise
+     */
+    ~ScapegoatTree() {
+      // The pool's destructor frees the memory of all nodes at once.
+      destroyAllNodes();
+    }
+
+    /**
+     * Replaces the contents of the tree with the keys in the range 
+     * [first, last), building a perfectly balanced tree in one pass instead
+     * of inserting the keys one at a time. 
+     * 
+     * Keys sorted in strictly increasing order (and read through forward 
+     * iterators) are copied straight into the tree. Any other range is first
+     * copied and stably sorted, and only the first of several equal keys 
+     * is kept, just as if the keys had been inserted in order.
+     * 
+     * Time complexity: O(N) for sorted keys, O(N log N) otherwise
+     * Space complexity: O(1) for sorted keys, O(N) otherwise
+     */
+    template<typename InputIt>
+    void assign(InputIt first, InputIt last) {
+      using Category = typename std::iterator_traits<InputIt>::iterator_category;
+      auto notLessThan = [this](const T& lhs, const T& rhs) {
+        return ! isLessThan(lhs, rhs);
+      };
+
+      if constexpr (std::is_base_of_v<std::forward_iterator_tag, Category>) {
+        if (std::adjacent_find(first, last, notLessThan) == last) {
+          assignSorted(first, std::distance(first, last));
+          return;
+        }
+      }
+
+      std::vector<T> keys(first, last);
+      sortUniqueKeys(keys);
+      assignSorted(std::make_move_iterator(keys.begin()), keys.size());
+    }
+
+    /**
+     * Removes every key from the tree and frees its nodes' memory.
+     * 
+     * Time complexity: O(N / chunk size) for trivially destructible keys, 
+     * O(N) otherwise
+     */
+    void clear() {
+      destroyAllNodes();
+      pool.clear();
+      root = nullptr;
+      size = maxSize = 0;
+    }
+
+    /**
+     * Returns whether the given key is present in the tree.
+     * 
+     * Time complexity: O(log N)
+     */
+    bool search(const T& key) const {
+      return findNode(key) != nullptr;
+    }
+
+    /**
+     * Returns whether a key equivalent to the given value, of any type the 
+     * comparator can compare to keys, is present in the tree. Only available
+     * for transparent comparators (such as std::less<>), so that looking up 
+     * a std::string_view among std::string keys copies nothing.
+     * 
+     * Time complexity: O(log N)
+     */
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    bool search(const K& key) const {
+      return findNode(key) != nullptr;
+    }
+
+    /**
+     * Same as search, including the overload for transparent comparators.
+     */
+    bool contains(const T& key) const {
+      return findNode(key) != nullptr;
+    }
+
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    bool contains(const K& key) const {
+      return findNode(key) != nullptr;
+    }
+
+    /**
+     * Bidirectional iterator over the keys of the tree in increasing order,
+     * defined at the end of the class. Any insertion or removal invalidates
+     * every iterator.
+     */
+    class const_iterator;
+    using iterator = const_iterator;
+
+    /**
+     * Bidirectional iterator over the keys of the tree in decreasing order,
+     * used like std::reverse_iterator<const_iterator> and defined at the end
+     * of the class.
+     */
+    class const_reverse_iterator;
+    using reverse_iterator = const_reverse_iterator;
+
+    /**
+     * Returns an iterator to the smallest key in the tree, or end() if the
+     * tree is empty.
+     * 
+     * Time complexity: O(log N)
+     */
+    const_iterator begin() const {
+      const_iterator it(this, getMaxPathLength());
+      it.pushSpine(root, true);
+      return it;
+    }
+
+    /**
+     * Returns an iterator past the largest key in the tree.
+     * 
+     * Time complexity: O(1)
+     */
+    const_iterator end() const {
+      return const_iterator(this, 0);
+    }
+
+    /**
+     * Returns reverse iterators, visiting keys in decreasing order.
+     * 
+     * Time complexity: O(log N) for rbegin, O(1) for rend
+     */
+    const_reverse_iterator rbegin() const {
+      // The path to the largest key is sized for, unlike end()'s.
+      return const_reverse_iterator(const_iterator(this, getMaxPathLength()));
+    }
+
+    const_reverse_iterator rend() const {
+      const_reverse_iterator it;
+      it.current = end();
+      return it;
+    }
+
+    /**
+     * Returns an iterator to the key in the tree equivalent to the given key, 
+     * or end() if there is none. The transparent overload takes a value of 
+     * any type the comparator can compare to keys.
+     * 
+     * Time complexity: O(log N)
+     */
+    const_iterator find(const T& key) const {
+      return findBound(key, BoundKind::kEqual);
+    }
+
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    const_iterator find(const K& key) const {
+      return findBound(key, BoundKind::kEqual);
+    }
+
+    /**
+     * Returns an iterator to the smallest key in the tree which does not come
+     * before the given key, or end() if there is none. Scanning k keys from 
+     * there takes O(log N + k) time. The transparent overload takes a value 
+     * of any type the comparator can compare to keys.
+     * 
+     * Time complexity: O(log N)
+     */
+    const_iterator lower_bound(const T& key) const {
+      return findBound(key, BoundKind::kLower);
+    }
+
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    const_iterator lower_bound(const K& key) const {
+      return findBound(key, BoundKind::kLower);
+    }
+
+    /**
+     * Returns an iterator to the smallest key in the tree which comes after 
+     * the given key, or end() if there is none. The transparent overload 
+     * takes a value of any type the comparator can compare to keys.
+     * 
+     * Time complexity: O(log N)
+     */
+    const_iterator upper_bound(const T& key) const {
+      return findBound(key, BoundKind::kUpper);
+    }
+
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    const_iterator upper_bound(const K& key) const {
+      return findBound(key, BoundKind::kUpper);
+    }
+
+    /**
+     * Returns the range of keys equivalent to the given key:
+     * { lower_bound(key), upper_bound(key) }.
+     * The transparent overload takes a value of any type the comparator can
+     * compare to keys.
+     * 
+     * Time complexity: O(log N)
+     */
+    std::pair<const_iterator, const_iterator> equal_range(const T& key) const {
+      return equalRange(key);
+    }
+
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    std::pair<const_iterator, const_iterator> equal_range(const K& key) const {
+      return equalRange(key);
+    }
+
+    /**
+     * Returns an immutable snapshot of the tree, laid out for lookups with
+     * few cache misses: see FrozenScapegoatTree.h, which defines this function
+     * and must be included to call it. The snapshot copies every key and 
+     * does not change along with the tree.
+     *
+     * Throws std::length_error if the tree holds more keys than a snapshot
+     * can (see FrozenScapegoatTree::max_size).
+     * 
+     * Time complexity: O(N log log N)
+     */
+    FrozenScapegoatTree<T, Compare, Allocator> freeze() const;
+
+    /**
+     * Returns the number of keys in the tree which come before the given key.
+     * The transparent overload takes a value of any type the comparator can
+     * compare to keys. Only available when subtree sizes are tracked (see 
+     * SizeAugmentedOptions).
+     * 
+     * Time complexity: O(log N)
+     */
+    size_t rank(const T& key) const {
+      return countBefore(key, false);
+    }
+
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    size_t rank(const K& key) const {
+      return countBefore(key, false);
+    }
+
+    /**
+     * Returns an iterator to the key of the given rank, that is, the 
+     * (index + 1)-th smallest key, or end() if index >= the number of keys.
+     * Only available when subtree sizes are tracked.
+     * 
+     * Time complexity: O(log N)
+     */
+    const_iterator select(size_t index) const {
+      static_assert(kTrackSubtreeSizes, "select needs SizeAugmentedOptions");
+      if (index >= size) return end();
+
+      const_iterator it(this, getMaxPathLength());
+      Node* curr = root;
+      while (true) {
+        it.path.push(curr);
+        size_t leftSize = getSubtreeSize(curr->left);
+        if (index == leftSize) return it;
+        if (index < leftSize) {
+          curr = curr->left;
+        } else {
+          index -= leftSize + 1;
+          curr = curr->right;
+        }
+      }
+    }
+
+    /**
+     * Returns the number of keys k in the tree such that neither k < lo nor
+     * hi < k, the keys removeRange(lo, hi) would remove. Only available when 
+     * subtree sizes are tracked.
+     * 
+     * Time complexity: O(log N)
+     */
+    size_t countRange(const T& lo, const T& hi) const {
+      if (isLessThan(hi, lo)) return 0;
+      return countBefore(hi, true) - countBefore(lo, false);
+    }
+
+    /**
+     * Inserts the given key into the scapegoat tree. If the element was added,
+     * this function returns true. If the element already existed, this
+     * function returns false and does not modify the tree.
+     * 
+     * Time complexity: amortized O(log N), worst-case O(N)
+     * Space complexity: O(log N)
+     */
+    bool insert(const T& key) {
+      return insertNode(key, [&] { return makeNode(key); }).second;
+    }
+
+    /**
+     * Same as insert above, but moves the given key into the tree's new node
+     * instead of copying it. The key is left untouched if it was already 
+     * present.
+     */
+    bool insert(T&& key) {
+      return insertNode(key, [&] { return makeNode(std::move(key)); }).second;
+    }
+
+    /**
+     * Inserts a key constructed in place from the given arguments, and 
+     * returns whether it was added, like insert. A key equal to one already
+     * present is destroyed right away, and its node's storage goes straight
+     * back to the node pool without reaching the allocator. A single 
+     * argument which already is a key is inserted as is: no node is made
+     * for it unless it is added.
+     * 
+     * Time complexity: amortized O(log N), worst-case O(N)
+     * Space complexity: O(log N)
+     */
+    template<typename... Args>
+    bool emplace(Args&&... args) {
+      if constexpr (sizeof...(Args) == 1 && 
+                    std::conjunction_v<std::is_same<std::decay_t<Args>, T>...>) {
+        return insert(std::forward<Args>(args)...);
+      } else {
+        // The key must exist to be compared, so build it right in a node.
+        Node *node = makeNode(std::forward<Args>(args)...);
+        if (insertNode(node->key, [&] { return node; }).second) return true;
+
+        destroyNode(node);
+        return false;
+      }
+    }
+
+    /**
+     * Inserts the keys in the range [first, last) into the scapegoat tree, 
+     * skipping keys already present, and returns how many keys were added.
+     * Of several equal keys in the range, only the first is inserted.
+     * 
+     * Rebuilding is deferred until every key is in the tree, so that each
+     * imbalanced subtree is rebuilt at most once per batch. A batch large 
+     * enough compared to the tree is instead merged with the tree's keys 
+     * into a brand new tree, which counts as a rebuild of the whole tree.
+     * 
+     * Time complexity: O(K log K + K log N) amortized for a batch of K keys,
+     *    O(K log K + N) for a large batch
+     * Space complexity: O(K), for a sorted copy of the batch
+     */
+    template<typename InputIt>
+    size_t insertBatch(InputIt first, InputIt last) {
+      std::vector<T> keys(first, last);
+      sortUniqueKeys(keys);
+      if (keys.size() * kLargeBatchRatio >= size) {
+        return mergeKeys(keys);
+      }
+
+      // Insert every key as a leaf, remembering the nodes that ended up too deep.
+      std::vector<Node *> deepNodes;
+      size_t oldSize = size;
+      for (T& key : keys) {
+        InsertionPath insertionPath(getMaxPathLength());
+        Node *node = insertLeaf(key, insertionPath, 
+                                [&] { return makeNode(std::move(key)); });
+        if (! node) continue;
+
+        size_t insertionHeight = insertionPath.size() - 1;
+        if (insertionHeight >= 1 && alphaDeepHeights.exceeds(insertionHeight, size)) {
+          deepNodes.push_back(node);
+        }
+      }
+
+      rebuildDeepNodes(deepNodes);
+      return size - oldSize;
+    }
+
+    /**
+     * Remove a key from the tree. If the element was removed, this function 
+     * returns true. If the element did not exist in the tree, this function
+     * returns false and doesn't modify the tree.
+     * 
+     * Time complexity: amortized O(log N), worst-case O(N)
+     */
+    bool remove(const T& key) {
+      if (! removeKey(key)) return false;
+
+      // Finally, rebuild the entire tree if necessary. 
+      rebuildIfShrunk();
+      return true;
+    }
+
+    /**
+     * Removes the keys in the range [first, last) from the tree, skipping 
+     * keys not present, and returns how many keys were removed.
+     * 
+     * The whole tree is rebuilt at most once, after every key is removed,
+     * instead of whenever a single removal shrinks it enough.
+     * 
+     * Time complexity: O(K log N + N) for a batch of K keys, 
+     *    O(K log N) amortized
+     */
+    template<typename InputIt>
+    size_t removeBatch(InputIt first, InputIt last) {
+      // Remove every key first, so that the whole tree is rebuilt at most once.
+      size_t oldSize = size;
+      for (; first != last; ++first) {
+        removeKey(*first);
+      }
+
+      rebuildIfShrunk();
+      return oldSize - size;
+    }
+
+    /**
+     * Removes every key k such that neither k < lo nor hi < k from the tree,
+     * and returns how many keys were removed. Subtrees lying within the range 
+     * are cut out whole, without looking up their keys one at a time, and 
+     * the whole tree is rebuilt at most once.
+     * 
+     * Time complexity: O(log N + K) to remove K keys, plus O(N) if the tree 
+     *    is rebuilt
+     */
+    size_t removeRange(const T& lo, const T& hi) {
+      // Find the highest node in the range, whose subtree holds every key in it.
+      InsertionPath ancestors(getMaxPathLength());
+      Node* split = root;
+      while (split && (isLessThan(split->key, lo) || isLessThan(hi, split->key))) {
+        ancestors.push(split);
+        split = isLessThan(split->key, lo) ? split->right : split->left;
+      }
+      if (! split) return 0;
+
+      // Nodes whose subtree sizes must be recomputed, from the deepest one up.
+      InsertionPath resized(kTrackSubtreeSizes ? getMaxPathLength() : 0);
+      size_t removed = 0;
+
+      // Cut the keys not less than lo out of split's left subtree: each such
+      // node and its right subtree lie within the range, and its left subtree
+      // takes its place.
+      Node** link = &split->left;
+      while (Node* node = *link) {
+        if (isLessThan(node->key, lo)) {
+          if constexpr (kTrackSubtreeSizes) resized.push(node);
+          link = &node->right;
+        } else {
+          *link = node->left;
+          removed += destroySubtree(node->right) + 1;
+          destroyNode(node);
+        }
+      }
+      updateSizes(resized);
+
+      // Likewise, cut the keys not greater than hi out of split's right subtree.
+      link = &split->right;
+      while (Node* node = *link) {
+        if (isLessThan(hi, node->key)) {
+          if constexpr (kTrackSubtreeSizes) resized.push(node);
+          link = &node->left;
+        } else {
+          *link = node->right;
+          removed += destroySubtree(node->left) + 1;
+          destroyNode(node);
+        }
+      }
+      updateSizes(resized);
+
+      // Replace split with the largest key of its left subtree, which has no
+      // right child, so that the joined subtree is no taller than split's.
+      Node* replacement = split->right;
+      if (split->left) {
+        Node* parent = nullptr;
+        replacement = split->left;
+        while (replacement->right) {
+          parent = replacement;
+          if constexpr (kTrackSubtreeSizes) resized.push(parent);
+          replacement = replacement->right;
+        }
+
+        if (parent) {
+          parent->right = replacement->left;
+          updateSizes(resized);
+          replacement->left = split->left;
+        }
+        replacement->right = split->right;
+        if constexpr (kTrackSubtreeSizes) resized.push(replacement);
+        updateSizes(resized);
+      }
+      destroyNode(split);
+      removed++;
+
+      // Wire the remaining keys back into the tree.
+      Node* parent = ancestors.empty() ? nullptr : ancestors.top();
+      if (! parent) {
+        root = replacement;
+      } else if (parent->left == split) {
+        parent->left = replacement;
+      } else /* if (parent->right == split) */ {
+        parent->right = replacement;
+      }
+      updateSizes(ancestors);
+
+      size -= removed;
+      rebuildIfShrunk();
+      return removed;
+    }
+
+    /**
+     * Returns whether the scapegoat tree is loosely alpha-height balanced.
+     */
+    bool verify() const {
+      VerificationData treeProperties = verifyHelper(root);
+      return size >= alpha * maxSize && treeProperties.balanced && treeProperties.isBST
+          && treeProperties.sizesValid;
+    }
+
+    /**
+     * Returns the counters the tree has kept about its rebuilds since it was
+     * constructed, batch insertions merged into a new tree included. Only available when stats are collected (see 
+     * DefaultScapegoatOptions).
+     * 
+     * Time complexity: O(1)
+     */
+    const RebuildStats& stats() const {
+      static_assert(kCollectStats, "stats needs Options::kCollectStats");
+      return this->rebuildStats;
+    }
+
+    /**
+     * Registers the given listener to be told of every rebuild from now on,
+     * replacing any listener registered before, or unregisters it if the 
+     * listener is nullptr. The tree does not own the listener, which must 
+     * outlive its registration. Only available when rebuild events are
+     * enabled (see DefaultScapegoatOptions).
+     * 
+     * Time complexity: O(1)
+     */
+    void setRebuildListener(RebuildListener* listener) {
+      static_assert(kRebuildEvents, "setRebuildListener needs Options::kRebuildEvents");
+      this->rebuildListener = listener;
+    }
+
+    /**
+     * Prints a pre-order traversal of the tree in a nice format for debugging.
+     */
+    void printDebugInfo() const {
+      printDebugInfoRec(root, 0);
+      std::cout << std::flush;
+    }
+
+  private:
+    // Helper structs:
+
+    static constexpr bool kTrackSubtreeSizes = Options::kTrackSubtreeSizes;
+    static constexpr bool kCollectStats = Options::kCollectStats;
+    static constexpr bool kRebuildEvents = Options::kRebuildEvents;
+
+    /** 
+     * Represents a standard BST node, holding its key and children. 
+     */
+    struct PlainNode {
+      T           key;
+
+      PlainNode*  left;
+      PlainNode*  right;
+    };
+
+    /** 
+     * Represents a BST node which also stores the size of its subtree.
+     */
+    struct SizedNode {
+      T           key;
+
+      SizedNode*  left;
+      SizedNode*  right;
+
+      size_t      size = 1;  // The number of nodes in the subtree rooted at this node
+    };
+
+    using Node = std::conditional_t<kTrackSubtreeSizes, SizedNode, PlainNode>;
+
+    /** 
+     * Contains information about the "scapegoat node" useful for a rebuild.
+     */
+    struct Scapegoat {
+      Node* scapegoat;  // The node at the root of the imbalanced subtree
+      Node* parent;     // The parent of the imbalanced subtree, nullptr if scapegoat == root
+      
+      size_t treeSize;  // The size of the scapegoat node's subtree 
+      size_t depth;     // The depth of the scapegoat node, 0 if scapegoat == root
+    };
+
+    /**
+     * Stack of the ancestors of an inserted node. Paths up to this many nodes 
+     * long are kept on the call stack, which covers every tree with alpha up 
+     * to about 0.84, and trees of up to hundreds of billions of nodes for alpha
+     * up to 0.9.
+     */
+    static constexpr size_t kInlinePathCapacity = 256;
+    using InsertionPath = NodeStack<Node, kInlinePathCapacity>;
+
+    /**
+     * A subtree under construction in buildTree.
+     */
+    struct BuildFrame {
+      size_t treeSize;  // The number of nodes in the subtree
+      Node*  root;      // The subtree's root, nullptr until its left half is built
+    };
+
+    // The most frames buildTree can need: sizes halve at each level.
+    static constexpr size_t kMaxBuildDepth = 8 * sizeof(size_t);
+
+    /**
+     * A batch holding at least 1 / kLargeBatchRatio as many keys as the tree
+     * is merged into it by rebuilding the whole tree, which is then cheaper
+     * than descending the tree once per key.
+     */
+    static constexpr size_t kLargeBatchRatio = 8;
+
+    /**
+     * Data used to verify the correctness of a subtree.
+     */ 
+    struct VerificationData {
+      bool balanced;  // Whether or not the subtree is loosely alpha-height balanced.
+      bool isBST;     // Whether or not the subtree follows BST ordering.
+      bool sizesValid;  // Whether or not all stored subtree sizes are correct.
+
+      size_t size;    // Size of the subtree.
+      int height;     // Height of the subtree (-1 if the tree is empty)
+    };
+
+
+    // Attributes of the tree:
+
+    // Owns the memory of every node in the tree.
+    NodePool<Node, Allocator> pool;
+
+    Node* root = nullptr;
+    size_t size = 0;      // Current size of tree.
+    size_t maxSize = 0;   // Max size of tree since last rebuild.
+
+    /** 
+     * An alpha-weight-balanced node can have one subtree as large as 
+     * alpha * the total number of nodes in its subtree.
+     */
+    static constexpr double kDefaultAlpha = 0.5;
+    static constexpr double kMinAlpha = 0.5;
+    static constexpr double kMaxAlpha = 1.0;
+    double alpha = kDefaultAlpha; 
+
+    /**
+     * The sizes at which the alpha-deep height increases, covering sizes 
+     * up to at least maxSize + 1.
+     */
+    AlphaDeepHeightTable alphaDeepHeights;
+
+    /**
+     * Represents whether a node being removed will be replaced with its 
+     * successor (true) or predecessor (false). This instance variable is flipped
+     * every time a node is removed, which empirically helps to maintain 
+     * overall tree balance after many removals. 
+     * 
+     * See removeNodeWithTwoChildren method.
+     */
+    bool replaceWithSucc = true;
+
+
+    // Helper functions:
+
+    /**
+     * Returns the comparator of trees constructed without one: 
+     * defaultIsLessThan for function pointers, a default-constructed 
+     * comparator otherwise.
+     */
+    static Compare getDefaultComparator() {
+      if constexpr (std::is_pointer<Compare>::value) return &defaultIsLessThan<T>;
+      else return Compare();
+    }
+
+    /**
+     * Returns whether lhs comes strictly before rhs according to the tree's
+     * comparator. Either may be a value of another type than the keys' when 
+     * the comparator is transparent.
+     */
+    template<typename L, typename R>
+    bool isLessThan(const L& lhs, const R& rhs) const {
+      return this->comparator()(lhs, rhs);
+    }
+
+    /**
+     * Returns a negative value, zero or a positive value when lhs comes 
+     * before, is equal to or comes after the key rhs according to the tree's
+     * comparator, in a single comparison if possible: see compareThreeWay.
+     * 
+     * lhs may be a value of another type than the keys' when the comparator 
+     * is transparent.
+     */
+    template<typename K>
+    int compareKeys(const K& lhs, const T& rhs) const {
+      return compareThreeWay(this->comparator(), lhs, rhs);
+    }
+
+    /** 
+     * Throws std::invalid_argument if alpha is not within (0.5, 1).
+     */ 
+    void checkInvalidAlpha(double alpha) const {
+      if (alpha <= kMinAlpha || alpha >= kMaxAlpha) {
+        throw std::invalid_argument("Alpha not in range (0.5, 1)!");
+      }
+    }
+
+    /**
+     * Returns the alpha-deep height == floor(log_{1/alpha}(size)) 
+     * for a subtree of given size, which is at most maxSize + 1.
+     */ 
+    size_t getAlphaDeepHeight(size_t size) const {
+      return alphaDeepHeights.height(size);
+    }
+
+    /**
+     * Returns an upper bound on the number of nodes on any root-to-leaf path
+     * after the next insertion, plus one for the root's (nullptr) parent: 
+     * no node is deeper than the loose alpha-deep height of maxSize.
+     */
+    size_t getMaxPathLength() const {
+      return getAlphaDeepHeight(maxSize + 1) + 3;
+    }
+
+    /**
+     * Search subroutine:
+     * Returns the node holding a key equivalent to the given value, or 
+     * nullptr if there is none.
+     * 
+     * Time complexity: O(log N)
+     */
+    template<typename K>
+    Node* findNode(const K& key) const {
+      Node* curr = root;
+      while (curr) {
+        int order = compareKeys(key, curr->key);
+        if      (order < 0) curr = curr->left;
+        else if (order > 0) curr = curr->right;
+        else /* equal, by strict ordering */ return curr;
+      }
+      return nullptr;
+    }
+
+    /**
+     * The key findBound looks for, relative to the given value.
+     */
+    enum class BoundKind {
+      kEqual,  // An equivalent key
+      kLower,  // The smallest key not before the value
+      kUpper   // The smallest key after the value
+    };
+
+    /**
+     * Find, lower_bound and upper_bound subroutine:
+     * Returns an iterator to the key of the given kind, keeping the path 
+     * from the root to it, or end() if there is none.
+     * 
+     * Time complexity: O(log N)
+     */
+    template<typename K>
+    const_iterator findBound(const K& key, BoundKind kind) const {
+      // Descend towards the key, remembering how deep the last node found to
+      // hold a suitable key is: the path to it is a prefix of the descent.
+      const_iterator it(this, getMaxPathLength());
+      size_t boundDepth = 0;
+      Node* curr = root;
+      while (curr) {
+        it.path.push(curr);
+        int order = compareKeys(key, curr->key);
+        if (order < 0 || (order == 0 && kind != BoundKind::kUpper)) {
+          if (kind != BoundKind::kEqual) boundDepth = it.path.size();
+          if (order == 0) {
+            boundDepth = it.path.size();
+            break;
+          }
+          curr = curr->left;
+        } else {
+          curr = curr->right;
+        }
+      }
+
+      while (it.path.size() > boundDepth) {
+        it.path.pop();
+      }
+      return it;
+    }
+
+    /**
+     * Rank and countRange subroutine:
+     * Returns the number of keys which come before the given value, also 
+     * counting an equivalent key if inclusive. 
+     * 
+     * Time complexity: O(log N)
+     */
+    template<typename K>
+    size_t countBefore(const K& key, bool inclusive) const {
+      static_assert(kTrackSubtreeSizes, "order statistics need SizeAugmentedOptions");
+      size_t count = 0;
+      Node* curr = root;
+      while (curr) {
+        int order = compareKeys(key, curr->key);
+        if (order < 0) {
+          curr = curr->left;
+        } else if (order > 0) {
+          count += getSubtreeSize(curr->left) + 1;
+          curr = curr->right;
+        } else {
+          return count + getSubtreeSize(curr->left) + inclusive;
+        }
+      }
+      return count;
+    }
+
+    /**
+     * Equal_range subroutine:
+     * Keys are unique, so the range holds at most the lower bound.
+     * 
+     * Time complexity: O(log N)
+     */
+    template<typename K>
+    std::pair<const_iterator, const_iterator> equalRange(const K& key) const {
+      const_iterator first = findBound(key, BoundKind::kLower);
+      const_iterator last = first;
+      if (last != end() && compareKeys(key, *last) == 0) ++last;
+      return { first, last };
+    }
+
+    /**
+     * Returns floor(log_2(size)), the height of a 1/2-weight-balanced tree 
+     * of given (nonzero) size.
+     */
+    static size_t getBalancedHeight(size_t size) {
+      size_t height = 0;
+      while (size >>= 1) height++;
+      return height;
     }
 
     /**
-     * Frees all memory allocated by this scapegoat tree.
-     * 
-     * Time complexity: O(N)
+     * Returns a new node, out of the node pool, holding a key constructed 
+     * from the given arguments and no children.
      */
-    ~ScapegoatTree() {
-      // Algorithm to deallocate iteratively in O(1) space thanks to Leo Shamis.
-      while (root) {
-        if (! root->left) {
-          // Case 1: The root has no left child; delete and replace it with right child.
-          Node* next = root->right;
-          delete root;
-          root = next;
-        } else {
-          // Case 2: Rotate the root's left child into the root's place.
-          Node* leftChild = root->left;
-          root->left = leftChild->right;
-          leftChild->right = root;
-          root = leftChild;
-        }
-      }
+    template<typename... Args>
+    Node* makeNode(Args&&... args) {
+      return new (pool.allocate()) Node{ T(std::forward<Args>(args)...), nullptr, nullptr };
     }
 
     /**
-     * Returns whether the given key is present in the tree.
+     * Insert subroutine:
+     * Inserts the given key, held by the node that newNode() returns, and 
+     * rebuilds the tree as necessary. Returns the node holding the key, and
+     * whether the key was added; newNode() is only called if so.
      * 
-     * Time complexity: O(log N)
+     * key may be a value of another type than the keys' when the comparator
+     * is transparent.
+     * 
+     * Time complexity: amortized O(log N), worst-case O(N)
      */
-    bool search(T key) const {
-      Node* curr = root;
-      while (curr) {
-        if      (isLessThan(key, curr->key)) curr = curr->left;
-        else if (isLessThan(curr->key, key)) curr = curr->right;
-        else /* equal, by strict ordering */ return true;
+    template<typename K, typename NewNode>
+    std::pair<Node*, bool> insertNode(const K& key, NewNode newNode) {
+      // Stack of ancestors of the inserted nodes, sized to never need the heap.
+      InsertionPath insertionPath(getMaxPathLength());
+      Node* node = insertLeaf(key, insertionPath, newNode);
+      if (! node) return { insertionPath.top(), false }; // key already present
+
+      // If there exist ancestors and the inserted node is deep, find scapegoat and rebuild.
+      // Insertion height equals the number of ancestors of the inserted node.
+      // We subtract 1 from the stack's size since we pushed a dummy node 
+      // (nullptr) onto the insertion path and heights start from 0. 
+      size_t insertionHeight = insertionPath.size() - 1;
+      if (insertionHeight >= 1 && alphaDeepHeights.exceeds(insertionHeight, size)) {
+        Scapegoat scapegoat = findScapegoat(insertionPath);
+        rebuild(scapegoat, RebuildReason::kInsertTooDeep);
       }
-      return false;
+
+      // Rebuilding relinks nodes without moving them, so node still holds the key.
+      return { node, true };
     }
 
     /**
-     * Inserts the given key into the scapegoat tree. If the element was added,
-     * this function returns true. If the element already existed, this
-     * function returns false and does not modify the tree.
+     * Insert subroutine:
+     * Inserts the given key as a new leaf, the node that newNode() returns,
+     * without rebuilding anything, leaving the ancestors of the new node on 
+     * the given (empty) insertion path, below the root's (nullptr) parent. 
+     * Returns the new node, or nullptr if the key was already present, in 
+     * which case newNode() is not called and the node holding the key is 
+     * left on top of the insertion path.
      * 
-     * Time complexity: amortized O(log N), worst-case O(N)
-     * Space complexity: O(log N)
+     * The new node may take the key away from the caller: key is not looked
+     * at once newNode() is called.
+     * 
+     * Time complexity: O(log N)
      */
-    bool insert(T key) {
-      std::stack<Node *> insertionPath; // Stack of ancestors of the inserted nodes
+    template<typename K, typename NewNode>
+    Node* insertLeaf(const K& key, InsertionPath& insertionPath, NewNode newNode) {
       insertionPath.push(nullptr);      // The "root's parent"
 
       // Find the insertion point and its parent.
       Node* prev = nullptr;
       Node* curr = root;
+      int order = 0;  // The order of key relative to prev's key
       while (curr) {
         insertionPath.push(curr);
         prev = curr;
 
-        if      (isLessThan(key, curr->key)) curr = curr->left;
-        else if (isLessThan(curr->key, key)) curr = curr->right;
-        else /* equal, by strict ordering */ return false; // key already present
+        order = compareKeys(key, curr->key);
+        if      (order < 0) curr = curr->left;
+        else if (order > 0) curr = curr->right;
+        else /* equal, by strict ordering */ return nullptr; // key already present
       }
 
       // Make the node to insert.
-      Node* node = new Node;
-      node->key  = key;
-      node->left = node->right = nullptr;
+      Node* node = newNode();
+
+      if constexpr (kTrackSubtreeSizes) {
+        // The new node is a leaf, and each of its ancestors gained one descendant.
+        for (size_t i = 1; i < insertionPath.size(); i++) {
+          insertionPath[i]->size++;
+        }
+      }
 
       // Wire the new node into the tree. 
       if (! prev) {
         root = node;
-      } else if (isLessThan(key, prev->key)) {
+      } else if (order < 0) {
         prev->left = node;
       } else /*  key > prev->key */ {
         prev->right = node;
@@ -130,170 +1214,270 @@ class ScapegoatTree {
 
       // Update tree information.
       size++;
-      if (size > maxSize) maxSize = size;
+      if (size > maxSize) {
+        maxSize = size;
+        alphaDeepHeights.cover(maxSize + 1);
+      }
 
-      // If there exist ancestors and the inserted node is deep, find scapegoat and rebuild.
-      size_t deepHeight = getAlphaDeepHeight(size);
-      
-      // Insertion height equals the number of ancestors of the inserted node.
-      // We subtract 1 from the stack's size since we pushed a dummy node 
-      // (nullptr) onto the insertion path and heights start from 0. 
-      size_t insertionHeight = insertionPath.size() - 1;
-      if (insertionHeight >= 1 && insertionHeight > deepHeight) {
-        Scapegoat scapegoat = findScapegoat(insertionPath);
-        rebuild(scapegoat);
+      if constexpr (kCollectStats) {
+        this->rebuildStats.recordInsertion(insertionPath.size() - 1, getAlphaDeepHeight(size));
       }
 
-      return true;
+      return node;
     }
 
     /**
-     * Remove a key from the tree. If the element was removed, this function 
-     * returns true. If the element did not exist in the tree, this function
-     * returns false and doesn't modify the tree.
+     * Remove subroutine:
+     * Removes the given key from the tree without rebuilding anything, and
+     * returns whether the key was present. key may be a value of another type
+     * than the keys' when the comparator is transparent.
      * 
-     * Time complexity: amortized O(log N), worst-case O(N)
+     * Time complexity: O(log N)
      */
-    bool remove(T key) {
+    template<typename K>
+    bool removeKey(const K& key) {
+      // Stack of ancestors of the removed node, only needed to update their sizes.
+      InsertionPath removalPath(kTrackSubtreeSizes ? getMaxPathLength() : 0);
+
       // Find node containing the key to remove and its parent.
       Node* prev = nullptr;
       Node* curr = root;
       while (true) {
         if (! curr) return false;   // Deletion failed if the key doesn't exist
         
-        bool keyLess = isLessThan(key, curr->key);
-        bool keyGreater = isLessThan(curr->key, key);
-
-        if (! keyLess && ! keyGreater) break; // Found the node to delete
+        int order = compareKeys(key, curr->key);
+        if (order == 0) break;      // Found the node to delete
 
         prev = curr;
+        if constexpr (kTrackSubtreeSizes) removalPath.push(curr);
+
+        if (order < 0) curr = curr->left;
+        else           curr = curr->right;
+      }
 
-        if      (keyLess)    curr = curr->left;
-        else if (keyGreater) curr = curr->right;
+      if constexpr (kTrackSubtreeSizes) {
+        // Every node on the path from the root to the removed key loses a 
+        // descendant. (curr's size only matters when it is handed down to
+        // the descendant taking its place.)
+        for (size_t i = 0; i < removalPath.size(); i++) {
+          removalPath[i]->size--;
+        }
+        curr->size--;
       }
 
       // Remove the node from the tree and clean up its memory.
       if (curr->left && curr->right) {
-        removeNodeWithTwoChildren(curr);
+        removeNodeWithTwoChildren(curr, prev);
       } else {
         removeNodeWithoutChild(curr, prev);
       }
 
-      // Finally, rebuild the entire tree if necessary. 
       size--;
-      if (size <= alpha * maxSize) {
-        rebuild( { root, nullptr, size } );
-      }
-
       return true;
     }
 
     /**
-     * Returns whether the scapegoat tree is loosely alpha-height balanced.
+     * Remove subroutine:
+     * Rebuilds the whole tree if it has shrunk to alpha * maxSize keys or fewer
+     * since it was last rebuilt.
      */
-    bool verify() const {
-      VerificationData treeProperties = verifyHelper(root);
-      return size >= alpha * maxSize && treeProperties.balanced && treeProperties.isBST;
+    void rebuildIfShrunk() {
+      if (size <= alpha * maxSize) {
+        rebuild( { root, nullptr, size, 0 }, RebuildReason::kRemoveShrunk);
+      }
     }
 
     /**
-     * Prints a pre-order traversal of the tree in a nice format for debugging.
+     * RemoveRange subroutine:
+     * Destroys every node of the subtree rooted at the given node and returns
+     * its memory to the node pool, and returns how many there were.
+     * 
+     * Time complexity: O(size of subtree)
+     * Space complexity: O(1)
      */
-    void printDebugInfo() const {
-      printDebugInfoRec(root, 0);
-      std::cout << std::flush;
+    size_t destroySubtree(Node *node) {
+      // Rotate left children up until the subtree is a right-leaning vine, 
+      // destroying each node as it reaches the top without a left child.
+      size_t destroyed = 0;
+      while (node) {
+        if (! node->left) {
+          Node* next = node->right;
+          destroyNode(node);
+          node = next;
+          destroyed++;
+        } else {
+          Node* leftChild = node->left;
+          node->left = leftChild->right;
+          leftChild->right = node;
+          node = leftChild;
+        }
+      }
+      return destroyed;
     }
 
-  private:
-    // Helper structs:
-
-    /** 
-     * Represents a standard BST node, holding its key and children. 
+    /**
+     * RemoveRange subroutine:
+     * Pops every node off the given stack, recomputing the stored subtree 
+     * size of each (if any) from its children's, deepest node first.
      */
-    struct Node {
-      T      key;
-
-      Node*  left;
-      Node*  right;
-    };
+    void updateSizes(InsertionPath& nodes) {
+      while (! nodes.empty()) {
+        if constexpr (kTrackSubtreeSizes) {
+          Node* node = nodes.top();
+          node->size = 1 + getSubtreeSize(node->left) + getSubtreeSize(node->right);
+        }
+        nodes.pop();
+      }
+    }
 
-    /** 
-     * Contains information about the "scapegoat node" useful for a rebuild.
+    /**
+     * Sorts the given keys, stably, and drops all but the first of several
+     * equal keys, unless they are strictly increasing already.
+     * 
+     * Time complexity: O(K) for sorted keys, O(K log K) otherwise
      */
-    struct Scapegoat {
-      Node* scapegoat;  // The node at the root of the imbalanced subtree
-      Node* parent;     // The parent of the imbalanced subtree, nullptr if scapegoat == root
-      
-      size_t treeSize;  // The size of the scapegoat node's subtree 
-    };
+    void sortUniqueKeys(std::vector<T>& keys) const {
+      auto lessThan = [this](const T& lhs, const T& rhs) {
+        return isLessThan(lhs, rhs);
+      };
+      auto notLessThan = [this](const T& lhs, const T& rhs) {
+        return ! isLessThan(lhs, rhs);
+      };
+
+      if (std::adjacent_find(keys.begin(), keys.end(), notLessThan) != keys.end()) {
+        std::stable_sort(keys.begin(), keys.end(), lessThan);
+        keys.erase(std::unique(keys.begin(), keys.end(), notLessThan), keys.end());
+      }
+    }
 
     /**
-     * Data used to verify the correctness of a subtree.
-     */ 
-    struct VerificationData {
-      bool balanced;  // Whether or not the subtree is loosely alpha-height balanced.
-      bool isBST;     // Whether or not the subtree follows BST ordering.
-
-      size_t size;    // Size of the subtree.
-      int height;     // Height of the subtree (-1 if the tree is empty)
-    };
+     * InsertBatch subroutine:
+     * Rebuilds the whole tree from its keys merged with the given sorted, 
+     * unique keys. Returns how many keys were added.
+     * 
+     * Time complexity: O(N + K)
+     */
+    size_t mergeKeys(std::vector<T>& keys) {
+      std::chrono::steady_clock::time_point start;
+      if constexpr (kCollectStats) start = std::chrono::steady_clock::now();
+
+      // Move the tree's keys out in order, then merge the new keys in. 
+      // Keys already in the tree win over equal keys of the batch.
+      std::vector<T> treeKeys;
+      treeKeys.reserve(size);
+      Flattener nodes(root, getMaxPathLength());
+      for (size_t i = 0; i < size; i++) {
+        treeKeys.push_back(std::move(nodes.next()->key));
+      }
 
+      std::vector<T> mergedKeys;
+      mergedKeys.reserve(treeKeys.size() + keys.size());
+      std::set_union(std::make_move_iterator(treeKeys.begin()), 
+                     std::make_move_iterator(treeKeys.end()),
+                     std::make_move_iterator(keys.begin()), 
+                     std::make_move_iterator(keys.end()),
+                     std::back_inserter(mergedKeys), 
+                     [this](const T& lhs, const T& rhs) { return isLessThan(lhs, rhs); });
+
+      RebuildEvent event { mergedKeys.size(), 0, true, RebuildReason::kBatchMerge };
+      if constexpr (kRebuildEvents) {
+        if (this->rebuildListener) this->rebuildListener->beforeRebuild(event);
+      }
 
-    // Attributes of the tree:
+      size_t oldSize = size;
+      assignSorted(std::make_move_iterator(mergedKeys.begin()), mergedKeys.size());
 
-    // Pointer to comparator function for keys, the < operator if not provided.
-    bool (*isLessThan)(const T&, const T&); 
+      // The merge rebuilds the whole tree, batch and all.
+      if constexpr (kCollectStats) {
+        this->rebuildStats.recordRebuild(size, true, std::chrono::steady_clock::now() - start);
+      }
 
-    Node* root = nullptr;
-    size_t size = 0;      // Current size of tree.
-    size_t maxSize = 0;   // Max size of tree since last rebuild.
+      if constexpr (kRebuildEvents) {
+        if (this->rebuildListener) this->rebuildListener->afterRebuild(event);
+      }
 
-    /** 
-     * An alpha-weight-balanced node can have one subtree as large as 
-     * alpha * the total number of nodes in its subtree.
-     */
-    static constexpr double kDefaultAlpha = 0.5;
-    static constexpr double kMinAlpha = 0.5;
-    static constexpr double kMaxAlpha = 1.0;
-    double alpha = kDefaultAlpha; 
+      return size - oldSize;
+    }
 
     /**
-     * Represents whether a node being removed will be replaced with its 
-     * successor (true) or predecessor (false). This instance variable is flipped
-     * every time a node is removed, which empirically helps to maintain 
-     * overall tree balance after many removals. 
+     * InsertBatch subroutine:
+     * Given the nodes which were inserted by a batch too deep for the size
+     * of the tree at the time, in increasing order of keys, finds a 
+     * scapegoat for every one of them that is still too deep now. Rebuilds 
+     * only the outermost scapegoats, which are disjoint, so that no subtree
+     * is rebuilt twice. 
      * 
-     * See removeNodeWithTwoChildren method.
+     * If some node is still too deep after that, which can only happen when
+     * a subtree has grown far out of balance, rebuilds the whole tree.
      */
-    bool replaceWithSucc = true;
+    void rebuildDeepNodes(const std::vector<Node *>& deepNodes) {
+      // The outermost scapegoats found so far. Keys come in increasing order, 
+      // and so do these disjoint subtrees.
+      std::vector<Scapegoat> subtrees;
+
+      for (Node *node : deepNodes) {
+        // Find the ancestors of the node, unless a scapegoat found for 
+        // a smaller key already holds it.
+        InsertionPath insertionPath(getMaxPathLength());
+        insertionPath.push(nullptr);      // The "root's parent"
+
+        Node* lastScapegoat = subtrees.empty() ? nullptr : subtrees.back().scapegoat;
+        bool inLastSubtree = false;
+
+        Node* curr = root;
+        while (true) {
+          inLastSubtree = inLastSubtree || curr == lastScapegoat;
+          if (curr == node) break;
+
+          insertionPath.push(curr);
+          curr = isLessThan(node->key, curr->key) ? curr->left : curr->right;
+        }
+
+        size_t insertionHeight = insertionPath.size() - 1;
+        if (inLastSubtree || ! alphaDeepHeights.exceeds(insertionHeight, size)) {
+          continue;
+        }
 
+        Scapegoat scapegoat = findScapegoat(insertionPath);
 
-    // Helper functions:
+        // The scapegoats nested in this one are the last ones found: drop them.
+        while (! subtrees.empty()) {
+          Node *nested = subtrees.back().scapegoat;
+          Node *ancestor = scapegoat.scapegoat;
+          while (ancestor && ancestor != nested) {
+            ancestor = isLessThan(nested->key, ancestor->key) ? ancestor->left : ancestor->right;
+          }
+          if (! ancestor) break;
+          subtrees.pop_back();
+        }
+        subtrees.push_back(scapegoat);
+      }
 
-    /** 
-     * Throws std::invalid_argument if alpha is not within (0.5, 1).
-     */ 
-    void checkInvalidAlpha(double alpha) const {
-      if (alpha <= kMinAlpha || alpha >= kMaxAlpha) {
-        throw std::invalid_argument("Alpha not in range (0.5, 1)!");
+      // Rebuild the scapegoats. A rebuilt subtree is perfectly balanced, 
+      // so its deepest nodes are exactly as deep as its root plus its height.
+      bool balanced = true;
+      for (const Scapegoat& subtree : subtrees) {
+        rebuild(subtree, RebuildReason::kInsertTooDeep);
+        size_t height = subtree.depth + getBalancedHeight(subtree.treeSize);
+        balanced = balanced && ! alphaDeepHeights.exceeds(height, size);
       }
-    }
 
-    /**
-     * Returns the alpha-deep height == floor(log_{1/alpha}(size)) 
-     * for a subtree of given size.
-     */ 
-    size_t getAlphaDeepHeight(size_t size) const {
-      return static_cast<size_t>(floor(log(size) / log(1 / alpha)));
+      if (! balanced) {
+        rebuild( { root, nullptr, size, 0 }, RebuildReason::kInsertTooDeep);
+      }
     }
 
     /**
-     * findScapegoat helper:
+     * findScapegoat and order statistics helper:
      * Returns the number of nodes in the subtree rooted at the given node.
+     * 
+     * Time complexity: O(1) when subtree sizes are tracked, 
+     *    O(size of subtree) otherwise
      */
-    size_t getSubtreeSize(Node *node) {
+    static size_t getSubtreeSize(Node *node) {
       if (! node)  return 0;
-      return 1 + getSubtreeSize(node->left) + getSubtreeSize(node->right);
+      if constexpr (kTrackSubtreeSizes) return node->size;
+      else return 1 + getSubtreeSize(node->left) + getSubtreeSize(node->right);
     }
 
     /**
@@ -301,15 +1485,20 @@ class ScapegoatTree {
      * Given a stack of nodes representing the ancestors of an inserted node n
      * in order of descending depth in the tree, where n_i is the i-th ancestor
      * of node n, returns the deepest ancestor such that i > the alpha-deep-height
-     * of n_i's subtree, as well as that ancestor's parent and subtree size. 
+     * of n_i's subtree, as well as that ancestor's parent, subtree size and
+     * depth. Only the ancestor's own ancestors (and the root's parent) are
+     * left on the stack.
      * 
      * This ancestor is weight-imbalanced and therefore a suitable scapegoat
      * (see Galperin and Rivest for proof)
      * 
+     * Time complexity: O(log N) when subtree sizes are tracked, 
+     *    O(size of the scapegoat's subtree) otherwise
+     * 
      * Precondition: there is at least one ancestor on the path
      *    (insertionPath contains at least 2 elements)
      */
-    Scapegoat findScapegoat(std::stack<Node *>& insertionPath) {
+    Scapegoat findScapegoat(InsertionPath& insertionPath) {
       // Retrieve parent (curr) and grandparent (parent) of inserted node.
       Node *curr = insertionPath.top();
       insertionPath.pop();
@@ -324,7 +1513,7 @@ class ScapegoatTree {
       while (parent) {
         // Found scapegoat if we exhausted the stack, 
         // or if index is greater than alpha-deep height.
-        if (currIndex > getAlphaDeepHeight(currSize)) {
+        if (alphaDeepHeights.exceeds(currIndex, currSize)) {
           break;
         }
 
@@ -343,18 +1532,30 @@ class ScapegoatTree {
         currIndex++;
       }
 
-      return { curr, parent, currSize };
+      if constexpr (kCollectStats) {
+        // Stored sizes were read once per level. Otherwise, every node 
+        // counted was visited, except for the ancestors added one at a time.
+        this->rebuildStats.scapegoatSearchNodes += 
+            kTrackSubtreeSizes ? currIndex : currSize - (currIndex - 1);
+      }
+
+      // Only the scapegoat's ancestors and the root's parent are left on the
+      // path, as many as the scapegoat's depth.
+      return { curr, parent, currSize, insertionPath.size() };
     }
 
     /** 
      * Remove subroutine: 
-     * Removes the given node from the tree by swapping its key with 
-     * its in-order successor / predecessor node's key.
+     * Removes the given node from the tree by splicing its in-order 
+     * successor / predecessor node out of its subtree and relinking it in
+     * the given node's place. No key is copied or moved, so every other key
+     * stays where it is in memory.
      * 
-     * Parameters: node has two children.
-     * Postcondition: the memory of the node wired out of the tree is freed.
+     * Parameters: node has two children, parent is its parent or 
+     *    nullptr if node is the root of the tree.
+     * Postcondition: node has been wired out of the tree, and its memory is freed.
      */
-    void removeNodeWithTwoChildren(Node *node) {
+    void removeNodeWithTwoChildren(Node *node, Node *parent) {
       Node *curr;
       Node *prev = node;
       
@@ -363,6 +1564,13 @@ class ScapegoatTree {
         // the node with minimum key in its right subtree.
         curr = node->right;
 
+        if constexpr (kTrackSubtreeSizes) {
+          // Every node on the path down to the successor loses a descendant.
+          for (Node* ancestor = curr; ancestor->left; ancestor = ancestor->left) {
+            ancestor->size--;
+          }
+        }
+
         if (! curr->left) {
           // node's right child has no left child, so it is the successor.
           node->right = curr->right;
@@ -382,6 +1590,13 @@ class ScapegoatTree {
         // the node with maximum key in its left subtree.
         curr = node->left;
 
+        if constexpr (kTrackSubtreeSizes) {
+          // Every node on the path down to the predecessor loses a descendant.
+          for (Node* ancestor = curr; ancestor->right; ancestor = ancestor->right) {
+            ancestor->size--;
+          }
+        }
+
         if (! curr->right) {
           // node's left child has no right child, so it is the predecessor.
           node->left = curr->left;
@@ -398,10 +1613,20 @@ class ScapegoatTree {
         }
       }
 
-      // Swapping the successor/predecessor's key with the key to be removed
-      // maintains the BST ordering. 
-      node->key = curr->key;
-      delete curr;
+      // Putting the successor/predecessor in node's place maintains the 
+      // BST ordering. 
+      curr->left = node->left;
+      curr->right = node->right;
+      if constexpr (kTrackSubtreeSizes) curr->size = node->size;
+
+      if (! parent) {
+        root = curr;
+      } else if (parent->left == node) {
+        parent->left = curr;
+      } else /* if (parent->right == node) */ {
+        parent->right = curr;
+      }
+      destroyNode(node);
 
       replaceWithSucc = !replaceWithSucc;
     }
@@ -427,108 +1652,226 @@ class ScapegoatTree {
       }
 
       // Free memory of the original node.
-      delete node;
+      destroyNode(node);
+    }
+
+    /**
+     * Runs the destructor of every node in the tree, if keys need destructors
+     * to run, without returning their memory to the node pool. Leaves root
+     * dangling.
+     * 
+     * Time complexity: O(1) for trivially destructible keys, O(N) otherwise
+     */
+    void destroyAllNodes() {
+      // Trivial keys need no walk at all: the pool frees their nodes at once.
+      if constexpr (! std::is_trivially_destructible<T>::value) {
+        // Algorithm to destroy iteratively in O(1) space thanks to Leo Shamis.
+        while (root) {
+          if (! root->left) {
+            // Case 1: The root has no left child; destroy and replace it with right child.
+            Node* next = root->right;
+            root->~Node();
+            root = next;
+          } else {
+            // Case 2: Rotate the root's left child into the root's place.
+            Node* leftChild = root->left;
+            root->left = leftChild->right;
+            leftChild->right = root;
+            root = leftChild;
+          }
+        }
+      }
+    }
+
+    /**
+     * Assign subroutine:
+     * Replaces the contents of the tree with the given number of strictly 
+     * increasing keys read from first, building a 1/2-weight-balanced tree 
+     * of them in a single contiguous run of the node pool.
+     * 
+     * Time complexity: O(treeSize)
+     */
+    template<typename InputIt>
+    void assignSorted(InputIt first, size_t treeSize) {
+      clear();
+      if (treeSize == 0) return;
+
+      KeyNodeMaker<InputIt> nodes(first, pool.allocateRun(treeSize));
+      root = buildTree(treeSize, nodes);
+
+      size = maxSize = treeSize;
+      alphaDeepHeights.cover(maxSize + 1);
+    }
+
+    /**
+     * Destroys a node that has been wired out of the tree and returns its
+     * memory to the node pool.
+     */
+    void destroyNode(Node *node) {
+      node->~Node();
+      pool.deallocate(node);
     }
 
     /** 
      * Rebuild the subtree rooted at the given scapegoat node
-     * to be perfectly balanced, and rewire it to its parent.
+     * to be perfectly balanced, and rewire it to its parent. The reason is
+     * passed on to the rebuild listener, if there is one.
      * 
      * Time complexity: O(size of subtree to be rebuilt)
-     * Space complexity: O(height of subtree to be rebuilt)
+     * Space complexity: O(height of subtree to be rebuilt), in a NodeStack
      */
-    void rebuild(Scapegoat scapegoat) {
-      // Dummy node will become the end of our linked list.
-      Node dummy;
+    void rebuild(Scapegoat scapegoat, RebuildReason reason) {
+      RebuildEvent event { scapegoat.treeSize, scapegoat.depth, ! scapegoat.parent, reason };
+      if constexpr (kRebuildEvents) {
+        if (this->rebuildListener) this->rebuildListener->beforeRebuild(event);
+      }
 
-      // Flatten the tree into a linked list.
-      Node *nodeList = flatten(scapegoat.scapegoat, &dummy);
+      std::chrono::steady_clock::time_point start;
+      if constexpr (kCollectStats) start = std::chrono::steady_clock::now();
 
-      // Rebuild the linked list into a tree.
-      buildTree(scapegoat.treeSize, nodeList);
+      // Stream the subtree's nodes in order straight into a new, balanced shape.
+      Flattener nodes(scapegoat.scapegoat, getMaxPathLength());
+      Node *subtreeRoot = buildTree(scapegoat.treeSize, nodes);
 
-      // Now, dummy's left child is the root of the new rebuilt subtree,
-      // so we may wire the rebuilt subtree back into the tree.
+      // Wire the rebuilt subtree back into the tree.
       if (! scapegoat.parent) {
-        root = dummy.left;
+        root = subtreeRoot;
         maxSize = size;
       } else if (scapegoat.scapegoat == scapegoat.parent->left) {
-        scapegoat.parent->left = dummy.left;
+        scapegoat.parent->left = subtreeRoot;
       } else /* if (scapegoat.scapegoat == scapegoat.parent->right) */ {
-        scapegoat.parent->right = dummy.left;
+        scapegoat.parent->right = subtreeRoot;
+      }
+
+      if constexpr (kCollectStats) {
+        this->rebuildStats.recordRebuild(scapegoat.treeSize, ! scapegoat.parent,
+                                         std::chrono::steady_clock::now() - start);
+      }
+
+      if constexpr (kRebuildEvents) {
+        if (this->rebuildListener) this->rebuildListener->afterRebuild(event);
       }
     }
 
     /** 
      * Rebuild subroutine: 
-     * Converts the tree rooted at treeRoot into a linked list
-     * joined by right child pointers, prepends this list to listHead,
-     * and returns the head of the resulting list.
+     * Hands out the nodes of the subtree rooted at treeRoot one at a time, 
+     * in order. Each node's children are read before it is handed out, 
+     * so the caller may rewire it right away.
      * 
-     * Time complexity: O(subtree size of treeRoot)
-     * Space complexity: O(subtree height of treeRoot)
-     * Equivalent to FLATTEN(x, y) in Galperin and Rivest.
+     * Time complexity: amortized O(1) per node
+     * Space complexity: O(subtree height of treeRoot), in a NodeStack
+     * Streaming equivalent of FLATTEN(x, nullptr) in Galperin and Rivest, 
+     * which saves walking the flattened list a second time.
      */ 
-    Node* flatten(Node *treeRoot, Node *listHead) {
-      // If there's nothing to prepend, the list stays the same.
-      if (! treeRoot) return listHead;
+    class Flattener {
+      public:
+        Flattener(Node *treeRoot, size_t maxDepth) 
+          : ancestors(maxDepth), rest(treeRoot) {}
+
+        Node* next() {
+          // The next node in order is the leftmost node of the unvisited 
+          // subtree if there is one, and otherwise the deepest ancestor 
+          // waiting on the stack.
+          while (rest) {
+            ancestors.push(rest);
+            rest = rest->left;
+          }
+          Node *node = ancestors.top();
+          ancestors.pop();
 
-      // Otherwise, prepend the right subtree, then the root, then its left subtree.
-      treeRoot->right = flatten(treeRoot->right, listHead);
-      return flatten(treeRoot->left, treeRoot);
-    }
+          // Read the node's right child before the caller rewires it.
+          rest = node->right;
+          return node;
+        }
+
+      private:
+        InsertionPath ancestors;  // Visited nodes whose keys are still to come
+        Node* rest;               // Root of the subtree not yet visited
+    };
+
+    /**
+     * Assign subroutine:
+     * Hands out freshly constructed nodes holding the keys read from an
+     * iterator one at a time, in order, in consecutive pieces of storage.
+     */
+    template<typename InputIt>
+    class KeyNodeMaker {
+      public:
+        KeyNodeMaker(InputIt keys, Node *nodes) : keys(keys), nodes(nodes) {}
+
+        Node* next() {
+          Node *node = new (nodes++) Node{ *keys, nullptr, nullptr };
+          ++keys;
+          return node;
+        }
+
+      private:
+        InputIt keys;  // The key of the next node to hand out
+        Node* nodes;   // Storage for the next node to hand out
+    };
 
     /**
      * Rebuild subroutine:
      * 
-     * Given a size n for the tree to build and the head of a linked list 
-     * joined by right child pointers, constructs a 1/2-weight-balanced tree of
-     * n nodes from the list, in-place. 
-     * 
-     * Returns a pointer to the (n+1)th node in the list whose left child 
-     * holds the root of the equivalent tree.
-     * 
-     * Assumes that listHead's size is at least n+1.
+     * Given a size n for the tree to build and a source of nodes whose next()
+     * returns them in order (see Flattener and KeyNodeMaker), constructs a 1/2-weight-balanced 
+     * tree of the next n nodes, in-place, and returns its root.
      * 
      * Time complexity: O(treeSize)
-     * Space complexity: O(log treeSize)
-     * Equivalent to BUILD-TREE(n, x) in Galperin and Rivest.
+     * Space complexity: O(log treeSize), in a fixed-size array
+     * Equivalent to BUILD-TREE(n, x) in Galperin and Rivest, computed 
+     * iteratively with integer-only size splits.
      */ 
-    Node* buildTree(size_t treeSize, Node *listHead) {
-      // No tree to build: resulting tree is nullptr, return rewired 1st element of list.
-      if (treeSize == 0) {
-        listHead->left = nullptr;
-        return listHead;
-      }
-      // Otherwise, recursively build the tree:
-
-      double halfTreeSize = (treeSize - 1.0) / 2.0;
-
-      // Node whose left child is a balanced tree equivalent of the first half of the list
-      // and right child is the unaltered second half of the list.
-      Node *firstHalf = buildTree(static_cast<size_t>(ceil(halfTreeSize)), listHead);
+    template<typename NodeSource>
+    Node* buildTree(size_t treeSize, NodeSource &nodes) {
+      // Stack of the subtrees being built, standing in for the recursion of 
+      // BUILD-TREE: each subtree builds its left half of treeSize / 2 nodes, 
+      // takes the next node in order as its root, then builds its right 
+      // half of (treeSize - 1) / 2 nodes. Sizes halve at each level, so the 
+      // stack never holds more frames than there are bits in a size_t.
+      BuildFrame frames[kMaxBuildDepth];
+      size_t depth = 0;
+
+      Node *built;  // The root of the most recently built subtree
+      size_t pending = treeSize;
 
-      // (n+1)th node in the original list, whose left child is the balanced tree 
-      // equivalent of the second half of the list.
-      Node *secondHalf = buildTree(static_cast<size_t>(floor(halfTreeSize)), firstHalf->right);
-
-      // Rewire so that firstHalf is now the tree formed of n elements from the list.
-      firstHalf->right = secondHalf->left;
-      
-      // Return a node whose left child is the equivalent tree, as specified.
-      secondHalf->left = firstHalf;
-      return secondHalf;
+      while (true) {
+        // Descend the left spine of a subtree of pending nodes.
+        while (pending > 0) {
+          frames[depth++] = { pending, nullptr };
+          pending /= 2;
+        }
+        built = nullptr;
+
+        // Finish every subtree whose right half was just built.
+        while (depth > 0 && frames[depth - 1].root) {
+          BuildFrame &frame = frames[--depth];
+          frame.root->right = built;
+          if constexpr (kTrackSubtreeSizes) frame.root->size = frame.treeSize;
+          built = frame.root;
+        }
+        if (depth == 0) return built;
+
+        // The left half of the innermost subtree was just built: 
+        // give it a root, then build its right half.
+        BuildFrame &frame = frames[depth - 1];
+        frame.root = nodes.next();
+        frame.root->left = built;
+        pending = (frame.treeSize - 1) / 2;
+      }
     }
 
     /**
      * Verify helper function for a specific node.
      * Returns information verifying whether the subtree rooted at the given node 
-     * is loosely alpha-height balanced and a proper BST - see VerificationData struct.
+     * is loosely alpha-height balanced and a proper BST, and whether its stored
+     * subtree sizes (if any) are correct - see VerificationData struct.
      */
     VerificationData verifyHelper(Node *node) const {
       // Base case: if tree is empty, size is 0 and tree is balanced.
       if (! node) {
-        return { true, true, 0, -1 };
+        return { true, true, true, 0, -1 };
       }
 
       // Check if left child's key < current node's key < right child's key. 
@@ -544,7 +1887,11 @@ class ScapegoatTree {
       int height = std::max(left.height, right.height) + 1;
       int max_height = getAlphaDeepHeight(size) + 1;
 
-      return { height <= max_height, isBST, size, height };
+      // Check if the stored subtree size (if any) matches the actual size.
+      bool sizesValid = left.sizesValid && right.sizesValid;
+      if constexpr (kTrackSubtreeSizes) sizesValid = sizesValid && node->size == size;
+
+      return { height <= max_height, isBST, sizesValid, size, height };
     }
 
     /**
@@ -558,10 +1905,214 @@ class ScapegoatTree {
       } else {
         std::cout << std::setw(indent) << "" << "Node       " << root << '\n';
         std::cout << std::setw(indent) << "" << "Key:       " << root->key << '\n';
+        if constexpr (kTrackSubtreeSizes) {
+          std::cout << std::setw(indent) << "" << "Size:      " << root->size << '\n';
+        }
         std::cout << std::setw(indent) << "" << "Left Child:" << '\n';
         printDebugInfoRec(root->left,  indent + 4);
         std::cout << std::setw(indent) << "" << "Right Child:" << '\n';
         printDebugInfoRec(root->right, indent + 4);
       }
     }
+
+  public:
+    /**
+     * Iterator over the keys of the tree. Nodes store no parent pointers, so
+     * the iterator keeps the path from the root down to its node instead, 
+     * which no scapegoat tree can make longer than its alpha-deep height 
+     * allows. The path is empty past the largest key.
+     * 
+     * Incrementing or decrementing takes amortized O(1) time over a scan, and
+     * O(log N) time in the worst case.
+     */
+    class const_iterator {
+      public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type        = T;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const T*;
+        using reference         = const T&;
+
+        const_iterator() = default;
+
+        reference operator*() const  { return path.top()->key; }
+        pointer   operator->() const { return &path.top()->key; }
+
+        const_iterator& operator++() {
+          // The next key is the smallest one in the right subtree if there is 
+          // one, and otherwise in the nearest ancestor of which this node is 
+          // a left descendant.
+          Node* node = path.top();
+          if (node->right) {
+            pushSpine(node->right, true);
+            return *this;
+          }
+
+          path.pop();
+          while (! path.empty() && path.top()->right == node) {
+            node = path.top();
+            path.pop();
+          }
+          return *this;
+        }
+
+        const_iterator& operator--() {
+          // Past the largest key, the previous key is the largest one in the tree.
+          if (path.empty()) {
+            pushSpine(tree->root, false);
+            return *this;
+          }
+
+          // Otherwise, mirror operator++.
+          Node* node = path.top();
+          if (node->left) {
+            pushSpine(node->left, false);
+            return *this;
+          }
+
+          path.pop();
+          while (! path.empty() && path.top()->left == node) {
+            node = path.top();
+            path.pop();
+          }
+          return *this;
+        }
+
+        const_iterator operator++(int) {
+          const_iterator old = *this;
+          ++*this;
+          return old;
+        }
+
+        const_iterator operator--(int) {
+          const_iterator old = *this;
+          --*this;
+          return old;
+        }
+
+        bool operator==(const const_iterator& other) const { return node() == other.node(); }
+        bool operator!=(const const_iterator& other) const { return node() != other.node(); }
+
+      private:
+        friend class ScapegoatTree;
+        friend class ScapegoatTree::const_reverse_iterator;
+
+        /**
+         * Paths up to this many nodes long are kept inside the iterator, 
+         * which covers trees of up to about ten million nodes for alpha up 
+         * to 0.6, and ninety thousand for alpha 0.7. Longer paths are 
+         * allocated on the heap, once per iterator made or copied.
+         */
+        static constexpr size_t kInlinePathCapacity = 32;
+
+        const ScapegoatTree* tree = nullptr;  // The tree iterated over, for --end()
+        NodeStack<Node, kInlinePathCapacity> path;  // From the root to the current node
+
+        const_iterator(const ScapegoatTree* tree, size_t maxDepth) 
+          : tree(tree), path(maxDepth) {}
+
+        // Returns the current node, or nullptr past the largest key.
+        Node* node() const { return path.empty() ? nullptr : path.top(); }
+
+        /**
+         * Pushes the given node and its descendants along its left (if toLeft)
+         * or right spine onto the path, ending at its smallest or largest key.
+         */
+        void pushSpine(Node* node, bool toLeft) {
+          while (node) {
+            path.push(node);
+            node = toLeft ? node->left : node->right;
+          }
+        }
+    };
+
+    /**
+     * Iterator over the keys of the tree in decreasing order. Where 
+     * std::reverse_iterator would keep an iterator to the next larger key 
+     * and step back from a copy of it on every dereference, this keeps an 
+     * iterator to its own key, whose path is empty past the smallest key.
+     * 
+     * Incrementing or decrementing takes amortized O(1) time over a scan, and
+     * O(log N) time in the worst case.
+     */
+    class const_reverse_iterator {
+      public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type        = T;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const T*;
+        using reference         = const T&;
+
+        const_reverse_iterator() = default;
+
+        /**
+         * Constructs an iterator to the key before next, as 
+         * std::reverse_iterator(next) refers to.
+         */
+        explicit const_reverse_iterator(const_iterator next) : current(next) {
+          --current;
+        }
+
+        /**
+         * Returns an iterator to the key after this one, as 
+         * std::reverse_iterator::base does.
+         */
+        const_iterator base() const {
+          const_iterator next = current;
+          if (next.path.empty()) {
+            next.pushSpine(next.tree->root, true);
+          } else {
+            ++next;
+          }
+          return next;
+        }
+
+        reference operator*() const  { return *current; }
+        pointer   operator->() const { return current.operator->(); }
+
+        const_reverse_iterator& operator++() {
+          --current;
+          return *this;
+        }
+
+        const_reverse_iterator& operator--() {
+          // Past the smallest key, the previous key is the smallest one in the tree.
+          if (current.path.empty()) {
+            current.pushSpine(current.tree->root, true);
+          } else {
+            ++current;
+          }
+          return *this;
+        }
+
+        const_reverse_iterator operator++(int) {
+          const_reverse_iterator old = *this;
+          ++*this;
+          return old;
+        }
+
+        const_reverse_iterator operator--(int) {
+          const_reverse_iterator old = *this;
+          --*this;
+          return old;
+        }
+
+        bool operator==(const const_reverse_iterator& other) const { return current == other.current; }
+        bool operator!=(const const_reverse_iterator& other) const { return current != other.current; }
+
+      private:
+        friend class ScapegoatTree;
+
+        const_iterator current;  // The iterator to this key, or past the smallest one
+    };
 };
+
+/**
+ * Deduces a tree compared through a plain comparison function from the 
+ * function passed to its constructor.
+ */
+template<typename T, typename Allocator = std::allocator<T>>
+ScapegoatTree(double, bool (*)(const T&, const T&), const Allocator& = Allocator())
+  -> ScapegoatTree<T, bool (*)(const T&, const T&), Allocator>;
+
+#endif // GENERIC_SCAPEGOAT_TREE_H
@@ -0,0 +1,439 @@
+/**
+ * NodePool.h provides a chunked slab allocator for the nodes of a Scapegoat
+ * Tree. Nodes are carved out of large chunks by bumping a pointer, and nodes
+ * given back to the pool are kept on an intrusive freelist to be reused by
+ * later allocations, so that insert/remove churn rarely reaches the underlying
+ * allocator. Destroying the pool frees whole chunks at once.
+ *
+ * IndexedNodePool instead refers to nodes by 32-bit NodeIndex values, whose
+ * high bits pick a chunk and low bits a slot within it, so that nodes can 
+ * link to each other in half the space of pointers.
+ *
+ * Authors: Ryan Guan (rzgn) and Tyler Packard (TPackard), 2021
+ */
+
+#ifndef NODE_POOL_H
+#define NODE_POOL_H
+
+#include <algorithm>  // for std::copy, std::max, std::min
+#include <cstddef>  // for std::size_t, std::nullptr_t
+#include <cstdint>  // for std::uint32_t
+#include <limits>   // for std::numeric_limits
+#include <memory>   // for std::allocator, std::allocator_traits
+#include <stdexcept>  // for std::length_error
+#include <vector>   // for the lists of allocated chunks
+
+/**
+ * Pool handing out uninitialized storage for objects of type Node. Chunks are
+ * obtained from the (rebound) Allocator and grow geometrically in size.
+ *
+ * The pool never runs constructors or destructors: callers construct nodes in
+ * the storage returned by allocate() and must destroy them before handing
+ * them back through deallocate(), or before the pool itself is destroyed.
+ */
+template<typename Node, typename Allocator = std::allocator<Node>>
+class NodePool {
+  public:
+    /**
+     * Constructs an empty pool. No memory is allocated until the first node
+     * is requested.
+     */
+    explicit NodePool(const Allocator& allocator = Allocator())
+      : slotAllocator(allocator) {}
+
+    /**
+     * Frees every chunk allocated by this pool.
+     *
+     * Time complexity: O(number of chunks)
+     */
+    ~NodePool() {
+      releaseChunks();
+    }
+
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    /**
+     * Returns a copy of the allocator the pool was constructed with.
+     */
+    Allocator getAllocator() const {
+      return Allocator(slotAllocator);
+    }
+
+    /**
+     * Returns uninitialized storage for a single node, popped off the
+     * freelist if possible and bumped off the current chunk otherwise.
+     *
+     * Time complexity: amortized O(1)
+     */
+    Node* allocate() {
+      if (freeList) {
+        Slot* slot = freeList;
+        freeList = slot->next;
+        freeCount--;
+        return reinterpret_cast<Node *>(slot);
+      }
+      if (chunkUsed == chunkCapacity) {
+        allocateChunk();
+      }
+      return reinterpret_cast<Node *>(&currentChunk[chunkUsed++]);
+    }
+
+    /**
+     * Returns uninitialized, contiguous storage for count nodes, bumped off 
+     * the current chunk if it has room and off a fresh chunk otherwise. 
+     * The nodes may later be deallocated one by one.
+     *
+     * Time complexity: amortized O(1)
+     */
+    Node* allocateRun(size_t count) {
+      if (chunkCapacity - chunkUsed < count) {
+        // Recycle what is left of the current chunk, then start a new one.
+        while (chunkUsed < chunkCapacity) {
+          deallocate(reinterpret_cast<Node *>(&currentChunk[chunkUsed++]));
+        }
+        allocateChunk(count);
+      }
+      Node* run = reinterpret_cast<Node *>(&currentChunk[chunkUsed]);
+      chunkUsed += count;
+      return run;
+    }
+
+    /**
+     * Returns the storage of an already destroyed node to the pool.
+     *
+     * Time complexity: O(1)
+     */
+    void deallocate(Node *node) {
+      Slot* slot = reinterpret_cast<Slot *>(node);
+      slot->next = freeList;
+      freeList = slot;
+      freeCount++;
+    }
+
+    /**
+     * Returns the number of nodes handed back and not reused yet.
+     */
+    size_t freeNodes() const {
+      return freeCount;
+    }
+
+    /**
+     * Frees every chunk at once, invalidating all nodes handed out so far.
+     * Any nodes still alive must have been destroyed beforehand.
+     *
+     * Time complexity: O(number of chunks)
+     */
+    void clear() {
+      releaseChunks();
+      chunks.clear();
+      freeList = nullptr;
+      freeCount = 0;
+      currentChunk = nullptr;
+      chunkUsed = chunkCapacity = 0;
+    }
+
+  private:
+    /**
+     * Storage for one node, which doubles as a freelist link while unused.
+     */
+    union Slot {
+      Slot* next;
+      alignas(Node) unsigned char storage[sizeof(Node)];
+    };
+
+    using SlotAllocator =
+        typename std::allocator_traits<Allocator>::template rebind_alloc<Slot>;
+    using SlotTraits = std::allocator_traits<SlotAllocator>;
+
+    /**
+     * A contiguous array of slots obtained from the allocator.
+     */
+    struct Chunk {
+      Slot*  slots;
+      size_t capacity;
+    };
+
+    /**
+     * Chunk sizes start small so that small trees stay small, and double
+     * up to a cap so that large trees need few calls into the allocator.
+     */
+    static constexpr size_t kInitialChunkCapacity = 32;
+    static constexpr size_t kMaxChunkCapacity = 1 << 16;
+
+    SlotAllocator slotAllocator;
+    std::vector<Chunk> chunks;
+
+    Slot* freeList = nullptr;       // Head of the list of recycled slots
+    size_t freeCount = 0;           // Number of slots on the freelist
+    Slot* currentChunk = nullptr;   // Chunk new slots are bumped off of
+    size_t chunkUsed = 0;           // Number of slots used in currentChunk
+    size_t chunkCapacity = 0;       // Number of slots in currentChunk
+
+    /**
+     * Allocates a new chunk, twice as large as the previous one up to the cap
+     * but at least minCapacity slots large, and makes it the current chunk.
+     */
+    void allocateChunk(size_t minCapacity = 0) {
+      size_t capacity = chunkCapacity == 0 ? kInitialChunkCapacity
+                      : chunkCapacity < kMaxChunkCapacity ? 2 * chunkCapacity
+                      : kMaxChunkCapacity;
+      if (capacity < minCapacity) capacity = minCapacity;
+
+      currentChunk = SlotTraits::allocate(slotAllocator, capacity);
+      chunks.push_back({ currentChunk, capacity });
+      chunkUsed = 0;
+      chunkCapacity = capacity;
+    }
+
+    /**
+     * Hands every chunk back to the allocator.
+     */
+    void releaseChunks() {
+      for (const Chunk& chunk : chunks) {
+        SlotTraits::deallocate(slotAllocator, chunk.slots, chunk.capacity);
+      }
+    }
+};
+
+/**
+ * Reference to a node of an IndexedNodePool: the node's 32-bit index in the
+ * pool. Index 0 refers to no node, so that, like a pointer, a 
+ * NodeIndex converts from nullptr, tests false when null, and runs of 
+ * consecutive nodes are reached by adding offsets.
+ */
+class NodeIndex {
+  public:
+    NodeIndex() = default;
+    NodeIndex(std::nullptr_t) {}
+    explicit NodeIndex(std::size_t index) : index(static_cast<std::uint32_t>(index)) {}
+
+    std::size_t value() const { return index; }
+
+    explicit operator bool() const { return index != 0; }
+
+    bool operator==(NodeIndex other) const { return index == other.index; }
+    bool operator!=(NodeIndex other) const { return index != other.index; }
+
+    NodeIndex operator+(std::size_t offset) const { return NodeIndex(index + offset); }
+
+    NodeIndex& operator++() {
+      index++;
+      return *this;
+    }
+
+    NodeIndex operator++(int) {
+      NodeIndex old = *this;
+      index++;
+      return old;
+    }
+
+  private:
+    std::uint32_t index = 0;
+};
+
+/**
+ * Pool handing out uninitialized storage for objects of type Node, as 
+ * NodePool does, but addressed by NodeIndex. The high bits of an index pick
+ * one of the pool's chunks, and the low bits a slot within it. Every chunk 
+ * holds kChunkCapacity slots, except that the first one starts small and 
+ * grows by doubling, moving its nodes, until it is full size: small trees 
+ * stay small, and once a tree outgrows the first chunk, its nodes never move
+ * again. Nodes must still only be held by index across allocations. Freed
+ * nodes are kept on an intrusive freelist.
+ */
+template<typename Node, typename Allocator = std::allocator<Node>>
+class IndexedNodePool {
+  public:
+    /**
+     * Constructs an empty pool. No memory is allocated until the first node
+     * is requested.
+     */
+    explicit IndexedNodePool(const Allocator& allocator = Allocator())
+      : slotAllocator(allocator) {}
+
+    /**
+     * Frees every chunk allocated by this pool.
+     *
+     * Time complexity: O(number of chunks)
+     */
+    ~IndexedNodePool() {
+      releaseChunks();
+    }
+
+    IndexedNodePool(const IndexedNodePool&) = delete;
+    IndexedNodePool& operator=(const IndexedNodePool&) = delete;
+
+    /**
+     * Returns the node with the given (non-null) index.
+     */
+    Node& at(NodeIndex node) {
+      return *reinterpret_cast<Node *>(slot(node).storage);
+    }
+
+    const Node& at(NodeIndex node) const {
+      return *reinterpret_cast<const Node *>(slot(node).storage);
+    }
+
+    /**
+     * Returns uninitialized storage for a single node, popped off the 
+     * freelist if possible and appended after the last slot otherwise.
+     * Throws std::length_error once 32-bit indices run out.
+     *
+     * Time complexity: amortized O(1)
+     */
+    NodeIndex allocate() {
+      if (freeList) {
+        NodeIndex node = freeList;
+        freeList = NodeIndex(slot(node).next);
+        freeCount--;
+        return node;
+      }
+      return allocateRun(1);
+    }
+
+    /**
+     * Returns uninitialized storage for count nodes with consecutive indices,
+     * appended after the last slot, in as many chunks as they span. The 
+     * nodes may later be deallocated one by one. Free slots are never reused
+     * for runs, so the pool keeps growing until it is cleared. Throws 
+     * std::length_error once 32-bit indices run out.
+     *
+     * Time complexity: amortized O(count / kChunkCapacity + 1)
+     */
+    NodeIndex allocateRun(size_t count) {
+      // Index 0 is set aside, so that it can stand for no node.
+      size_t first = used == 0 ? 1 : used;
+      if (count > kMaxIndex + 1 - first) {
+        throw std::length_error("Too many nodes for 32-bit node indices");
+      }
+      if (first + count > capacity()) reserve(first + count);
+      used = first + count;
+      return NodeIndex(first);
+    }
+
+    /**
+     * Returns the storage of an already destroyed node to the pool.
+     *
+     * Time complexity: O(1)
+     */
+    void deallocate(NodeIndex node) {
+      slot(node).next = static_cast<std::uint32_t>(freeList.value());
+      freeList = node;
+      freeCount++;
+    }
+
+    /**
+     * Returns the number of nodes handed back and not reused yet.
+     */
+    size_t freeNodes() const {
+      return freeCount;
+    }
+
+    /**
+     * Frees every chunk at once, invalidating all nodes handed out so far.
+     * Any nodes still alive must have been destroyed beforehand.
+     *
+     * Time complexity: O(number of chunks)
+     */
+    void clear() {
+      releaseChunks();
+      chunks.clear();
+      firstCapacity = used = 0;
+      freeList = nullptr;
+      freeCount = 0;
+    }
+
+    /**
+     * Returns a copy of the allocator the pool was constructed with.
+     */
+    Allocator getAllocator() const {
+      return Allocator(slotAllocator);
+    }
+
+  private:
+    /**
+     * Storage for one node, which doubles as a freelist link (the index of
+     * the next free slot) while unused.
+     */
+    union Slot {
+      std::uint32_t next;
+      alignas(Node) unsigned char storage[sizeof(Node)];
+    };
+
+    using SlotAllocator =
+        typename std::allocator_traits<Allocator>::template rebind_alloc<Slot>;
+    using SlotTraits = std::allocator_traits<SlotAllocator>;
+
+    static constexpr size_t kMaxIndex = std::numeric_limits<std::uint32_t>::max();
+
+    /**
+     * Chunks hold 2^kChunkBits slots, about a megabyte of nodes, so that the
+     * list of chunks of a tree of millions of nodes fits in a few cache
+     * lines, and stays in cache alongside the nodes.
+     */
+    static constexpr unsigned kChunkBits = 16;
+    static constexpr size_t kChunkCapacity = size_t(1) << kChunkBits;
+    static constexpr size_t kSlotMask = kChunkCapacity - 1;
+    static constexpr size_t kInitialCapacity = 32;
+
+    SlotAllocator slotAllocator;
+    std::vector<Slot*> chunks;   // Every chunk, in order of the indices they hold
+
+    size_t firstCapacity = 0;    // Number of slots in the first chunk
+    size_t used = 0;             // One past the last index handed out, 0 if none
+    NodeIndex freeList;          // Head of the list of recycled slots
+    size_t freeCount = 0;        // Number of slots on the freelist
+
+    Slot& slot(NodeIndex node) {
+      return chunks[node.value() >> kChunkBits][node.value() & kSlotMask];
+    }
+
+    const Slot& slot(NodeIndex node) const {
+      return chunks[node.value() >> kChunkBits][node.value() & kSlotMask];
+    }
+
+    /**
+     * Returns the number of slots in all chunks.
+     */
+    size_t capacity() const {
+      return chunks.empty() ? 0 : firstCapacity + (chunks.size() - 1) * kChunkCapacity;
+    }
+
+    /**
+     * Adds chunks until there are at least slotCount slots, first growing
+     * the first chunk to full size if it is not yet.
+     */
+    void reserve(size_t slotCount) {
+      if (firstCapacity < kChunkCapacity) {
+        size_t grown = std::max(2 * firstCapacity, kInitialCapacity);
+        grown = std::min(std::max(grown, slotCount), kChunkCapacity);
+
+        // The slots are trivially copyable, free ones included.
+        Slot* first = SlotTraits::allocate(slotAllocator, grown);
+        if (! chunks.empty()) {
+          std::copy(chunks[0], chunks[0] + firstCapacity, first);
+          SlotTraits::deallocate(slotAllocator, chunks[0], firstCapacity);
+          chunks[0] = first;
+        } else {
+          chunks.push_back(first);
+        }
+        firstCapacity = grown;
+      }
+
+      while (capacity() < slotCount) {
+        chunks.push_back(SlotTraits::allocate(slotAllocator, kChunkCapacity));
+      }
+    }
+
+    /**
+     * Hands every chunk back to the allocator.
+     */
+    void releaseChunks() {
+      for (size_t i = 0; i < chunks.size(); i++) {
+        SlotTraits::deallocate(slotAllocator, chunks[i], i == 0 ? firstCapacity : kChunkCapacity);
+      }
+    }
+};
+
+#endif // NODE_POOL_H
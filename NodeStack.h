@@ -0,0 +1,87 @@
+/**
+ * NodeStack.h provides the stack used to remember a path of nodes from the
+ * root of a Scapegoat Tree, such as the ancestors of a freshly inserted node.
+ *
+ * The height of a scapegoat tree is bounded by its alpha-deep height, so the
+ * stack is sized up front from that bound and kept in an inline array that
+ * lives wherever the stack does (usually the call stack of an insert, or an
+ * iterator). Only paths longer than the inline capacity, which need a large 
+ * alpha and a very large tree, spill over into heap memory.
+ *
+ * Authors: Ryan Guan (rzgn) and Tyler Packard (TPackard), 2021
+ */
+
+#ifndef NODE_STACK_H
+#define NODE_STACK_H
+
+#include <cstddef>  // for std::size_t
+#include <vector>   // for paths longer than the inline capacity
+
+/**
+ * Stack of references to nodes of type Node, which are pointers unless nodes
+ * are referred to in some other way (such as by NodeIndex).
+ */
+template<typename Node, std::size_t InlineCapacity, typename NodeRef = Node*>
+class NodeStack {
+  public:
+    /**
+     * Constructs an empty stack able to hold expectedSize nodes without
+     * allocating again. The stack still grows if more nodes are pushed.
+     */
+    explicit NodeStack(std::size_t expectedSize = 0) {
+      if (expectedSize > InlineCapacity) spill(expectedSize);
+    }
+
+    /**
+     * Copies the nodes on the given stack, keeping them inline if they fit.
+     */
+    NodeStack(const NodeStack& other) {
+      *this = other;
+    }
+
+    NodeStack& operator=(const NodeStack& other) {
+      if (this == &other) return *this;
+      if (other.count > capacity) spill(other.count);
+      for (std::size_t i = 0; i < other.count; i++) {
+        nodes[i] = other.nodes[i];
+      }
+      count = other.count;
+      return *this;
+    }
+
+    void push(NodeRef node) {
+      if (count == capacity) spill(2 * capacity);
+      nodes[count++] = node;
+    }
+
+    NodeRef top() const { return nodes[count - 1]; }
+    void pop()          { count--; }
+
+    // Returns the i-th node pushed onto the stack, starting from 0.
+    NodeRef operator[](std::size_t i) const { return nodes[i]; }
+
+    std::size_t size() const { return count; }
+    bool empty() const       { return count == 0; }
+
+  private:
+    NodeRef inlineNodes[InlineCapacity];
+    std::vector<NodeRef> heapNodes;  // Only used once the inline array is too small
+
+    NodeRef* nodes = inlineNodes;
+    std::size_t count = 0;
+    std::size_t capacity = InlineCapacity;
+
+    /**
+     * Moves the stack's contents into heap memory able to hold newCapacity nodes.
+     */
+    void spill(std::size_t newCapacity) {
+      if (nodes == inlineNodes) {
+        heapNodes.assign(inlineNodes, inlineNodes + count);
+      }
+      heapNodes.resize(newCapacity);
+      nodes = heapNodes.data();
+      capacity = newCapacity;
+    }
+};
+
+#endif // NODE_STACK_H
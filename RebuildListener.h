@@ -0,0 +1,80 @@
+/**
+ * RebuildListener.h provides the interface through which a Scapegoat Tree
+ * reports each of its rebuilds as it happens, so that the pauses rebuilds
+ * cause can be traced alongside the operations they slow down.
+ *
+ * Trees only report rebuilds when asked to at compile time (see
+ * ScapegoatTree.h and DefaultScapegoatOptions); otherwise no reporting code
+ * is compiled in at all.
+ *
+ * Authors: Ryan Guan (rzgn) and Tyler Packard (TPackard), 2021
+ */
+
+#ifndef REBUILD_LISTENER_H
+#define REBUILD_LISTENER_H
+
+#include <cstddef>  // for std::size_t
+
+/**
+ * Why a subtree is being rebuilt.
+ */
+enum class RebuildReason {
+  // An insertion went deeper than the alpha-deep height of the tree's size,
+  // and the subtree's root is its scapegoat.
+  kInsertTooDeep,
+
+  // Removals shrank the tree to alpha times its size since the last rebuild
+  // of the whole tree or fewer keys (size <= alpha * maxSize).
+  kRemoveShrunk,
+
+  // A batch insertion large enough compared to the tree was merged with the
+  // tree's keys into a new tree, reported once the merged keys are known.
+  kBatchMerge
+};
+
+/**
+ * Describes a rebuild.
+ */
+struct RebuildEvent {
+  std::size_t treeSize;  // The number of nodes in the rebuilt subtree
+  std::size_t depth;     // The depth of the subtree's root, 0 for the whole tree
+  bool wholeTree;        // Whether the subtree is the whole tree
+  RebuildReason reason;
+};
+
+/**
+ * Receives the rebuilds of the trees it is registered with. Both functions
+ * run on the thread doing the operation that caused the rebuild, and must
+ * not modify the tree.
+ *
+ * A subtree rebuilt incrementally (see ScapegoatTree::setRebuildBudget) is
+ * reported once, before its first step and after its last, so that the
+ * rebuilds in between are reported inside that pair. One dropped before it
+ * is done is reported as over when it is dropped.
+ */
+class RebuildListener {
+  public:
+    virtual ~RebuildListener() = default;
+
+    // Called right before the subtree is rebuilt.
+    virtual void beforeRebuild(const RebuildEvent& event) { (void) event; }
+
+    // Called right after the subtree is rebuilt, with the same event.
+    virtual void afterRebuild(const RebuildEvent& event) { (void) event; }
+};
+
+/**
+ * Base class of a tree holding a pointer to its RebuildListener if Enabled,
+ * and nothing otherwise, so that trees without rebuild events take no room
+ * for one.
+ */
+template<bool Enabled>
+class RebuildListenerHolder {
+  protected:
+    RebuildListener* rebuildListener = nullptr;
+};
+
+template<>
+class RebuildListenerHolder<false> {};
+
+#endif // REBUILD_LISTENER_H
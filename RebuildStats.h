@@ -0,0 +1,98 @@
+/**
+ * RebuildStats.h provides the counters a Scapegoat Tree can keep about its
+ * rebuilds, which cause its worst-case operation times: how many there were
+ * and how large, how long they took, how much work went into finding
+ * scapegoats, and how deep insertions went compared to the alpha-deep height.
+ *
+ * Trees only keep stats when asked to at compile time (see ScapegoatTree.h
+ * and DefaultScapegoatOptions), and cost nothing otherwise.
+ *
+ * Authors: Ryan Guan (rzgn) and Tyler Packard (TPackard), 2021
+ */
+
+#ifndef REBUILD_STATS_H
+#define REBUILD_STATS_H
+
+#include <chrono>   // for std::chrono::nanoseconds, std::chrono::steady_clock
+#include <cstddef>  // for std::size_t
+
+/**
+ * Counters about the rebuilds of a tree since it was constructed.
+ */
+struct RebuildStats {
+  // Enough buckets for subtrees of any size.
+  static constexpr std::size_t kNumSizeBuckets = 8 * sizeof(std::size_t);
+
+  std::size_t partialRebuilds = 0;  // Rebuilds of a proper subtree
+  std::size_t fullRebuilds = 0;     // Rebuilds of the whole tree
+
+  /**
+   * Histogram of the sizes of rebuilt subtrees: rebuiltSizes[i] counts the
+   * rebuilds of subtrees of at least 2^i and fewer than 2^(i + 1) nodes.
+   * Rebuilds of an empty tree are counted in rebuiltSizes[0].
+   */
+  std::size_t rebuiltSizes[kNumSizeBuckets] = {};
+
+  /**
+   * The number of nodes whose subtree sizes were counted (or read, if nodes
+   * store them) while finding scapegoats.
+   */
+  std::size_t scapegoatSearchNodes = 0;
+
+  /**
+   * The greatest depth at which a key was inserted, before any rebuild, and
+   * the alpha-deep height of the tree's size right after that insertion.
+   * Insertions deeper than the alpha-deep height trigger rebuilds.
+   */
+  std::size_t maxDepth = 0;
+  std::size_t alphaDeepHeightAtMaxDepth = 0;
+
+  std::chrono::nanoseconds rebuildTime{0};  // Total time spent rebuilding
+
+  /**
+   * Returns the bucket of rebuiltSizes counting subtrees of the given size.
+   */
+  static std::size_t sizeBucket(std::size_t treeSize) {
+    std::size_t bucket = 0;
+    while (treeSize >>= 1) bucket++;
+    return bucket;
+  }
+
+  /**
+   * Counts a rebuild of a subtree of the given size, or of the whole tree,
+   * which took the given time.
+   */
+  void recordRebuild(std::size_t treeSize, bool wholeTree,
+                     std::chrono::steady_clock::duration elapsed) {
+    if (wholeTree) fullRebuilds++;
+    else partialRebuilds++;
+    rebuiltSizes[sizeBucket(treeSize)]++;
+    rebuildTime += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed);
+  }
+
+  /**
+   * Notes that a key was inserted at the given depth into a tree whose size
+   * then has the given alpha-deep height.
+   */
+  void recordInsertion(std::size_t depth, std::size_t alphaDeepHeight) {
+    if (depth > maxDepth) {
+      maxDepth = depth;
+      alphaDeepHeightAtMaxDepth = alphaDeepHeight;
+    }
+  }
+};
+
+/**
+ * Base class of a tree holding its RebuildStats if Enabled, and nothing
+ * otherwise, so that trees without stats take no room for them.
+ */
+template<bool Enabled>
+class RebuildStatsHolder {
+  protected:
+    RebuildStats rebuildStats;
+};
+
+template<>
+class RebuildStatsHolder<false> {};
+
+#endif // REBUILD_STATS_H
@@ -0,0 +1,223 @@
+/**
+ * ScapegoatMap.h provides an ordered map on top of the generic Scapegoat 
+ * Tree: each node holds a key and its value side by side, and the tree is 
+ * ordered by keys alone. 
+ * 
+ * Rebuilding relinks nodes without moving them, and removing a key relinks 
+ * its successor or predecessor in its place, so values never move once 
+ * inserted: pointers to values stay valid until their key is removed.
+ * 
+ * Authors: Ryan Guan (rzgn) and Tyler Packard (TPackard), 2021
+ */ 
+
+#ifndef SCAPEGOAT_MAP_H
+#define SCAPEGOAT_MAP_H
+
+#include <functional> // for std::less
+#include <memory>     // for std::allocator
+#include <tuple>      // for std::forward_as_tuple
+#include <utility>    // for std::pair, std::piecewise_construct, std::move, std::forward
+
+#include "GenericScapegoatTree.h"
+
+/**
+ * Orders the entries of a map by their keys, using the map's key comparator. 
+ * Transparent, so that entries can be looked up by key alone, and able to 
+ * compare three ways in a single key comparison whenever the key 
+ * comparator allows.
+ */ 
+template<typename K, typename V, typename Compare>
+class MapEntryCompare : private ComparatorHolder<Compare> {
+  public:
+    using Entry = std::pair<const K, V>;
+    using is_transparent = void;
+
+    explicit MapEntryCompare(const Compare& compare = Compare()) 
+      : ComparatorHolder<Compare>(compare) {}
+
+    bool operator()(const Entry& lhs, const Entry& rhs) const {
+      return this->comparator()(lhs.first, rhs.first);
+    }
+
+    bool operator()(const K& lhs, const Entry& rhs) const {
+      return this->comparator()(lhs, rhs.first);
+    }
+
+    bool operator()(const Entry& lhs, const K& rhs) const {
+      return this->comparator()(lhs.first, rhs);
+    }
+
+    int compare(const Entry& lhs, const Entry& rhs) const {
+      return compareThreeWay(this->comparator(), lhs.first, rhs.first);
+    }
+
+    int compare(const K& lhs, const Entry& rhs) const {
+      return compareThreeWay(this->comparator(), lhs, rhs.first);
+    }
+};
+
+template<typename K, typename V, typename Compare = std::less<K>,
+         typename Allocator = std::allocator<std::pair<const K, V>>,
+         typename Options = DefaultScapegoatOptions>
+class ScapegoatMap {
+  public:
+    /**
+     * Constructs a new, empty map whose scapegoat tree has the provided 
+     * alpha value, ordering keys with the provided comparator. Nodes are
+     * allocated in chunks obtained from the provided allocator.
+     * 
+     * Throws std::invalid_argument if alpha is not within (0.5, 1).
+     */
+    explicit ScapegoatMap(double alpha, const Compare& compare = Compare(),
+                          const Allocator& allocator = Allocator())
+      : entries(alpha, EntryCompare(compare), allocator) {}
+
+    /**
+     * Returns the value associated with the given key, or nullptr if the key
+     * is not in the map.
+     * 
+     * Time complexity: O(log N)
+     */
+    V* find(const K& key) {
+      auto node = entries.findNode(key);
+      return node ? &node->key.second : nullptr;
+    }
+
+    const V* find(const K& key) const {
+      auto node = entries.findNode(key);
+      return node ? &node->key.second : nullptr;
+    }
+
+    /**
+     * Returns whether the given key is in the map.
+     * 
+     * Time complexity: O(log N)
+     */
+    bool contains(const K& key) const {
+      return entries.findNode(key) != nullptr;
+    }
+
+    /**
+     * Returns the value associated with the given key, associating a 
+     * value-initialized value with it first if the key is not in the map.
+     * 
+     * Time complexity: amortized O(log N), worst-case O(N)
+     */
+    V& operator[](const K& key) {
+      return *tryEmplace(key).first;
+    }
+
+    V& operator[](K&& key) {
+      return *tryEmplace(std::move(key)).first;
+    }
+
+    /**
+     * If the given key is not in the map, associates it with a value 
+     * constructed in place from the given arguments. Otherwise, neither the
+     * key nor the arguments are touched. Returns the value associated with
+     * the key, and whether it was inserted.
+     * 
+     * Time complexity: amortized O(log N), worst-case O(N)
+     */
+    template<typename... Args>
+    std::pair<V*, bool> try_emplace(const K& key, Args&&... args) {
+      return tryEmplace(key, std::forward<Args>(args)...);
+    }
+
+    template<typename... Args>
+    std::pair<V*, bool> try_emplace(K&& key, Args&&... args) {
+      return tryEmplace(std::move(key), std::forward<Args>(args)...);
+    }
+
+    /**
+     * Associates the given value with the given key, assigning it to the 
+     * value already associated with the key if there is one. Returns the 
+     * value associated with the key, and whether the key was inserted.
+     * 
+     * Time complexity: amortized O(log N), worst-case O(N)
+     */
+    template<typename M>
+    std::pair<V*, bool> insert_or_assign(const K& key, M&& value) {
+      return insertOrAssign(key, std::forward<M>(value));
+    }
+
+    template<typename M>
+    std::pair<V*, bool> insert_or_assign(K&& key, M&& value) {
+      return insertOrAssign(std::move(key), std::forward<M>(value));
+    }
+
+    /**
+     * Removes the given key and its value from the map, and returns whether
+     * the key was in the map.
+     * 
+     * Time complexity: amortized O(log N), worst-case O(N)
+     */
+    bool remove(const K& key) {
+      if (! entries.removeKey(key)) return false;
+
+      entries.rebuildIfShrunk();
+      return true;
+    }
+
+    /**
+     * Returns whether the map's scapegoat tree is loosely alpha-height balanced.
+     */
+    bool verify() const {
+      return entries.verify();
+    }
+
+    /**
+     * Returns the counters the map's scapegoat tree has kept about its
+     * rebuilds. Only available when stats are collected (see
+     * DefaultScapegoatOptions).
+     */
+    const RebuildStats& stats() const {
+      return entries.stats();
+    }
+
+    /**
+     * Registers the given listener to be told of every rebuild of the map's
+     * scapegoat tree, or unregisters it if the listener is nullptr. Only 
+     * available when rebuild events are enabled (see DefaultScapegoatOptions).
+     */
+    void setRebuildListener(RebuildListener* listener) {
+      entries.setRebuildListener(listener);
+    }
+
+  private:
+    using Entry = std::pair<const K, V>;
+    using EntryCompare = MapEntryCompare<K, V, Compare>;
+
+    // The map's entries, in a tree ordered by their keys.
+    ScapegoatTree<Entry, EntryCompare, Allocator, Options> entries;
+
+    /**
+     * Try_emplace subroutine:
+     * Inserts an entry for the given key, with a value constructed from the
+     * given arguments, unless the key is already in the map. The key and
+     * arguments are only moved from if the entry is inserted.
+     */
+    template<typename KeyArg, typename... Args>
+    std::pair<V*, bool> tryEmplace(KeyArg&& key, Args&&... args) {
+      auto inserted = entries.insertNode(key, [&] {
+        return entries.makeNode(std::piecewise_construct,
+                                std::forward_as_tuple(std::forward<KeyArg>(key)),
+                                std::forward_as_tuple(std::forward<Args>(args)...));
+      });
+      return { &inserted.first->key.second, inserted.second };
+    }
+
+    /**
+     * Insert_or_assign subroutine:
+     * Inserts an entry for the given key and value, or assigns the value to
+     * the key's entry if there is one.
+     */
+    template<typename KeyArg, typename M>
+    std::pair<V*, bool> insertOrAssign(KeyArg&& key, M&& value) {
+      std::pair<V*, bool> result = tryEmplace(std::forward<KeyArg>(key), std::forward<M>(value));
+      if (! result.second) *result.first = std::forward<M>(value);
+      return result;
+    }
+};
+
+#endif // SCAPEGOAT_MAP_H
@@ -7,214 +7,926 @@
 
 #include "ScapegoatTree.h"
 
+#include <algorithm>  // for std::min, std::max, std::sort, std::unique, std::adjacent_find, std::set_union, std::any_of, std::binary_search
+#include <chrono>     // for std::chrono::steady_clock
+#include <cstdint>    // for SIZE_MAX
+#include <functional> // for std::greater_equal
+#include <iterator>   // for std::back_inserter
 #include <stdexcept>  // for std::invalid_argument
 #include <iostream>   // for std::cout, flush
 #include <iomanip>    // for std::setw
+#include <utility>    // for std::swap
 
 
-ScapegoatTree::ScapegoatTree(double alpha) {
+/**
+ * Hints that the memory at the given address is about to be read, where the
+ * compiler offers a way to say so.
+ */
+static inline void prefetch(const void* address) {
+#if defined(__GNUC__)
+  __builtin_prefetch(address);
+#else
+  (void) address;
+#endif
+}
+
+/**
+ * Given the index a descent of an Eytzinger array ended at, returns the index
+ * of the last node it went left from, or 0 if it only went right: the index 
+ * with the right turns taken since (trailing ones) and that left turn undone.
+ */
+static inline size_t lastLeftTurn(size_t index) {
+#if defined(__GNUC__)
+  return index >> __builtin_ffsll(~static_cast<long long>(index));
+#else
+  while (index & 1) index >>= 1;
+  return index >> 1;
+#endif
+}
+
+ScapegoatTree::ScapegoatTree(double alpha, RebuildStrategy strategy) {
   // Tree's alpha value must be larger than 0.5 and smaller than 1.
   if (alpha <= kMinAlpha || alpha >= kMaxAlpha) {
     throw std::invalid_argument("Alpha not in range (0.5, 1)!");
   }
   this->alpha = alpha;
+  alphaDeepHeights = AlphaDeepHeightTable(alpha);
+  rebuildStrategy = strategy;
 }
 
 ScapegoatTree::~ScapegoatTree() {
-  // Algorithm to deallocate iteratively in O(1) space thanks to Leo Shamis.
-  while (root) {
-    if (! root->left) {
-      // Case 1: The root has no left child; delete and replace it with right child.
-      Node* next = root->right;
-      delete root;
-      root = next;
-    } else {
-      // Case 2: Rotate the root's left child into the root's place.
-      Node* leftChild = root->left;
-      root->left = leftChild->right;
-      leftChild->right = root;
-      root = leftChild;
-    }
+  // Nodes hold nothing but ints and child references, so there is nothing to
+  // destroy node by node: the pool's destructor frees every chunk at once.
+}
+
+void ScapegoatTree::clear() {
+  // Rebuilds in progress are over, though not done.
+  while (! incremental.rebuilds.empty()) {
+    dropRebuild(incremental.rebuilds.size() - 1);
   }
+
+  // Nodes need no destructors, so dropping the pool's chunks frees them all.
+  pool.clear();
+  root = nullptr;
+  size = maxSize = 0;
+  syncEytzinger();
+
+  // Any shadow subtree and old subtree still to be freed went with the pool.
+  incremental = IncrementalRebuilds();
+}
+
+void ScapegoatTree::sortUniqueKeys(std::vector<int>& keys) {
+  if (std::adjacent_find(keys.begin(), keys.end(), std::greater_equal<int>()) 
+      != keys.end()) {
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  }
+}
+
+void ScapegoatTree::assignKeys(std::vector<int> keys) {
+  // Only keys that are strictly increasing can be built into a tree as is.
+  sortUniqueKeys(keys);
+
+  clear();
+  if (keys.empty()) return;
+
+  if (rebuildStrategy == RebuildStrategy::kRelayout) {
+    root = layoutKeys(keys);
+  } else {
+    // Build the tree straight from the keys, in nodes laid out in order.
+    KeyNodeMaker nodes(*this, keys.data(), pool.allocateRun(keys.size()));
+    root = buildTree(keys.size(), nodes);
+  }
+
+  size = maxSize = keys.size();
+  alphaDeepHeights.cover(maxSize + 1);
+  syncEytzinger();
 }
 
 bool ScapegoatTree::search(int key) const {
-  Node* curr = root;
+  if (eytzingerCurrent) return searchEytzinger(key);
+
+  // Reading the node once and picking a child in a single expression lets
+  // the compiler select the child without branching, which it otherwise
+  // fails to do for compact nodes.
+  NodeRef curr = root;
   while (curr) {
-    if      (key == curr->key)   return true;
-    else if (key <  curr->key)   curr = curr->left;
-    else /*  key >  curr->key */ curr = curr->right;
+    const Node& node = at(curr);
+    if (key == node.key) return true;
+    curr = key < node.key ? node.left : node.right;
   }
   return false;
 }
 
+void ScapegoatTree::searchBatch(const int* keys, size_t n, bool* out) const {
+  for (size_t first = 0; first < n; first += kSearchGroupSize) {
+    size_t count = std::min(kSearchGroupSize, n - first);
+    if (eytzingerCurrent) {
+      searchGroupEytzinger(keys + first, count, out + first);
+    } else {
+      searchGroup(keys + first, count, out + first);
+    }
+  }
+}
+
+void ScapegoatTree::searchGroup(const int* keys, size_t count, bool* out) const {
+  // The next node of each lookup, or nullptr once it is over.
+  NodeRef nodes[kSearchGroupSize];
+  for (size_t i = 0; i < count; i++) {
+    nodes[i] = root;
+    out[i] = false;
+  }
+
+  // Take one step of every ongoing lookup per round, prefetching the nodes
+  // the next round reads.
+  size_t ongoing = count;
+  while (ongoing > 0) {
+    ongoing = 0;
+    for (size_t i = 0; i < count; i++) {
+      NodeRef curr = nodes[i];
+      if (! curr) continue;
+
+      if (keys[i] == at(curr).key) {
+        out[i] = true;
+        nodes[i] = nullptr;
+        continue;
+      }
+      curr = keys[i] < at(curr).key ? at(curr).left : at(curr).right;
+      nodes[i] = curr;
+      if (curr) {
+        prefetch(&at(curr));
+        ongoing++;
+      }
+    }
+  }
+}
+
+void ScapegoatTree::searchGroupEytzinger(const int* keys, size_t count, bool* out) const {
+  // The next index of each lookup, as in searchEytzinger. Every descent 
+  // takes floor(log_2(size)) or one more steps, so lookups stay in lockstep.
+  size_t indices[kSearchGroupSize];
+  for (size_t i = 0; i < count; i++) {
+    indices[i] = 1;
+  }
+
+  bool ongoing = size > 0;
+  while (ongoing) {
+    ongoing = false;
+    for (size_t i = 0; i < count; i++) {
+      size_t index = indices[i];
+      if (index > size) continue;
+
+      index = 2 * index + (keys[i] > eytzingerKey(index));
+      indices[i] = index;
+      if (index <= size) {
+        prefetch(&eytzinger[index / kKeysPerLine]);
+        ongoing = true;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    size_t index = lastLeftTurn(indices[i]);
+    out[i] = index != 0 && eytzingerKey(index) == keys[i];
+  }
+}
+
+void ScapegoatTree::setEytzingerSearch(bool enabled) {
+  eytzingerSearch = enabled;
+  if (enabled) {
+    syncEytzinger();
+  } else {
+    eytzingerCurrent = false;
+    std::vector<EytzingerLine>().swap(eytzinger);  // Free the array's memory
+  }
+}
+
+#ifdef SCAPEGOAT_TRACK_SUBTREE_SIZES
+void ScapegoatTree::setRebuildBudget(size_t unitsPerOperation) {
+  if (unitsPerOperation == 1) {
+    throw std::invalid_argument("Rebuild budget must be 0 or at least 2!");
+  }
+  if (unitsPerOperation == 0) finishRebuild();
+  rebuildBudget = unitsPerOperation;
+}
+#endif
+
+bool ScapegoatTree::rebuildInProgress() const {
+  return ! incremental.rebuilds.empty() || ! incremental.garbage.empty()
+      || ! incremental.deepKeys.empty();
+}
+
+void ScapegoatTree::finishRebuild() {
+  while (rebuildInProgress()) {
+    advanceRebuild(SIZE_MAX);
+  }
+}
+
+bool ScapegoatTree::searchEytzinger(int key) const {
+  // Descend from the root at index 1 to index 2k or 2k + 1 by arithmetic on
+  // the comparison's result rather than a branch, fetching the cache line of 
+  // the descendants four levels down ahead of time.
+  size_t index = 1;
+  while (index <= size) {
+    if (index < eytzinger.size()) prefetch(&eytzinger[index]);
+    index = 2 * index + (key > eytzingerKey(index));
+  }
+
+  // The descent last turned left at the smallest key >= the given key.
+  index = lastLeftTurn(index);
+  return index != 0 && eytzingerKey(index) == key;
+}
+
+void ScapegoatTree::syncEytzinger() {
+  eytzingerCurrent = eytzingerSearch;
+  if (! eytzingerSearch) return;
+
+  eytzinger.assign(size / kKeysPerLine + 1, EytzingerLine{});
+  if (size == 0) return;
+
+  // Visit the array's indices in order, as in an in-order walk of the
+  // implicit tree, while walking the tree's nodes in order, starting from 
+  // the leftmost index.
+  Flattener nodes(*this, root, getMaxPathLength());
+  size_t index = 1;
+  while (2 * index <= size) index *= 2;
+  for (size_t i = 0; i < size; i++) {
+    eytzinger[index / kKeysPerLine].keys[index % kKeysPerLine] = at(nodes.next()).key;
+
+    if (2 * index + 1 <= size) {
+      // Next comes the leftmost index of the right subtree...
+      index = 2 * index + 1;
+      while (2 * index <= size) index *= 2;
+    } else {
+      // ...or else the nearest ancestor reached from its left subtree.
+      while (index & 1) index >>= 1;
+      index >>= 1;
+    }
+  }
+}
+
+ScapegoatTree::const_iterator ScapegoatTree::begin() const {
+  const_iterator it(this, getMaxPathLength());
+  it.pushSpine(root, true);
+  return it;
+}
+
+ScapegoatTree::const_iterator ScapegoatTree::end() const {
+  return const_iterator(this, 0);
+}
+
+ScapegoatTree::const_reverse_iterator ScapegoatTree::rbegin() const {
+  // The path to the largest key is sized for, unlike end()'s.
+  return const_reverse_iterator(const_iterator(this, getMaxPathLength()));
+}
+
+ScapegoatTree::const_reverse_iterator ScapegoatTree::rend() const {
+  const_reverse_iterator it;
+  it.current = end();
+  return it;
+}
+
+ScapegoatTree::const_iterator ScapegoatTree::lower_bound(int key) const {
+  return findBound(key, true);
+}
+
+ScapegoatTree::const_iterator ScapegoatTree::upper_bound(int key) const {
+  return findBound(key, false);
+}
+
+std::pair<ScapegoatTree::const_iterator, ScapegoatTree::const_iterator> 
+ScapegoatTree::equal_range(int key) const {
+  // Keys are unique, so the range holds at most the lower bound.
+  const_iterator first = lower_bound(key);
+  const_iterator last = first;
+  if (last != end() && *last == key) ++last;
+  return { first, last };
+}
+
+ScapegoatTree::const_iterator ScapegoatTree::findBound(int key, bool inclusive) const {
+  // Descend towards the key, remembering how deep the last node found to 
+  // hold a large enough key is: the path to it is a prefix of the descent.
+  const_iterator it(this, getMaxPathLength());
+  size_t boundDepth = 0;
+  NodeRef curr = root;
+  while (curr) {
+    it.path.push(curr);
+    if (key < at(curr).key || (inclusive && key == at(curr).key)) {
+      boundDepth = it.path.size();
+      if (key == at(curr).key) break;
+      curr = at(curr).left;
+    } else {
+      curr = at(curr).right;
+    }
+  }
+
+  while (it.path.size() > boundDepth) {
+    it.path.pop();
+  }
+  return it;
+}
+
+void ScapegoatTree::const_iterator::pushSpine(NodeRef node, bool toLeft) {
+  while (node) {
+    path.push(node);
+    node = toLeft ? tree->at(node).left : tree->at(node).right;
+  }
+}
+
+ScapegoatTree::const_iterator& ScapegoatTree::const_iterator::operator++() {
+  // The next key is the smallest one in the right subtree if there is one,
+  // and otherwise in the nearest ancestor of which this node is a left descendant.
+  NodeRef node = path.top();
+  if (tree->at(node).right) {
+    pushSpine(tree->at(node).right, true);
+    return *this;
+  }
+
+  path.pop();
+  while (! path.empty() && tree->at(path.top()).right == node) {
+    node = path.top();
+    path.pop();
+  }
+  return *this;
+}
+
+ScapegoatTree::const_iterator& ScapegoatTree::const_iterator::operator--() {
+  // Past the largest key, the previous key is the largest one in the tree.
+  if (path.empty()) {
+    pushSpine(tree->root, false);
+    return *this;
+  }
+
+  // Otherwise, mirror operator++.
+  NodeRef node = path.top();
+  if (tree->at(node).left) {
+    pushSpine(tree->at(node).left, false);
+    return *this;
+  }
+
+  path.pop();
+  while (! path.empty() && tree->at(path.top()).left == node) {
+    node = path.top();
+    path.pop();
+  }
+  return *this;
+}
+
+ScapegoatTree::const_iterator ScapegoatTree::const_reverse_iterator::base() const {
+  const_iterator next = current;
+  if (next.path.empty()) {
+    next.pushSpine(next.tree->root, true);
+  } else {
+    ++next;
+  }
+  return next;
+}
+
+ScapegoatTree::const_reverse_iterator& ScapegoatTree::const_reverse_iterator::operator--() {
+  // Past the smallest key, the previous key is the smallest one in the tree.
+  if (current.path.empty()) {
+    current.pushSpine(current.tree->root, true);
+  } else {
+    ++current;
+  }
+  return *this;
+}
+
 bool ScapegoatTree::insert(int key) {
-  std::stack<Node *> insertionPath; // Stack of ancestors of the inserted nodes
+  // Stack of ancestors of the inserted nodes, sized to never need the heap.
+  InsertionPath insertionPath(getMaxPathLength());
+  if (! insertLeaf(key, insertionPath)) return false;  // Key already present
+  noteChangedKey(key);
+
+  // If there exist ancestors and the inserted node is deep, find scapegoat and rebuild.
+  // Insertion height equals the number of ancestors of the inserted node.
+  // We subtract 1 from the stack's size since we pushed a dummy node 
+  // (nullptr) onto the insertion path and heights start from 0. 
+  size_t insertionHeight = insertionPath.size() - 1;
+  if (insertionHeight >= 1 && alphaDeepHeights.exceeds(insertionHeight, size)) {
+    Scapegoat scapegoat = findScapegoat(insertionPath);
+    rebuild(scapegoat, RebuildReason::kInsertTooDeep);
+  }
+
+  advanceRebuild(rebuildBudget);
+  return true;
+}
+
+ScapegoatTree::NodeRef ScapegoatTree::insertLeaf(int key, InsertionPath& insertionPath) {
   insertionPath.push(nullptr);      // The "root's parent"
 
   // Find the insertion point and its parent.
-  Node* prev = nullptr;
-  Node* curr = root;
+  NodeRef prev = nullptr;
+  NodeRef curr = root;
   while (curr) {
     insertionPath.push(curr);
     prev = curr;
 
-    if      (key == curr->key)   return false;       // Key already present
-    else if (key <  curr->key)   curr = curr->left;
-    else /*  key >  curr->key */ curr = curr->right;
+    if      (key == at(curr).key)   return nullptr;     // Key already present
+    else if (key <  at(curr).key)   curr = at(curr).left;
+    else /*  key >  at(curr).key */ curr = at(curr).right;
   }
 
   // Make the node to insert.
-  Node* node = new Node;
-  node->key  = key;
-  node->left = node->right = nullptr;
+  NodeRef node = pool.allocate();
+  at(node).key  = key;
+  at(node).left = at(node).right = nullptr;
+
+#ifdef SCAPEGOAT_TRACK_SUBTREE_SIZES
+  // The new node is a leaf, and each of its ancestors gained one descendant.
+  at(node).size = 1;
+  for (size_t i = 1; i < insertionPath.size(); i++) {
+    at(insertionPath[i]).size++;
+  }
+#endif
 
   // Wire the new node into the tree. 
   if (! prev) {
     root = node;
-  } else if (key < prev->key) {
-    prev->left = node;
-  } else /*  key > prev->key */ {
-    prev->right = node;
+  } else if (key < at(prev).key) {
+    at(prev).left = node;
+  } else /*  key > at(prev).key */ {
+    at(prev).right = node;
   }
 
   // Update tree information.
   size++;
-  if (size > maxSize) maxSize = size;
+  eytzingerCurrent = false;
+  if (size > maxSize) {
+    maxSize = size;
+    alphaDeepHeights.cover(maxSize + 1);
+  }
+
+#ifdef SCAPEGOAT_COLLECT_STATS
+  if (! incremental.syncing) {
+    rebuildStats.recordInsertion(insertionPath.size() - 1, getAlphaDeepHeight(size));
+  }
+#endif
+
+  return node;
+}
+
+size_t ScapegoatTree::insertKeys(std::vector<int> keys) {
+  sortUniqueKeys(keys);
+  if (keys.size() * kLargeBatchRatio >= size) {
+    return mergeKeys(keys);
+  }
+
+  // Insert every key as a leaf, remembering the ones that ended up too deep.
+  std::vector<int> deepKeys;
+  size_t oldSize = size;
+  for (int key : keys) {
+    InsertionPath insertionPath(getMaxPathLength());
+    if (! insertLeaf(key, insertionPath)) continue;
+    noteChangedKey(key);
+    advanceRebuild(rebuildBudget);
+
+    size_t insertionHeight = insertionPath.size() - 1;
+    if (insertionHeight >= 1 && alphaDeepHeights.exceeds(insertionHeight, size)) {
+      deepKeys.push_back(key);
+    }
+  }
+
+  rebuildDeepNodes(deepKeys);
+  return size - oldSize;
+}
+
+size_t ScapegoatTree::mergeKeys(const std::vector<int>& keys) {
+#ifdef SCAPEGOAT_COLLECT_STATS
+  auto start = std::chrono::steady_clock::now();
+#endif
+
+  // Copy the tree's keys in order, then merge the new keys in.
+  std::vector<int> treeKeys(size);
+  Flattener nodes(*this, root, getMaxPathLength());
+  for (size_t i = 0; i < size; i++) {
+    treeKeys[i] = at(nodes.next()).key;
+  }
+
+  std::vector<int> mergedKeys;
+  mergedKeys.reserve(treeKeys.size() + keys.size());
+  std::set_union(treeKeys.begin(), treeKeys.end(), keys.begin(), keys.end(),
+                 std::back_inserter(mergedKeys));
+
+  // The new tree supersedes every incremental rebuild in progress, which is
+  // reported as over first.
+  dropRebuildsWithin(nullptr);
+
+#ifdef SCAPEGOAT_REBUILD_EVENTS
+  RebuildEvent event { mergedKeys.size(), 0, true, RebuildReason::kBatchMerge };
+  if (rebuildListener) rebuildListener->beforeRebuild(event);
+#endif
+
+  size_t oldSize = size;
+  assignKeys(std::move(mergedKeys));
+
+#ifdef SCAPEGOAT_COLLECT_STATS
+  // The merge rebuilds the whole tree, batch and all.
+  rebuildStats.recordRebuild(size, true, std::chrono::steady_clock::now() - start);
+#endif
+
+#ifdef SCAPEGOAT_REBUILD_EVENTS
+  if (rebuildListener) rebuildListener->afterRebuild(event);
+#endif
+
+  return size - oldSize;
+}
+
+void ScapegoatTree::rebuildDeepNodes(const std::vector<int>& deepKeys) {
+  // The outermost scapegoats found so far. Keys come in increasing order, 
+  // and so do these disjoint subtrees.
+  std::vector<Scapegoat> subtrees;
+
+  for (int key : deepKeys) {
+    // Find the ancestors of the key's node, unless a scapegoat found for 
+    // a smaller key already holds it.
+    InsertionPath insertionPath(getMaxPathLength());
+    insertionPath.push(nullptr);      // The "root's parent"
+
+    NodeRef lastScapegoat = subtrees.empty() ? nullptr : subtrees.back().scapegoat;
+    bool inLastSubtree = false;
+
+    NodeRef curr = root;
+    while (true) {
+      inLastSubtree = inLastSubtree || curr == lastScapegoat;
+      if (key == at(curr).key) break;
+
+      insertionPath.push(curr);
+      curr = key < at(curr).key ? at(curr).left : at(curr).right;
+    }
+
+    size_t insertionHeight = insertionPath.size() - 1;
+    if (inLastSubtree || ! alphaDeepHeights.exceeds(insertionHeight, size)) {
+      continue;
+    }
 
-  // If there exist ancestors and the inserted node is deep, find scapegoat and rebuild.
-  size_t deepHeight = getAlphaDeepHeight(size);
-  
-  // Insertion height equals the number of ancestors of the inserted node.
-  // We subtract 1 from the stack's size since we pushed a dummy node 
-  // (nullptr) onto the insertion path and heights start from 0. 
-  size_t insertionHeight = insertionPath.size() - 1;
-  if (insertionHeight >= 1 && insertionHeight > deepHeight) {
     Scapegoat scapegoat = findScapegoat(insertionPath);
-    rebuild(scapegoat);
+
+    // The scapegoats nested in this one are the last ones found: drop them.
+    while (! subtrees.empty()) {
+      NodeRef nested = subtrees.back().scapegoat;
+      NodeRef ancestor = scapegoat.scapegoat;
+      while (ancestor && ancestor != nested) {
+        ancestor = at(nested).key < at(ancestor).key ? at(ancestor).left : at(ancestor).right;
+      }
+      if (! ancestor) break;
+      subtrees.pop_back();
+    }
+    subtrees.push_back(scapegoat);
   }
 
-  return true;
+  // Rebuild the scapegoats. A rebuilt subtree is perfectly balanced, 
+  // so its deepest nodes are exactly as deep as its root plus its height.
+  bool balanced = true;
+  for (const Scapegoat& subtree : subtrees) {
+    if (rebuild(subtree, RebuildReason::kInsertTooDeep)) return;
+    size_t height = subtree.depth + getBalancedHeight(subtree.treeSize);
+    balanced = balanced && ! alphaDeepHeights.exceeds(height, size);
+  }
+
+  if (! balanced) {
+    rebuild( { root, nullptr, size, 0 }, RebuildReason::kInsertTooDeep);
+  }
 }
 
 bool ScapegoatTree::remove(int key) {
+  if (! removeKey(key)) return false;
+  noteChangedKey(key);
+
+  // Finally, rebuild the entire tree if necessary. 
+  rebuildIfShrunk();
+  advanceRebuild(rebuildBudget);
+  return true;
+}
+
+size_t ScapegoatTree::removeKeys(const std::vector<int>& keys) {
+  // Remove every key first, so that the whole tree is rebuilt at most once.
+  size_t oldSize = size;
+  for (int key : keys) {
+    if (! removeKey(key)) continue;
+    noteChangedKey(key);
+    advanceRebuild(rebuildBudget);
+  }
+
+  rebuildIfShrunk();
+  return oldSize - size;
+}
+
+bool ScapegoatTree::removeKey(int key) {
   // Find node containing the key to remove and its parent.
-  Node* prev = nullptr;
-  Node* curr = root;
+  NodeRef prev = nullptr;
+  NodeRef curr = root;
   while (true) {
     if (! curr)  return false;   // Deletion failed if the key doesn't exist
     
-    if (key == curr->key) break; // Found the node to delete
+    if (key == at(curr).key) break; // Found the node to delete
 
     prev = curr;
-    if      (key < curr->key) curr = curr->left;
-    else if (key > curr->key) curr = curr->right;
+    if      (key < at(curr).key) curr = at(curr).left;
+    else if (key > at(curr).key) curr = at(curr).right;
   }
 
+#ifdef SCAPEGOAT_TRACK_SUBTREE_SIZES
+  // Every node on the path from the root to the removed key loses a descendant.
+  // (curr itself only survives when its key is replaced by a descendant's.)
+  for (NodeRef ancestor = root; ancestor != curr; 
+       ancestor = key < at(ancestor).key ? at(ancestor).left : at(ancestor).right) {
+    at(ancestor).size--;
+  }
+  at(curr).size--;
+#endif
+
   // Remove the node from the tree and clean up its memory.
-  if (curr->left && curr->right) {
+  bool keyMoved = at(curr).left && at(curr).right;
+  if (keyMoved) {
     removeNodeWithTwoChildren(curr);
   } else {
     removeNodeWithoutChild(curr, prev);
   }
 
-  // Finally, rebuild the entire tree if necessary. 
   size--;
+  eytzingerCurrent = false;
+
+  // The key moved into curr may have left a subtree being rebuilt.
+  if (keyMoved && ! incremental.syncing) noteChangedKey(at(curr).key);
+  return true;
+}
+
+void ScapegoatTree::rebuildIfShrunk() {
   if (size <= alpha * maxSize) {
-    rebuild( { root, nullptr, size } );
+    rebuild( { root, nullptr, size, 0 }, RebuildReason::kRemoveShrunk);
   }
+}
 
-  return true;
+size_t ScapegoatTree::removeRange(int lo, int hi) {
+  // Subtrees are cut out without visiting their keys one at a time, so keep
+  // the keys released, or moved, while rebuilds in progress need to catch 
+  // up on them.
+  std::vector<int> changedKeys;
+  std::vector<int>* releasedKeys = incremental.rebuilds.empty() ? nullptr : &changedKeys;
+
+  // Rebuilds of subtrees whose root is removed are dropped. What is left of
+  // their subtrees ends up in the subtree joined in the range's place, which
+  // is rebuilt instead.
+  bool dropped = false;
+  RebuildReason reason = RebuildReason::kInsertTooDeep;
+  for (size_t i = incremental.rebuilds.size(); i-- > 0; ) {
+    NodeRef subtreeRoot = incremental.rebuilds[i].subtreeRoot;
+    if (subtreeRoot && lo <= at(subtreeRoot).key && at(subtreeRoot).key <= hi) {
+      dropped = true;
+      reason = incremental.rebuilds[i].reason;
+      dropRebuild(i);
+    }
+  }
+
+  // Find the highest node in the range, whose subtree holds every key in it.
+  InsertionPath ancestors(getMaxPathLength());
+  NodeRef split = root;
+  while (split && (at(split).key < lo || at(split).key > hi)) {
+    ancestors.push(split);
+    split = at(split).key < lo ? at(split).right : at(split).left;
+  }
+  if (! split) return 0;
+
+  // Nodes whose subtree sizes must be recomputed, from the deepest one up.
+  InsertionPath resized(getMaxPathLength());
+  size_t removed = 0;
+
+  // Cut the keys >= lo out of split's left subtree: each such node and its
+  // right subtree lie within the range, and its left subtree takes its place.
+  NodeRef* link = &at(split).left;
+  while (NodeRef node = *link) {
+    if (at(node).key < lo) {
+      resized.push(node);
+      link = &at(node).right;
+    } else {
+      *link = at(node).left;
+      removed += releaseSubtree(at(node).right, releasedKeys) + 1;
+      if (releasedKeys) releasedKeys->push_back(at(node).key);
+      pool.deallocate(node);
+    }
+  }
+  updateSizes(resized);
+
+  // Likewise, cut the keys <= hi out of split's right subtree.
+  link = &at(split).right;
+  while (NodeRef node = *link) {
+    if (at(node).key > hi) {
+      resized.push(node);
+      link = &at(node).left;
+    } else {
+      *link = at(node).right;
+      removed += releaseSubtree(at(node).left, releasedKeys) + 1;
+      if (releasedKeys) releasedKeys->push_back(at(node).key);
+      pool.deallocate(node);
+    }
+  }
+  updateSizes(resized);
+
+  // Replace split with the largest key of its left subtree, which has no 
+  // right child, so that the joined subtree is no taller than split's.
+  NodeRef replacement = at(split).right;
+  if (at(split).left) {
+    NodeRef parent = nullptr;
+    replacement = at(split).left;
+    while (at(replacement).right) {
+      parent = replacement;
+      resized.push(parent);
+      replacement = at(replacement).right;
+    }
+
+    // The replacement's key leaves the subtrees it is moved out of, and its
+    // own subtree changes entirely: drop any rebuild of it.
+    if (releasedKeys) releasedKeys->push_back(at(replacement).key);
+    for (size_t i = incremental.rebuilds.size(); i-- > 0; ) {
+      if (incremental.rebuilds[i].subtreeRoot != replacement) continue;
+      dropped = true;
+      reason = incremental.rebuilds[i].reason;
+      dropRebuild(i);
+    }
+
+    if (parent) {
+      at(parent).right = at(replacement).left;
+      updateSizes(resized);
+      at(replacement).left = at(split).left;
+    }
+    at(replacement).right = at(split).right;
+    resized.push(replacement);
+    updateSizes(resized);
+  }
+  if (releasedKeys) releasedKeys->push_back(at(split).key);
+  pool.deallocate(split);
+  removed++;
+
+  // Wire the remaining keys back into the tree.
+  NodeRef parent = ancestors.empty() ? nullptr : ancestors.top();
+  size_t depth = ancestors.size();
+  if (! parent) {
+    root = replacement;
+  } else if (at(parent).left == split) {
+    at(parent).left = replacement;
+  } else /* if (at(parent).right == split) */ {
+    at(parent).right = replacement;
+  }
+  updateSizes(ancestors);
+
+  size -= removed;
+  if (removed > 0) eytzingerCurrent = false;
+
+  if (dropped && replacement) {
+    rebuild( { replacement, parent, getSubtreeSize(replacement), depth }, reason);
+  }
+
+  // Note every changed key before advancing, so that no rebuild can be 
+  // done without them.
+  for (int key : changedKeys) noteChangedKey(key);
+  for (size_t i = 0; i < changedKeys.size(); i++) advanceRebuild(rebuildBudget);
+
+  rebuildIfShrunk();
+  return removed;
 }
 
-void ScapegoatTree::removeNodeWithTwoChildren(Node *node) {
+size_t ScapegoatTree::releaseSubtree(NodeRef node, std::vector<int>* releasedKeys) {
+  // Rotate left children up until the subtree is a right-leaning vine, 
+  // releasing each node as it reaches the top without a left child.
+  size_t released = 0;
+  while (node) {
+    if (! at(node).left) {
+      NodeRef next = at(node).right;
+      if (releasedKeys) releasedKeys->push_back(at(node).key);
+      pool.deallocate(node);
+      node = next;
+      released++;
+    } else {
+      NodeRef leftChild = at(node).left;
+      at(node).left = at(leftChild).right;
+      at(leftChild).right = node;
+      node = leftChild;
+    }
+  }
+  return released;
+}
+
+void ScapegoatTree::updateSizes(InsertionPath& nodes) {
+  while (! nodes.empty()) {
+#ifdef SCAPEGOAT_TRACK_SUBTREE_SIZES
+    NodeRef node = nodes.top();
+    at(node).size = 1 + getSubtreeSize(at(node).left) + getSubtreeSize(at(node).right);
+#endif
+    nodes.pop();
+  }
+}
+
+void ScapegoatTree::removeNodeWithTwoChildren(NodeRef node) {
   // Find the in-order successor/predecessor to node, splice it out of the tree
   // and clean up its memory, and swap its key with node's key, essentially 
   // deleting node's original key from the tree. 
 
-  Node *curr;
-  Node *prev = node;
+  NodeRef curr;
+  NodeRef prev = node;
   
   if (replaceWithSucc) {
     // Find the in-order successor of node:
     // the node with minimum key in its right subtree.
-    curr = node->right;
+    curr = at(node).right;
+
+#ifdef SCAPEGOAT_TRACK_SUBTREE_SIZES
+    // Every node on the path down to the successor loses a descendant.
+    for (NodeRef ancestor = curr; at(ancestor).left; ancestor = at(ancestor).left) {
+      at(ancestor).size--;
+    }
+#endif
 
-    if (! curr->left) {
+    if (! at(curr).left) {
       // node's right child has no left child, so it is the successor.
-      node->right = curr->right;
+      at(node).right = at(curr).right;
     }
     else {
       // Otherwise, descend the left spine of node's right subtree.
-      while (curr->left) {
+      while (at(curr).left) {
         prev = curr;
-        curr = curr->left;
+        curr = at(curr).left;
       }
 
       // Splice the successor out of the tree (it has at most a right child.)
-      prev->left = curr->right;
+      at(prev).left = at(curr).right;
     }
   } else {
     // Find the in-order predecessor of node:
     // the node with maximum key in its left subtree.
-    curr = node->left;
+    curr = at(node).left;
+
+#ifdef SCAPEGOAT_TRACK_SUBTREE_SIZES
+    // Every node on the path down to the predecessor loses a descendant.
+    for (NodeRef ancestor = curr; at(ancestor).right; ancestor = at(ancestor).right) {
+      at(ancestor).size--;
+    }
+#endif
 
-    if (! curr->right) {
+    if (! at(curr).right) {
       // node's left child has no right child, so it is the predecessor.
-      node->left = curr->left;
+      at(node).left = at(curr).left;
     }
     else {
       // Otherwise, descend the right spine of node's left subtree.
-      while (curr->right) {
+      while (at(curr).right) {
         prev = curr;
-        curr = curr->right;
+        curr = at(curr).right;
       }
 
       // Splice the predecessor out of the tree (it has at most a left child.)
-      prev->right = curr->left;
+      at(prev).right = at(curr).left;
     }
   }
 
   // Swapping the successor/predecessor's key with the key to be removed
   // maintains the BST ordering. 
-  node->key = curr->key;
-  delete curr;
+  at(node).key = at(curr).key;
+  spliceRebuildRoot(curr, replaceWithSucc ? at(curr).right : at(curr).left);
+  pool.deallocate(curr);
 
   replaceWithSucc = !replaceWithSucc;
 }
 
-void ScapegoatTree::removeNodeWithoutChild(Node *node, Node *parent) {
+void ScapegoatTree::removeNodeWithoutChild(NodeRef node, NodeRef parent) {
   // Wire the node being deleted out of the tree:
   // Point the appropriate child pointer of the parent 
   // to a subtree of the node being deleted.
 
-  Node *child = node->left ? node->left : node->right;
+  NodeRef child = at(node).left ? at(node).left : at(node).right;
 
   if (root == node) { // node is the root: replace the root
     root = child;
-  } else if (parent->left == node) { // node is a left child
-    parent->left = child;
-  } else /* if (parent->right == node) */ { // node is a right child
-    parent->right = child;
+  } else if (at(parent).left == node) { // node is a left child
+    at(parent).left = child;
+  } else /* if (at(parent).right == node) */ { // node is a right child
+    at(parent).right = child;
   }
 
+  // A rebuild of the node's subtree carries on with its child's.
+  spliceRebuildRoot(node, child);
+
   // Free memory of the original node.
-  delete node;
+  pool.deallocate(node);
 }
 
-/* Recursively generates the size of the subtree rooted at node. */
-size_t ScapegoatTree::getSubtreeSize(Node *node) {
+/* Reads or recursively generates the size of the subtree rooted at node. */
+size_t ScapegoatTree::getSubtreeSize(NodeRef node) {
   if (! node) {
     return 0;
   } 
-  return 1 + getSubtreeSize(node->left) + getSubtreeSize(node->right);
+#ifdef SCAPEGOAT_TRACK_SUBTREE_SIZES
+  return at(node).size;
+#else
+  return 1 + getSubtreeSize(at(node).left) + getSubtreeSize(at(node).right);
+#endif
 }
 
-ScapegoatTree::Scapegoat ScapegoatTree::findScapegoat(std::stack<Node *>& insertionPath) {
+ScapegoatTree::Scapegoat ScapegoatTree::findScapegoat(InsertionPath& insertionPath) {
   // Retrieve parent (curr) and grandparent (parent) of inserted node.
-  Node *curr = insertionPath.top();
+  NodeRef curr = insertionPath.top();
   insertionPath.pop();
-  Node *parent = insertionPath.top();
+  NodeRef parent = insertionPath.top();
   insertionPath.pop();
 
   // Track current subtree size and index 
@@ -225,15 +937,15 @@ ScapegoatTree::Scapegoat ScapegoatTree::findScapegoat(std::stack<Node *>& insert
   while (parent) {
     // Found scapegoat if we exhausted the stack, 
     // or if index is greater than alpha-deep height.
-    if (currIndex > getAlphaDeepHeight(currSize)) {
+    if (alphaDeepHeights.exceeds(currIndex, currSize)) {
       break;
     }
 
     // Update the size without revisiting any nodes already visited.
-    if (parent->left == curr) {
-      currSize += 1 + getSubtreeSize(parent->right);
+    if (at(parent).left == curr) {
+      currSize += 1 + getSubtreeSize(at(parent).right);
     } else {
-      currSize += 1 + getSubtreeSize(parent->left);
+      currSize += 1 + getSubtreeSize(at(parent).left);
     }
 
     // Get the next ancestor from the stack.
@@ -244,91 +956,672 @@ ScapegoatTree::Scapegoat ScapegoatTree::findScapegoat(std::stack<Node *>& insert
     currIndex++;
   }
 
-  return { curr, parent, currSize };
+#ifdef SCAPEGOAT_COLLECT_STATS
+  // Stored sizes were read once per level. Otherwise, every node counted 
+  // was visited, except for the ancestors added one at a time.
+  if (! incremental.syncing) {
+#ifdef SCAPEGOAT_TRACK_SUBTREE_SIZES
+    rebuildStats.scapegoatSearchNodes += currIndex;
+#else
+    rebuildStats.scapegoatSearchNodes += currSize - (currIndex - 1);
+#endif
+  }
+#endif
+
+  // Only the scapegoat's ancestors and the root's parent are left on the
+  // path, as many as the scapegoat's depth.
+  return { curr, parent, currSize, insertionPath.size() };
+}
+
+ScapegoatTree::NodeRef ScapegoatTree::Flattener::next() {
+  // The next node in order is the leftmost node of the unvisited subtree if 
+  // there is one, and otherwise the deepest ancestor waiting on the stack.
+  while (rest) {
+    ancestors.push(rest);
+    rest = tree.at(rest).left;
+  }
+  NodeRef node = ancestors.top();
+  ancestors.pop();
+
+  // Read the node's right child before the caller rewires it.
+  rest = tree.at(node).right;
+  return node;
 }
 
-ScapegoatTree::Node *ScapegoatTree::flatten(Node *treeRoot, Node *listHead) {
-  // If there's nothing to prepend, the list stays the same.
-  if (! treeRoot) return listHead;
+template<typename NodeSource>
+ScapegoatTree::NodeRef ScapegoatTree::buildTree(size_t treeSize, NodeSource &nodes) {
+  // Stack of the subtrees being built, standing in for the recursion of 
+  // BUILD-TREE: each subtree builds its left half of treeSize / 2 nodes, takes 
+  // the next node in order as its root, then builds its right half of 
+  // (treeSize - 1) / 2 nodes. Sizes halve at each level, so the stack never 
+  // holds more frames than there are bits in a size_t.
+  BuildFrame frames[kMaxBuildDepth];
+  size_t depth = 0;
+
+  NodeRef built;  // The root of the most recently built subtree
+  size_t pending = treeSize;
+
+  while (true) {
+    // Descend the left spine of a subtree of pending nodes.
+    while (pending > 0) {
+      frames[depth++] = { pending, nullptr };
+      pending /= 2;
+    }
+    built = nullptr;
+
+    // Finish every subtree whose right half was just built.
+    while (depth > 0 && frames[depth - 1].root) {
+      BuildFrame &frame = frames[--depth];
+      at(frame.root).right = built;
+#ifdef SCAPEGOAT_TRACK_SUBTREE_SIZES
+      at(frame.root).size = frame.treeSize;
+#endif
+      built = frame.root;
+    }
+    if (depth == 0) return built;
 
-  // Otherwise, prepend the right subtree, then the root, then its left subtree.
-  treeRoot->right = flatten(treeRoot->right, listHead);
-  return flatten(treeRoot->left, treeRoot);
+    // The left half of the innermost subtree was just built: 
+    // give it a root, then build its right half.
+    BuildFrame &frame = frames[depth - 1];
+    frame.root = nodes.next();
+    at(frame.root).left = built;
+    pending = (frame.treeSize - 1) / 2;
+  }
 }
 
-ScapegoatTree::Node *ScapegoatTree::buildTree(size_t treeSize, Node *listHead) {
-  // No tree to build: resulting tree is nullptr, return rewired 1st element of list.
-  if (treeSize == 0) {
-    listHead->left = nullptr;
-    return listHead;
+ScapegoatTree::NodeRef ScapegoatTree::relayout(NodeRef treeRoot, size_t treeSize) {
+  // Nodes of trees replaced by incremental rebuilds may still be in the pool.
+  bool wholeTree = treeRoot == root && incremental.garbage.empty();
+
+  // Copy the keys in order, releasing each node once its children are read.
+  std::vector<int> keys(treeSize);
+  Flattener nodes(*this, treeRoot, getMaxPathLength());
+  for (size_t i = 0; i < treeSize; i++) {
+    NodeRef node = nodes.next();
+    keys[i] = at(node).key;
+    if (! wholeTree) pool.deallocate(node);
   }
-  // Otherwise, recursively build the tree:
 
-  double halfTreeSize = (treeSize - 1.0) / 2.0;
+  // Once the whole tree is copied no node is alive, so the pool may start 
+  // over, and the new layout ends up in a single chunk. 
+  if (wholeTree) pool.clear();
 
-  // Node whose left child is a balanced tree equivalent of the first half of the list
-  // and right child is the unaltered second half of the list.
-  Node *firstHalf = buildTree(static_cast<size_t>(ceil(halfTreeSize)), listHead);
+  return layoutKeys(keys);
+}
 
-  // (n+1)th node in the original list, whose left child is the balanced tree 
-  // equivalent of the second half of the list.
-  Node *secondHalf = buildTree(static_cast<size_t>(floor(halfTreeSize)), firstHalf->right);
+ScapegoatTree::NodeRef ScapegoatTree::layoutKeys(const std::vector<int>& keys) {
+  size_t treeSize = keys.size();
 
-  // Rewire so that firstHalf is now the tree formed of n elements from the list.
-  firstHalf->right = secondHalf->left;
-  
-  // Return a node whose left child is the equivalent tree, as specified.
-  secondHalf->left = firstHalf;
-  return secondHalf;
+  // The range of keys each new node's subtree holds: the root holds them all.
+  struct KeyRange {
+    size_t first;
+    size_t count;
+  };
+  std::vector<KeyRange> ranges(treeSize);
+  ranges[0] = { 0, treeSize };
+
+  // Fill in the nodes in breadth-first order, which is also the order in 
+  // which their ranges are handed out: a subtree of n keys has n / 2 keys 
+  // on the left and (n - 1) / 2 keys on the right, just as in buildTree.
+  NodeRef layout = pool.allocateRun(treeSize);
+  size_t nextIndex = 1;
+  for (size_t i = 0; i < treeSize; i++) {
+    KeyRange range = ranges[i];
+    size_t leftCount = range.count / 2;
+    size_t rightCount = (range.count - 1) / 2;
+
+    NodeRef node = layout + i;
+    at(node).key = keys[range.first + leftCount];
+    at(node).left = at(node).right = nullptr;
+#ifdef SCAPEGOAT_TRACK_SUBTREE_SIZES
+    at(node).size = range.count;
+#endif
+
+    if (leftCount > 0) {
+      ranges[nextIndex] = { range.first, leftCount };
+      at(node).left = layout + nextIndex++;
+    }
+    if (rightCount > 0) {
+      ranges[nextIndex] = { range.first + leftCount + 1, rightCount };
+      at(node).right = layout + nextIndex++;
+    }
+  }
+
+  return layout;
 }
 
-void ScapegoatTree::rebuild(Scapegoat scapegoat) {
-  // Dummy node will become the end of our linked list.
-  Node dummy = { -1, nullptr, nullptr };
+bool ScapegoatTree::rebuild(Scapegoat scapegoat, RebuildReason reason) {
+  // Relaying out a subtree releases its old nodes, which only single 
+  // insertions reuse. Once released nodes outnumber the tree's keys, relay
+  // out the whole tree instead, which starts the pool over. If the pool 
+  // cannot start over right away, relink the subtree, releasing nothing.
+  bool relayoutNodes = rebuildStrategy == RebuildStrategy::kRelayout && scapegoat.treeSize > 0;
+  if (relayoutNodes && scapegoat.parent && pool.freeNodes() > size) {
+    bool canStartOver = ! rebuildInProgress() && (rebuildBudget == 0 || size <= rebuildBudget);
+    if (canStartOver) {
+      scapegoat = { root, nullptr, size, 0 };
+    } else {
+      relayoutNodes = false;
+    }
+  }
+
+  // A subtree too large to rebuild within a single operation's budget is 
+  // rebuilt incrementally instead.
+  if (rebuildBudget > 0 && scapegoat.treeSize > rebuildBudget) {
+    startRebuild(scapegoat, reason);
+    return false;
+  }
+
+  // Rebuilding the subtree at once supersedes the rebuilds within it.
+  if (! incremental.syncing) dropRebuildsWithin(scapegoat.parent ? scapegoat.scapegoat : nullptr);
+
+  // Rebuilds of a shadow tree are part of the incremental rebuild, which 
+  // counts and reports itself as a whole.
+#ifdef SCAPEGOAT_REBUILD_EVENTS
+  RebuildEvent event { scapegoat.treeSize, scapegoat.depth, ! scapegoat.parent, reason };
+  if (rebuildListener && ! incremental.syncing) rebuildListener->beforeRebuild(event);
+#else
+  (void) reason;
+#endif
 
-  // Flatten the tree into a linked list.
-  Node *nodeList = flatten(scapegoat.scapegoat, &dummy);
+#ifdef SCAPEGOAT_COLLECT_STATS
+  auto start = std::chrono::steady_clock::now();
+#endif
 
-  // Rebuild the linked list into a tree.
-  buildTree(scapegoat.treeSize, nodeList);
+  NodeRef subtreeRoot;
+  if (relayoutNodes) {
+    subtreeRoot = relayout(scapegoat.scapegoat, scapegoat.treeSize);
+  } else {
+    // Stream the subtree's nodes in order straight into a new, balanced shape.
+    Flattener nodes(*this, scapegoat.scapegoat, getMaxPathLength());
+    subtreeRoot = buildTree(scapegoat.treeSize, nodes);
+  }
 
-  // Now, dummy's left child is the root of the new rebuilt subtree,
-  // so we may wire the rebuilt subtree back into the tree.
+  // Wire the rebuilt subtree back into the tree.
   if (! scapegoat.parent) {
-    root = dummy.left;
+    root = subtreeRoot;
+    maxSize = size;
+    syncEytzinger();
+  } else if (scapegoat.scapegoat == at(scapegoat.parent).left) {
+    at(scapegoat.parent).left = subtreeRoot;
+  } else /* if (scapegoat.scapegoat == at(scapegoat.parent).right) */ {
+    at(scapegoat.parent).right = subtreeRoot;
+  }
+
+#ifdef SCAPEGOAT_COLLECT_STATS
+  if (! incremental.syncing) {
+    rebuildStats.recordRebuild(scapegoat.treeSize, ! scapegoat.parent, 
+                               std::chrono::steady_clock::now() - start);
+  }
+#endif
+
+#ifdef SCAPEGOAT_REBUILD_EVENTS
+  if (rebuildListener && ! incremental.syncing) rebuildListener->afterRebuild(event);
+#endif
+
+  return ! scapegoat.parent;
+}
+
+void ScapegoatTree::startRebuild(const Scapegoat& scapegoat, RebuildReason reason) {
+  NodeRef subtreeRoot = scapegoat.parent ? scapegoat.scapegoat : nullptr;
+  std::vector<IncrementalRebuild>& rebuilds = incremental.rebuilds;
+
+  for (const IncrementalRebuild& other : rebuilds) {
+    if (other.subtreeRoot == subtreeRoot) return;  // Rebuilt already
+  }
+
+  // The new rebuild supersedes those within its subtree, whose work would
+  // be thrown away once it is done anyway. So a rebuild only ever comes 
+  // after those of subtrees holding its own.
+  dropRebuildsWithin(subtreeRoot);
+
+#ifdef SCAPEGOAT_REBUILD_EVENTS
+  if (rebuildListener) {
+    rebuildListener->beforeRebuild( { scapegoat.treeSize, scapegoat.depth, ! subtreeRoot, reason } );
+  }
+#endif
+
+  IncrementalRebuild started;
+  started.subtreeRoot = subtreeRoot;
+  started.reason = reason;
+  started.treeSize = scapegoat.treeSize;
+  started.depth = scapegoat.depth;
+
+  // Growing the copy of the keys would move every key copied so far at once.
+  started.keys.reserve(scapegoat.treeSize);
+  rebuilds.push_back(std::move(started));
+}
+
+void ScapegoatTree::dropRebuildsWithin(NodeRef subtreeRoot) {
+  if (incremental.rebuilds.empty()) return;
+
+  KeyBounds bounds = boundsOf(subtreeRoot);
+  for (size_t i = incremental.rebuilds.size(); i-- > 0; ) {
+    NodeRef within = incremental.rebuilds[i].subtreeRoot;
+    if (! subtreeRoot || (within && bounds.holds(at(within).key))) dropRebuild(i);
+  }
+}
+
+void ScapegoatTree::dropRebuild(size_t index) {
+  IncrementalRebuild& dropped = incremental.rebuilds[index];
+  if (dropped.shadowRoot) incremental.garbage.push_back(dropped.shadowRoot);
+
+#ifdef SCAPEGOAT_REBUILD_EVENTS
+  if (rebuildListener) {
+    rebuildListener->afterRebuild( { dropped.treeSize, dropped.depth, ! dropped.subtreeRoot, dropped.reason } );
+  }
+#endif
+
+  incremental.rebuilds.erase(incremental.rebuilds.begin() + index);
+}
+
+void ScapegoatTree::spliceRebuildRoot(NodeRef node, NodeRef child) {
+  if (incremental.syncing) return;
+
+  // Rebuilds are of distinct subtrees, so the child's subtree may already
+  // be rebuilt on its own.
+  std::vector<IncrementalRebuild>& rebuilds = incremental.rebuilds;
+  for (size_t i = rebuilds.size(); i-- > 0; ) {
+    if (rebuilds[i].subtreeRoot != node) continue;
+
+    bool childRebuilt = std::any_of(rebuilds.begin(), rebuilds.end(), 
+        [child](const IncrementalRebuild& other) { return other.subtreeRoot == child; });
+    if (child && ! childRebuilt) {
+      rebuilds[i].subtreeRoot = child;
+    } else {
+      dropRebuild(i);
+    }
+  }
+}
+
+ScapegoatTree::KeyBounds ScapegoatTree::boundsOf(NodeRef subtreeRoot) const {
+  KeyBounds bounds;
+  if (! subtreeRoot) return bounds;
+
+  int key = at(subtreeRoot).key;
+  for (NodeRef node = root; node != subtreeRoot; ) {
+    if (key < at(node).key) {
+      bounds.hasHi = true;
+      bounds.hi = at(node).key;
+      node = at(node).left;
+    } else {
+      bounds.hasLo = true;
+      bounds.lo = at(node).key;
+      node = at(node).right;
+    }
+  }
+  return bounds;
+}
+
+bool ScapegoatTree::subtreeHolds(NodeRef subtreeRoot, int key) const {
+  bool within = ! subtreeRoot;
+  for (NodeRef curr = root; curr; curr = key < at(curr).key ? at(curr).left : at(curr).right) {
+    within = within || curr == subtreeRoot;
+    if (key == at(curr).key) return within;
+  }
+  return false;
+}
+
+void ScapegoatTree::advanceRebuild(size_t budget) {
+  if (! rebuildInProgress()) return;
+
+  // Check the keys left too deep by shadow subtrees put in place, a unit 
+  // each. Rebuilds of their scapegoats count their own time.
+  std::vector<int>& deepKeys = incremental.deepKeys;
+  for (; budget > 0 && ! deepKeys.empty(); budget--) {
+    int key = deepKeys.back();
+    deepKeys.pop_back();
+    rebuildIfDeep(key);
+  }
+
+#ifdef SCAPEGOAT_COLLECT_STATS
+  auto start = std::chrono::steady_clock::now();
+#endif
+
+  // Free the nodes of replaced subtrees from the top down, each node's 
+  // children taking its place on the stack.
+  std::vector<NodeRef>& garbage = incremental.garbage;
+  for (; budget > 0 && ! garbage.empty(); budget--) {
+    NodeRef node = garbage.back();
+    garbage.pop_back();
+    if (at(node).left) garbage.push_back(at(node).left);
+    if (at(node).right) garbage.push_back(at(node).right);
+    pool.deallocate(node);
+  }
+
+  // Half of the rest goes to the last rebuild, which holds no other one, so
+  // that nested rebuilds keep the subtrees around them in shape. The other
+  // half goes to the first rebuild, so that no rebuild waits forever on 
+  // those started after it.
+  std::vector<IncrementalRebuild>& rebuilds = incremental.rebuilds;
+  bool toLast = true;
+  while (budget > 0 && ! rebuilds.empty()) {
+    size_t index = toLast ? rebuilds.size() - 1 : 0;
+    size_t share = toLast && rebuilds.size() > 1 ? budget - budget / 2 : budget;
+    budget -= share;
+    bool caughtUp = stepRebuild(rebuilds[index], share);
+    budget += share;  // Units the rebuild had no use for
+    toLast = ! toLast;
+    if (! caughtUp) continue;
+
+    // The shadow subtree may be rebuilt once it is in place, which counts
+    // its own time.
+#ifdef SCAPEGOAT_COLLECT_STATS
+    rebuildStats.rebuildTime += std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start);
+#endif
+    swapInShadow(index);
+#ifdef SCAPEGOAT_COLLECT_STATS
+    start = std::chrono::steady_clock::now();
+#endif
+  }
+
+#ifdef SCAPEGOAT_COLLECT_STATS
+  rebuildStats.rebuildTime += std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start);
+#endif
+}
+
+bool ScapegoatTree::stepRebuild(IncrementalRebuild& current, size_t& budget) {
+  using Phase = IncrementalRebuild::Phase;
+  std::vector<int>& keys = current.keys;
+
+  if (current.phase == Phase::kCopy) {
+    KeyBounds bounds = boundsOf(current.subtreeRoot);
+
+    // Pick up after the last key copied, wherever the tree has moved it 
+    // since, unless the subtree's keys now start after it.
+    const_iterator it = begin();
+    if (! keys.empty() && (! bounds.hasLo || keys.back() > bounds.lo)) {
+      it = upper_bound(keys.back());
+    } else if (bounds.hasLo) {
+      it = upper_bound(bounds.lo);
+    }
+    const_iterator last = bounds.hasHi ? lower_bound(bounds.hi) : end();
+    if (bounds.hasHi && (it == end() || *it > bounds.hi)) it = last;
+
+    for (; budget > 0 && it != last; ++it, budget--) {
+      keys.push_back(*it);
+    }
+    if (! keys.empty()) {
+      current.hasKeys = true;
+      current.lowestKey = keys.front();
+      current.highestKey = keys.back();
+    }
+
+    if (it == last) {
+      current.phase = Phase::kBuild;
+      current.shadowRoot = nullptr;
+      current.shadowSize = current.shadowMaxSize = keys.size();
+      if (! keys.empty()) current.pending.push_back( { 0, keys.size(), nullptr, false } );
+    }
+  }
+
+  if (current.phase == Phase::kBuild) {
+    std::vector<PendingSubtree>& pending = current.pending;
+    for (; budget > 0 && ! pending.empty(); budget--) {
+      PendingSubtree subtree = pending.back();
+      pending.pop_back();
+
+      // As in buildTree, a subtree of n keys has n / 2 keys on the left and
+      // (n - 1) / 2 keys on the right.
+      size_t leftCount = subtree.count / 2;
+      size_t rightCount = (subtree.count - 1) / 2;
+
+      NodeRef node = pool.allocate();
+      at(node).key = keys[subtree.first + leftCount];
+      at(node).left = at(node).right = nullptr;
+#ifdef SCAPEGOAT_TRACK_SUBTREE_SIZES
+      at(node).size = subtree.count;
+#endif
+
+      if (! subtree.parent) {
+        current.shadowRoot = node;
+      } else if (subtree.isLeft) {
+        at(subtree.parent).left = node;
+      } else {
+        at(subtree.parent).right = node;
+      }
+
+      // Build the left subtree first, so that nodes are made in pre-order.
+      if (rightCount > 0) {
+        pending.push_back( { subtree.first + leftCount + 1, rightCount, node, false } );
+      }
+      if (leftCount > 0) {
+        pending.push_back( { subtree.first, leftCount, node, true } );
+      }
+    }
+
+    if (pending.empty()) {
+      current.phase = Phase::kCatchUp;
+      std::vector<int>().swap(keys);  // Free the copied keys' memory
+    }
+  }
+
+  if (current.phase != Phase::kCatchUp) return false;
+
+  std::vector<int>& changedKeys = current.changedKeys;
+  for (; budget > 0 && ! changedKeys.empty(); budget--) {
+    syncShadowKey(current, changedKeys.back());
+    changedKeys.pop_back();
+  }
+  return changedKeys.empty();
+}
+
+void ScapegoatTree::noteChangedKey(int key) {
+  if (incremental.rebuilds.empty()) return;
+
+  // A change to the key touches the subtrees on its search path, and those
+  // within the subtree of the node holding it, which it may have just been
+  // moved up out of. The nodes on the path are told apart by their keys. A
+  // key removed by removeRange may have left a subtree whose bounds have
+  // moved since, so removed keys also touch the copies spanning them.
+  std::vector<int> pathKeys;
+  KeyBounds holderBounds;
+  NodeRef curr = root;
+  while (curr && key != at(curr).key) {
+    pathKeys.push_back(at(curr).key);
+    if (key < at(curr).key) {
+      holderBounds.hasHi = true;
+      holderBounds.hi = at(curr).key;
+      curr = at(curr).left;
+    } else {
+      holderBounds.hasLo = true;
+      holderBounds.lo = at(curr).key;
+      curr = at(curr).right;
+    }
+  }
+  std::sort(pathKeys.begin(), pathKeys.end());
+
+  for (IncrementalRebuild& current : incremental.rebuilds) {
+    if (current.subtreeRoot) {
+      int rootKey = at(current.subtreeRoot).key;
+      bool touched = std::binary_search(pathKeys.begin(), pathKeys.end(), rootKey)
+          || (curr && holderBounds.holds(rootKey))
+          || (! curr && current.hasKeys && current.lowestKey <= key && key <= current.highestKey);
+      if (! touched) continue;
+    }
+
+    switch (current.phase) {
+      case IncrementalRebuild::Phase::kCopy:
+        // Keys not copied yet will be copied as they are by then.
+        if (! current.keys.empty() && key <= current.keys.back()) {
+          current.changedKeys.push_back(key);
+        }
+        break;
+
+      case IncrementalRebuild::Phase::kBuild:
+        current.changedKeys.push_back(key);
+        break;
+
+      case IncrementalRebuild::Phase::kCatchUp:
+        // The shadow subtree is whole, and can keep up with the tree right away.
+        syncShadowKey(current, key);
+        break;
+    }
+  }
+}
+
+void ScapegoatTree::syncShadowKey(IncrementalRebuild& current, int key) {
+  bool present = subtreeHolds(current.subtreeRoot, key);
+
+  // Insertions into the shadow subtree are too deep as they would be in
+  // the tree: below the subtree's root, against the tree's size.
+  size_t rootDepth = 0;
+  if (current.subtreeRoot) {
+    int rootKey = at(current.subtreeRoot).key;
+    for (NodeRef node = root; node != current.subtreeRoot; rootDepth++) {
+      node = rootKey < at(node).key ? at(node).left : at(node).right;
+    }
+  }
+  size_t treeSize = size;
+
+  // Run the tree's own insertion and removal on the shadow subtree, swapped
+  // in for the tree meanwhile, without counting or reporting them as the 
+  // tree's. Keys too deep are checked again in the tree once the shadow 
+  // subtree is in place: their scapegoats may be too large to rebuild at
+  // once here, which would start an incremental rebuild of the tree's own 
+  // nodes instead, and rebuilding one may not lift them far enough.
+  std::swap(root, current.shadowRoot);
+  std::swap(size, current.shadowSize);
+  std::swap(maxSize, current.shadowMaxSize);
+  incremental.syncing = true;
+
+  if (present) {
+    InsertionPath insertionPath(getMaxPathLength());
+    if (insertLeaf(key, insertionPath)) {
+      current.lowestKey = current.hasKeys ? std::min(current.lowestKey, key) : key;
+      current.highestKey = current.hasKeys ? std::max(current.highestKey, key) : key;
+      current.hasKeys = true;
+
+      size_t insertionHeight = rootDepth + insertionPath.size() - 1;
+      if (insertionHeight >= 1 && alphaDeepHeights.exceeds(insertionHeight, treeSize)) {
+        Scapegoat scapegoat = findScapegoat(insertionPath);
+        if (scapegoat.parent && scapegoat.treeSize <= rebuildBudget) {
+          rebuild(scapegoat, RebuildReason::kInsertTooDeep);
+        }
+        current.deepKeys.push_back(key);
+      }
+    }
+  } else {
+    removeKey(key);
+  }
+
+  incremental.syncing = false;
+  std::swap(root, current.shadowRoot);
+  std::swap(size, current.shadowSize);
+  std::swap(maxSize, current.shadowMaxSize);
+}
+
+void ScapegoatTree::swapInShadow(size_t index) {
+  IncrementalRebuild done = std::move(incremental.rebuilds[index]);
+  incremental.rebuilds.erase(incremental.rebuilds.begin() + index);
+
+  // Rebuilds within the subtree are done along with it.
+  dropRebuildsWithin(done.subtreeRoot);
+
+  // Find where the subtree hangs now.
+  NodeRef subtreeRoot = done.subtreeRoot ? done.subtreeRoot : root;
+  NodeRef parent = nullptr;
+  if (done.subtreeRoot) {
+    int key = at(subtreeRoot).key;
+    for (NodeRef node = root; node != subtreeRoot; ) {
+      parent = node;
+      node = key < at(node).key ? at(node).left : at(node).right;
+    }
+  }
+
+  // The shadow subtree holds the same keys, so only a new whole tree 
+  // changes the tree's max size or needs a new Eytzinger array.
+  if (subtreeRoot) incremental.garbage.push_back(subtreeRoot);
+  if (! parent) {
+    root = done.shadowRoot;
     maxSize = size;
-  } else if (scapegoat.scapegoat == scapegoat.parent->left) {
-    scapegoat.parent->left = dummy.left;
-  } else /* if (scapegoat.scapegoat == scapegoat.parent->right) */ {
-    scapegoat.parent->right = dummy.left;
+    syncEytzinger();
+  } else if (at(parent).left == subtreeRoot) {
+    at(parent).left = done.shadowRoot;
+  } else /* if (at(parent).right == subtreeRoot) */ {
+    at(parent).right = done.shadowRoot;
+  }
+
+#ifdef SCAPEGOAT_COLLECT_STATS
+  // The time spent was counted step by step.
+  rebuildStats.recordRebuild(done.treeSize, ! done.subtreeRoot, 
+                             std::chrono::steady_clock::duration::zero());
+#endif
+
+#ifdef SCAPEGOAT_REBUILD_EVENTS
+  if (rebuildListener) {
+    rebuildListener->afterRebuild( { done.treeSize, done.depth, ! done.subtreeRoot, done.reason } );
+  }
+#endif
+
+  // Keys left too deep in the shadow subtree are checked in the tree, 
+  // where their scapegoats can be rebuilt incrementally.
+  std::vector<int>& deepKeys = incremental.deepKeys;
+  deepKeys.insert(deepKeys.end(), done.deepKeys.begin(), done.deepKeys.end());
+}
+
+void ScapegoatTree::rebuildIfDeep(int key) {
+  // A node may have been left more than a level too deep, and rebuilding a
+  // scapegoat only lifts it by one level or more, so keep rebuilding until
+  // it is deep no more, or a rebuild is left to be done incrementally.
+  while (true) {
+    // Find the ancestors of the key's node, as insertLeaf does.
+    InsertionPath insertionPath(getMaxPathLength());
+    insertionPath.push(nullptr);      // The "root's parent"
+
+    NodeRef curr = root;
+    while (curr && key != at(curr).key) {
+      insertionPath.push(curr);
+      curr = key < at(curr).key ? at(curr).left : at(curr).right;
+    }
+    if (! curr) return;
+
+    size_t insertionHeight = insertionPath.size() - 1;
+    if (insertionHeight < 1 || ! alphaDeepHeights.exceeds(insertionHeight, size)) return;
+
+    Scapegoat scapegoat = findScapegoat(insertionPath);
+    rebuild(scapegoat, RebuildReason::kInsertTooDeep);
+    if (rebuildBudget > 0 && scapegoat.treeSize > rebuildBudget) return;
   }
 }
 
 bool ScapegoatTree::verify() const {
   VerificationData treeProperties = verifyHelper(root);
-  return size >= alpha * maxSize && treeProperties.balanced && treeProperties.isBST;
+
+  // The tree may be out of balance until an incremental rebuild is done.
+  bool balanced = ! incremental.rebuilds.empty() || ! incremental.deepKeys.empty()
+      || (size >= alpha * maxSize && treeProperties.balanced);
+  return balanced && treeProperties.isBST && treeProperties.sizesValid;
 }
 
-ScapegoatTree::VerificationData ScapegoatTree::verifyHelper(Node *node) const {
+ScapegoatTree::VerificationData ScapegoatTree::verifyHelper(NodeRef node) const {
   // Base case: if tree is empty, size is 0 and tree is balanced.
   if (! node) {
-    return { true, true, 0, -1 };
+    return { true, true, true, 0, -1 };
   }
 
   // Check if left child's key < current node's key < right child's key. 
-  VerificationData left = verifyHelper(node->left);
-  VerificationData right = verifyHelper(node->right);
+  VerificationData left = verifyHelper(at(node).left);
+  VerificationData right = verifyHelper(at(node).right);
 
   bool isBST = left.isBST && right.isBST;
-  if (node->left) isBST = isBST && node->left->key < node->key; 
-  if (node->right) isBST = isBST && node->right->key > node->key;
+  if (at(node).left) isBST = isBST && at(at(node).left).key < at(node).key; 
+  if (at(node).right) isBST = isBST && at(at(node).right).key > at(node).key;
 
   // Check if current node is loosely alpha-height balanced.
   size_t size = left.size + right.size + 1;
   int height = std::max(left.height, right.height) + 1;
   int max_height = getAlphaDeepHeight(size) + 1;
 
-  return { height <= max_height, isBST, size, height };
+  // Check if the stored subtree size (if any) matches the actual size.
+  bool sizesValid = left.sizesValid && right.sizesValid;
+#ifdef SCAPEGOAT_TRACK_SUBTREE_SIZES
+  sizesValid = sizesValid && at(node).size == size;
+#endif
+
+  return { height <= max_height, isBST, sizesValid, size, height };
 }
 
 void ScapegoatTree::printDebugInfo() const {
@@ -336,15 +1629,18 @@ void ScapegoatTree::printDebugInfo() const {
   std::cout << std::flush;
 }
 
-void ScapegoatTree::printDebugInfoRec(Node* root, unsigned indent) const {
+void ScapegoatTree::printDebugInfoRec(NodeRef root, unsigned indent) const {
   if (! root) {
     std::cout << std::setw(indent) << "" << "null" << '\n';
   } else {
-    std::cout << std::setw(indent) << "" << "Node       " << root << '\n';
-    std::cout << std::setw(indent) << "" << "Key:       " << root->key << '\n';
+    std::cout << std::setw(indent) << "" << "Node       " << &at(root) << '\n';
+    std::cout << std::setw(indent) << "" << "Key:       " << at(root).key << '\n';
+#ifdef SCAPEGOAT_TRACK_SUBTREE_SIZES
+    std::cout << std::setw(indent) << "" << "Size:      " << at(root).size << '\n';
+#endif
     std::cout << std::setw(indent) << "" << "Left Child:" << '\n';
-    printDebugInfoRec(root->left,  indent + 4);
+    printDebugInfoRec(at(root).left,  indent + 4);
     std::cout << std::setw(indent) << "" << "Right Child:" << '\n';
-    printDebugInfoRec(root->right, indent + 4);
+    printDebugInfoRec(at(root).right, indent + 4);
   }
 }
\ No newline at end of file
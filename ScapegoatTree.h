@@ -14,11 +14,57 @@
  * See also page 77 onward in "On Consulting a Set of Experts and Searching" 
  * by Igal Galperin, 1996: 
  * http://publications.csail.mit.edu/lcs/pubs/pdf/MIT-LCS-TR-700.pdf
+ * 
+ * Compiling with SCAPEGOAT_TRACK_SUBTREE_SIZES defined (for every translation
+ * unit including this header) trades the "no additional information" property
+ * for a subtree size stored in every node. Sizes are kept up to date along
+ * insertion and removal paths, so finding a scapegoat takes O(log N) time 
+ * instead of O(size of the scapegoat's subtree).
+ * 
+ * Compiling with SCAPEGOAT_COMPACT_NODES defined (likewise for every 
+ * translation unit) keeps nodes in chunks of an IndexedNodePool, in which 
+ * nodes refer to their children by 32-bit index instead of by pointer. A node
+ * then takes 12 bytes instead of 24 (16 instead of 32 with subtree sizes), so
+ * that more of the tree fits in each cache line, at the cost of finding the 
+ * chunk and slot of each child followed. The pool holds at most 2^32 - 1 
+ * nodes, counting nodes released and not reused yet as well as, during 
+ * incremental rebuilds, the nodes of both the old and the new subtrees. With
+ * the kRelink strategy and no rebuild budget, the tree thus holds up to 
+ * 2^32 - 1 keys. The kRelayout strategy and incremental rebuilds each take up
+ * to about as many nodes again as there are keys, bringing the limit down to
+ * about 2^31 keys, or about 2^32 / 3 keys with both. Past the limit, 
+ * insertions throw std::length_error. The pool grows a chunk of 65536 nodes
+ * at a time, and never moves nodes once the tree outgrows the first chunk.
+ * 
+ * Compact nodes only pay off when memory is what limits the tree. Finding 
+ * a node's chunk is one more load before the node itself, so random lookups
+ * in trees that fit in cache run about 1.3-1.7x slower than with pointer 
+ * nodes; only from a million keys or so do the cache misses that half-size
+ * nodes save make up for it. They suit trees that must take as little 
+ * memory as possible, such as many trees at once, or a tree that would not
+ * fit in memory otherwise.
+ * 
+ * Compiling with SCAPEGOAT_COLLECT_STATS defined (likewise for every 
+ * translation unit) makes the tree count its rebuilds, their sizes and 
+ * their time, as reported by stats(). See RebuildStats.h.
+ * 
+ * Compiling with SCAPEGOAT_REBUILD_EVENTS defined (likewise for every 
+ * translation unit) lets a RebuildListener be told of each rebuild right
+ * before and after it happens, through setRebuildListener. Without it, no 
+ * trace of listeners is compiled in. See RebuildListener.h.
  */ 
 
-#include <cstddef>  // for std::size_t
-#include <stack>    // for scapegoat-node-finding stack
-#include <cmath>    // for floor, log
+#include <cstddef>  // for std::size_t, std::ptrdiff_t
+#include <cstdint>  // for std::uint32_t
+#include <iterator> // for std::bidirectional_iterator_tag
+#include <utility>  // for std::pair
+#include <vector>   // for batches of keys and the relayout rebuild's scratch buffers
+
+#include "AlphaDeepHeightTable.h"
+#include "NodePool.h"
+#include "NodeStack.h"  // for scapegoat-node-finding stack and iterator paths
+#include "RebuildListener.h"
+#include "RebuildStats.h"
 
 /**
  * Class representing a Scapegoat Tree. 
@@ -26,20 +72,80 @@
 class ScapegoatTree {
   public:
     /**
-     * Constructs a new, empty scapegoat tree with the provided alpha value.
+     * How rebuild makes a subtree perfectly balanced.
+     */
+    enum class RebuildStrategy {
+      // Relink the subtree's existing nodes in place. No memory is allocated,
+      // but the rebuilt subtree keeps the nodes' scattered memory layout.
+      kRelink,
+
+      // Copy the subtree's keys into a scratch buffer, write the rebuilt 
+      // subtree into freshly allocated, contiguous nodes in breadth-first 
+      // order, and release the old nodes. Searches through the rebuilt 
+      // subtree touch far fewer cache lines.
+      //
+      // Released nodes are only reused by single insertions, so once they
+      // outnumber the tree's keys, the whole tree is relaid out instead,
+      // which frees them all. The pool thus holds at most about twice as 
+      // many nodes as the tree, where kRelink holds as many as the tree ever 
+      // had at once. While subtrees are rebuilt incrementally (see 
+      // setRebuildBudget), or if the tree is too large to be rebuilt at 
+      // once, subtrees are relinked instead once the bound is reached.
+      kRelayout
+    };
+
+    /**
+     * Constructs a new, empty scapegoat tree with the provided alpha value,
+     * which rebuilds subtrees using the provided strategy.
      * Throws std::invalid_argument if alpha is not within (0.5, 1).
      * 
      * Time complexity: O(1)
      */
-    ScapegoatTree(double alpha);
+    ScapegoatTree(double alpha, RebuildStrategy strategy = RebuildStrategy::kRelink);
 
     /**
-     * Frees all memory allocated by this scapegoat tree.
+     * Constructs a new scapegoat tree with the provided alpha value and 
+     * strategy, holding the keys in the range [first, last). See assign.
+     * Throws std::invalid_argument if alpha is not within (0.5, 1).
      * 
-     * Time complexity: O(N)
+     * Time complexity: O(N) for sorted keys, O(N log N) otherwise
+     */
+    template<typename InputIt>
+    ScapegoatTree(double alpha, InputIt first, InputIt last,
+                  RebuildStrategy strategy = RebuildStrategy::kRelink)
+      : ScapegoatTree(alpha, strategy) {
+      assign(first, last);
+    }
+
+    /**
+     * Frees all memory allocated by this scapegoat tree. Nodes live in the
+     * tree's node pool, so this frees whole chunks instead of walking the tree.
+     * 
+     * Time complexity: O(N / chunk size)
      */
     ~ScapegoatTree();
 
+    /**
+     * Replaces the contents of the tree with the keys in the range 
+     * [first, last), building a perfectly balanced tree in one pass instead
+     * of inserting the keys one at a time. Keys are expected to be sorted; 
+     * any other range is sorted first. Duplicate keys are only kept once.
+     * 
+     * Time complexity: O(N) for sorted keys, O(N log N) otherwise
+     * Space complexity: O(N), for a copy of the keys
+     */
+    template<typename InputIt>
+    void assign(InputIt first, InputIt last) {
+      assignKeys(std::vector<int>(first, last));
+    }
+
+    /**
+     * Removes every key from the tree and frees its nodes' memory.
+     * 
+     * Time complexity: O(N / chunk size)
+     */
+    void clear();
+
     /**
      * Returns whether the given key is present in the tree.
      * 
@@ -47,6 +153,166 @@ class ScapegoatTree {
      */
     bool search(int key) const;
 
+    /**
+     * Sets out[i] to whether keys[i] is present in the tree, for each of the
+     * n given keys, the same as n calls to search. Lookups advance in groups,
+     * one level at a time, prefetching the next node of every lookup in a 
+     * group before reading any of them, so that the cache misses of one 
+     * group overlap instead of following one another.
+     * 
+     * Time complexity: O(n log N)
+     */
+    void searchBatch(const int* keys, size_t n, bool* out) const;
+
+    /**
+     * Turns the Eytzinger search mode on or off. In this mode, the tree also
+     * keeps a copy of its keys in an implicit, cache-line-aligned array in 
+     * Eytzinger (breadth-first) order, with no child pointers. The copy is 
+     * refreshed whenever the whole tree is rebuilt or assigned, and search 
+     * descends it without branching, prefetching ahead, for as long as the 
+     * tree stays unchanged. This suits read-mostly trees: after an insertion
+     * or removal, search walks the nodes until the next whole-tree rebuild.
+     * Turning the mode on (again) copies the keys right away.
+     * 
+     * Time complexity: O(N) to turn on, O(1) to turn off
+     * Space complexity: O(N) while on
+     */
+    void setEytzingerSearch(bool enabled);
+
+#ifdef SCAPEGOAT_TRACK_SUBTREE_SIZES
+    /**
+     * Turns incremental rebuilding on, or off if unitsPerOperation is 0 (the
+     * default). Rebuilding a subtree takes time proportional to its size, 
+     * all at once. In this mode, a subtree holding more than 
+     * unitsPerOperation keys instead spreads that work over the insertions
+     * and removals that follow: a balanced shadow copy of the subtree is 
+     * built alongside it, each insertion or removal doing at most 
+     * unitsPerOperation units of work on it (copying a key, making a node,
+     * bringing a key changed since it was copied up to date, or freeing a 
+     * node of the replaced subtree), and the copy takes the subtree's place
+     * once it is complete. Until then the tree answers queries and changes 
+     * as usual, though the subtree may be out of balance.
+     * 
+     * A scapegoat found within a subtree being rebuilt gets a rebuild of its
+     * own, nested in the other one, and so do scapegoats beside it, while a
+     * scapegoat holding it supersedes it. Half of each operation's work goes
+     * to the latest rebuild, which keeps the subtrees within larger rebuilds
+     * in shape meanwhile, and the rest to the earliest one, so that none 
+     * waits forever. Keys left too deep by a copy are checked once it is in
+     * place, a unit each, as their insertions would have been.
+     * 
+     * The budget should cover the amortized rebuilding work of insertions,
+     * about three units per node rebuilt: for keys inserted in order, some
+     * 150 units per operation at alpha 0.55, 80 at 0.6 and 50 at 0.7, and 
+     * less for random keys. Smaller budgets let rebuilds pile up, leaving 
+     * the tree deeper and every operation slower until they catch up.
+     * 
+     * Besides its own descent, each insertion or removal thus does 
+     * O(unitsPerOperation) rebuilding work. The exceptions are batches: a 
+     * batch insertion merged with the tree (see insertBatch) rebuilds it at
+     * once, in time proportional to the batch, and removeRange catches up on
+     * each key it removes in turn. In Eytzinger search mode, the array is 
+     * still refreshed all at once when a copy takes the whole tree's place.
+     * 
+     * Stats and rebuild events count each incremental rebuild as a single 
+     * rebuild, leaving out the insertions, removals and rebuilds done on the
+     * copy. A rebuild whose subtree is rebuilt at once, superseded by a 
+     * rebuild holding it, or cut out by removeRange before it is done is 
+     * dropped: it is reported as over, but not counted. Searches and other 
+     * const operations leave the tree untouched, and so do no rebuilding 
+     * work.
+     * 
+     * Only available when compiled with SCAPEGOAT_TRACK_SUBTREE_SIZES: 
+     * without stored sizes, finding a scapegoat takes time proportional to
+     * its subtree, which no budget could bound.
+     * 
+     * Throws std::invalid_argument if unitsPerOperation is 1, which could 
+     * fall behind insertions forever.
+     * 
+     * Time complexity: O(1), plus O(N) to finish the rebuilds in progress 
+     *    when turning the mode off
+     * Space complexity: O(size of the subtrees being rebuilt), for the copies
+     */
+    void setRebuildBudget(size_t unitsPerOperation);
+#endif
+
+    /**
+     * Returns whether an incremental rebuild (see setRebuildBudget) is in 
+     * progress, or one left work behind: nodes of the subtree it replaced 
+     * to free, or nodes too deep in its copy to check.
+     * 
+     * Time complexity: O(1)
+     */
+    bool rebuildInProgress() const;
+
+    /**
+     * Finishes every incremental rebuild in progress right away.
+     * 
+     * Time complexity: O(N) during a rebuild, O(1) otherwise
+     */
+    void finishRebuild();
+
+    /**
+     * Bidirectional iterator over the keys of the tree in increasing order. 
+     * Any insertion or removal invalidates every iterator. See below.
+     */
+    class const_iterator;
+    using iterator = const_iterator;
+
+    /**
+     * Bidirectional iterator over the keys of the tree in decreasing order,
+     * used like std::reverse_iterator<const_iterator>. See below.
+     */
+    class const_reverse_iterator;
+    using reverse_iterator = const_reverse_iterator;
+
+    /**
+     * Returns an iterator to the smallest key in the tree, or end() if the
+     * tree is empty.
+     * 
+     * Time complexity: O(log N)
+     */
+    const_iterator begin() const;
+
+    /**
+     * Returns an iterator past the largest key in the tree.
+     * 
+     * Time complexity: O(1)
+     */
+    const_iterator end() const;
+
+    /**
+     * Returns reverse iterators, visiting keys in decreasing order.
+     * 
+     * Time complexity: O(log N) for rbegin, O(1) for rend
+     */
+    const_reverse_iterator rbegin() const;
+    const_reverse_iterator rend() const;
+
+    /**
+     * Returns an iterator to the smallest key >= the given key, or end() if
+     * there is none. Scanning k keys from there takes O(log N + k) time.
+     * 
+     * Time complexity: O(log N)
+     */
+    const_iterator lower_bound(int key) const;
+
+    /**
+     * Returns an iterator to the smallest key > the given key, or end() if
+     * there is none.
+     * 
+     * Time complexity: O(log N)
+     */
+    const_iterator upper_bound(int key) const;
+
+    /**
+     * Returns the range of keys equal to the given key: 
+     * { lower_bound(key), upper_bound(key) }.
+     * 
+     * Time complexity: O(log N)
+     */
+    std::pair<const_iterator, const_iterator> equal_range(int key) const;
+
     /**
      * Inserts the given key into the scapegoat tree. If the element was added,
      * this function returns true. If the element already existed, this
@@ -57,6 +323,24 @@ class ScapegoatTree {
      */
     bool insert(int key);
 
+    /**
+     * Inserts the keys in the range [first, last) into the scapegoat tree, 
+     * skipping keys already present, and returns how many keys were added.
+     * 
+     * Rebuilding is deferred until every key is in the tree, so that each
+     * imbalanced subtree is rebuilt at most once per batch. A batch large 
+     * enough compared to the tree is instead merged with the tree's keys 
+     * into a brand new tree, which counts as a rebuild of the whole tree.
+     * 
+     * Time complexity: O(K log K + K log N) amortized for a batch of K keys,
+     *    O(K log K + N) for a large batch
+     * Space complexity: O(K), for a sorted copy of the batch
+     */
+    template<typename InputIt>
+    size_t insertBatch(InputIt first, InputIt last) {
+      return insertKeys(std::vector<int>(first, last));
+    }
+
     /**
      * Remove a key from the tree. If the element was removed, this function 
      * returns true. If the element did not exist in the tree, this function
@@ -66,8 +350,62 @@ class ScapegoatTree {
      */
     bool remove(int key);
 
+    /**
+     * Removes the keys in the range [first, last) from the tree, skipping 
+     * keys not present, and returns how many keys were removed.
+     * 
+     * The whole tree is rebuilt at most once, after every key is removed,
+     * instead of whenever a single removal shrinks it enough.
+     * 
+     * Time complexity: O(K log N + N) for a batch of K keys, 
+     *    O(K log N) amortized
+     */
+    template<typename InputIt>
+    size_t removeBatch(InputIt first, InputIt last) {
+      return removeKeys(std::vector<int>(first, last));
+    }
+
+    /**
+     * Removes every key k such that lo <= k <= hi from the tree, and returns
+     * how many keys were removed. Subtrees lying within the range are cut 
+     * out whole, without looking up their keys one at a time, and the whole
+     * tree is rebuilt at most once. Incremental rebuilds in progress then 
+     * catch up on the removed keys one at a time, each advancing them as 
+     * much as a removal would. Those of subtrees whose root is cut out are
+     * dropped, and the subtree joined in the range's place is rebuilt.
+     * 
+     * Time complexity: O(log N + K) to remove K keys, plus O(N) if the tree 
+     *    is rebuilt, or O(K log N) during incremental rebuilds
+     */
+    size_t removeRange(int lo, int hi);
+
+#ifdef SCAPEGOAT_COLLECT_STATS
+    /**
+     * Returns the counters the tree has kept about its rebuilds since it was
+     * constructed, batch insertions merged into a new tree included. Only available when compiled with SCAPEGOAT_COLLECT_STATS.
+     * 
+     * Time complexity: O(1)
+     */
+    const RebuildStats& stats() const { return rebuildStats; }
+#endif
+
+#ifdef SCAPEGOAT_REBUILD_EVENTS
+    /**
+     * Registers the given listener to be told of every rebuild from now on,
+     * replacing any listener registered before, or unregisters it if the 
+     * listener is nullptr. The tree does not own the listener, which must 
+     * outlive its registration. Only available when compiled with 
+     * SCAPEGOAT_REBUILD_EVENTS.
+     * 
+     * Time complexity: O(1)
+     */
+    void setRebuildListener(RebuildListener* listener) { rebuildListener = listener; }
+#endif
+
     /**
      * Returns whether the scapegoat tree is loosely alpha-height balanced.
+     * While an incremental rebuild is in progress, only checks that it is a
+     * proper BST.
      */
     bool verify() const;
 
@@ -80,23 +418,149 @@ class ScapegoatTree {
     // Helper structs:
 
     /** 
-     * Represents a standard BST node, holding its key and children. 
+     * Represents a standard BST node, holding its key and children. Nodes
+     * refer to each other by NodeRef, which is a pointer unless nodes are
+     * compact, and are reached through at().
      */
+    struct Node;
+#ifdef SCAPEGOAT_COMPACT_NODES
+    using NodeRef = NodeIndex;
+#else
+    using NodeRef = Node*;
+#endif
+
     struct Node {
-      int    key;
+      int     key;
+
+      NodeRef left;
+      NodeRef right;
 
-      Node*  left;
-      Node*  right;
+#ifdef SCAPEGOAT_TRACK_SUBTREE_SIZES
+#ifdef SCAPEGOAT_COMPACT_NODES
+      std::uint32_t size;  // The number of nodes in the subtree rooted at this node
+#else
+      size_t size;  // The number of nodes in the subtree rooted at this node
+#endif
+#endif
     };
 
     /** 
      * Contains information about the "scapegoat node" useful for a rebuild.
      */
     struct Scapegoat {
-      Node* scapegoat;  // The node at the root of the imbalanced subtree
-      Node* parent;     // The parent of the imbalanced subtree, nullptr if scapegoat == root
+      NodeRef scapegoat;  // The node at the root of the imbalanced subtree
+      NodeRef parent;     // The parent of the imbalanced subtree, nullptr if scapegoat == root
       
-      size_t treeSize;  // The size of the scapegoat node's subtree 
+      size_t  treeSize;   // The size of the scapegoat node's subtree 
+      size_t  depth;      // The depth of the scapegoat node, 0 if scapegoat == root
+    };
+
+    /**
+     * Stack of the ancestors of an inserted node. Paths up to this many nodes 
+     * long are kept on the call stack, which covers every tree with alpha up 
+     * to about 0.84, and trees of up to hundreds of billions of nodes for alpha
+     * up to 0.9.
+     */
+    static constexpr size_t kInlinePathCapacity = 256;
+    using InsertionPath = NodeStack<Node, kInlinePathCapacity, NodeRef>;
+
+    /**
+     * A subtree under construction in buildTree.
+     */
+    struct BuildFrame {
+      size_t  treeSize;  // The number of nodes in the subtree
+      NodeRef root;      // The subtree's root, nullptr until its left half is built
+    };
+
+    // The most frames buildTree can need: sizes halve at each level.
+    static constexpr size_t kMaxBuildDepth = 8 * sizeof(size_t);
+
+    /**
+     * A range of the keys copied by an incremental rebuild, from which to 
+     * build the subtree hanging from one side of its parent.
+     */
+    struct PendingSubtree {
+      size_t  first;   // The index of the range's first key
+      size_t  count;   // The number of keys in the range
+      NodeRef parent;  // The subtree's parent, nullptr for the root
+      bool    isLeft;  // Whether the subtree is its parent's left subtree
+    };
+
+    /**
+     * The keys a subtree may hold: those between the keys of the nearest 
+     * ancestors it hangs left and right from, if any.
+     */
+    struct KeyBounds {
+      bool hasLo = false;  // Whether the subtree hangs right from an ancestor
+      bool hasHi = false;  // Whether it hangs left from one
+      int lo = 0;          // The key of the nearest such ancestors
+      int hi = 0;
+
+      bool holds(int key) const { return (! hasLo || lo < key) && (! hasHi || key < hi); }
+    };
+
+    /**
+     * The state of an incremental rebuild of a subtree. See setRebuildBudget.
+     */
+    struct IncrementalRebuild {
+      enum class Phase {
+        kCopy,     // Copying the subtree's keys in order
+        kBuild,    // Making the shadow subtree's nodes from the copied keys
+        kCatchUp   // Bringing keys changed since they were copied up to date
+      };
+      Phase phase = Phase::kCopy;
+
+      NodeRef subtreeRoot = nullptr;  // The subtree's root, nullptr for the whole tree
+      RebuildReason reason = RebuildReason::kInsertTooDeep;
+      size_t treeSize = 0;  // The size of the subtree when the rebuild started
+      size_t depth = 0;     // The depth of its root then
+
+      std::vector<int> keys;                // The keys copied so far, in order
+      std::vector<PendingSubtree> pending;  // Subtrees still to build, the next one last
+      std::vector<int> changedKeys;         // Keys inserted or removed after being copied
+      bool hasKeys = false;   // Whether the copy ever held keys, all between these
+      int lowestKey = 0;
+      int highestKey = 0;
+
+      NodeRef shadowRoot = nullptr;  // The root of the balanced copy
+      size_t shadowSize = 0;         // The copy's size and max size, as for the tree
+      size_t shadowMaxSize = 0;
+      std::vector<int> deepKeys;     // Keys too deep in the copy, to check once it is in place
+    };
+
+    /**
+     * The incremental rebuilds in progress and what is left of the subtrees
+     * they replaced. A rebuild comes after those of subtrees holding its own.
+     */
+    struct IncrementalRebuilds {
+      std::vector<IncrementalRebuild> rebuilds;  // The next one to work on last
+      std::vector<NodeRef> garbage;  // Subtrees whose nodes are still to be freed
+      std::vector<int> deepKeys;     // Keys of copies put in place, still to check
+      bool syncing = false;          // Whether a copy is swapped in for the tree
+    };
+
+    /**
+     * A batch holding at least 1 / kLargeBatchRatio as many keys as the tree
+     * is merged into it by rebuilding the whole tree, which is then cheaper
+     * than descending the tree once per key.
+     */
+    static constexpr size_t kLargeBatchRatio = 8;
+
+    /**
+     * The number of lookups searchBatch advances together, about as many 
+     * cache misses as a core can have in flight.
+     */
+    static constexpr size_t kSearchGroupSize = 16;
+
+    /**
+     * Sixteen consecutive keys of the Eytzinger array, filling a cache line.
+     * Index i of the array is keys[i % kKeysPerLine] of line i / kKeysPerLine,
+     * so the descendants four levels below index k, at indices 16k to 
+     * 16k + 15, make up line k exactly.
+     */
+    static constexpr size_t kKeysPerLine = 16;
+    struct alignas(64) EytzingerLine {
+      int keys[kKeysPerLine];
     };
 
     /**
@@ -105,6 +569,7 @@ class ScapegoatTree {
     struct VerificationData {
       bool balanced;  // Whether or not the subtree is loosely alpha-height balanced.
       bool isBST;     // Whether or not the subtree follows BST ordering.
+      bool sizesValid;  // Whether or not all stored subtree sizes are correct.
 
       size_t size;    // Size of the subtree.
       int height;     // Height of the subtree (-1 if the tree is empty)
@@ -113,7 +578,13 @@ class ScapegoatTree {
 
     // Attributes of the tree:
 
-    Node* root = nullptr;
+#ifdef SCAPEGOAT_COMPACT_NODES
+    IndexedNodePool<Node> pool;  // Owns the memory of every node in the tree.
+#else
+    NodePool<Node> pool;  // Owns the memory of every node in the tree.
+#endif
+
+    NodeRef root = nullptr;
     size_t size = 0;      // Current size of tree.
     size_t maxSize = 0;   // Max size of tree since last rebuild.
 
@@ -126,6 +597,24 @@ class ScapegoatTree {
     static constexpr double kMaxAlpha = 1.0;
     double alpha = kDefaultAlpha; 
 
+    RebuildStrategy rebuildStrategy = RebuildStrategy::kRelink;
+
+    bool eytzingerSearch = false;   // Whether the Eytzinger search mode is on
+    bool eytzingerCurrent = false;  // Whether eytzinger holds the tree's current keys
+
+    // In Eytzinger search mode, the keys at indices 1 to size, where the 
+    // children of index k are at indices 2k and 2k + 1.
+    std::vector<EytzingerLine> eytzinger;
+
+    size_t rebuildBudget = 0;  // Units of rebuild work per operation, 0 to rebuild at once
+    IncrementalRebuilds incremental;
+
+    /**
+     * The sizes at which the alpha-deep height increases, covering sizes 
+     * up to at least maxSize + 1.
+     */
+    AlphaDeepHeightTable alphaDeepHeights;
+
     /**
      * Represents whether a node being removed will be replaced with its 
      * successor (true) or predecessor (false). This instance variable is flipped
@@ -136,37 +625,213 @@ class ScapegoatTree {
      */
     bool replaceWithSucc = true;
 
+#ifdef SCAPEGOAT_COLLECT_STATS
+    RebuildStats rebuildStats;  // Counters about rebuilds, see stats()
+#endif
+
+#ifdef SCAPEGOAT_REBUILD_EVENTS
+    RebuildListener* rebuildListener = nullptr;  // Told of rebuilds, if not nullptr
+#endif
+
 
     // Helper functions:
 
+    /**
+     * Returns the node the given (non-null) reference refers to.
+     */
+#ifdef SCAPEGOAT_COMPACT_NODES
+    Node& at(NodeRef node)             { return pool.at(node); }
+    const Node& at(NodeRef node) const { return pool.at(node); }
+#else
+    Node& at(NodeRef node)             { return *node; }
+    const Node& at(NodeRef node) const { return *node; }
+#endif
+
     /**
      * Returns the alpha-deep height == floor(log_{1/alpha}(size)) 
-     * for a subtree of given size.
+     * for a subtree of given size, which is at most maxSize + 1.
      */ 
     size_t getAlphaDeepHeight(size_t size) const {
-      return static_cast<size_t>(floor(log(size) / log(1 / alpha)));
+      return alphaDeepHeights.height(size);
+    }
+
+    /**
+     * Returns an upper bound on the number of nodes on any root-to-leaf path
+     * after the next insertion, plus one for the root's (nullptr) parent: 
+     * no node is deeper than the loose alpha-deep height of maxSize.
+     */
+    size_t getMaxPathLength() const {
+      return getAlphaDeepHeight(maxSize + 1) + 3;
+    }
+
+    /**
+     * Returns floor(log_2(size)), the height of a 1/2-weight-balanced tree 
+     * of given (nonzero) size.
+     */
+    static size_t getBalancedHeight(size_t size) {
+      size_t height = 0;
+      while (size >>= 1) height++;
+      return height;
+    }
+
+    /**
+     * Insert subroutine:
+     * Inserts the given key as a new leaf without rebuilding anything, 
+     * leaving the ancestors of the new node on the given (empty) insertion 
+     * path, below the root's (nullptr) parent. Returns the new node, or 
+     * nullptr if the key was already present.
+     * 
+     * Time complexity: O(log N)
+     */
+    NodeRef insertLeaf(int key, InsertionPath& insertionPath);
+
+    /**
+     * InsertBatch subroutine:
+     * Inserts the given keys, rebuilding subtrees once they are all in. 
+     * Returns how many keys were added.
+     */
+    size_t insertKeys(std::vector<int> keys);
+
+    /**
+     * InsertBatch subroutine:
+     * Rebuilds the whole tree from its keys merged with the given sorted, 
+     * unique keys. Returns how many keys were added.
+     * 
+     * Time complexity: O(N + K)
+     */
+    size_t mergeKeys(const std::vector<int>& keys);
+
+    /**
+     * InsertBatch subroutine:
+     * Given the keys of nodes which were inserted by a batch too deep for 
+     * the size of the tree at the time, in increasing order, finds a 
+     * scapegoat for every one of them that is still too deep now. Rebuilds 
+     * only the outermost scapegoats, which are disjoint, so that no subtree
+     * is rebuilt twice. 
+     * 
+     * If some node is still too deep after that, which can only happen when
+     * a subtree has grown far out of balance, rebuilds the whole tree.
+     */
+    void rebuildDeepNodes(const std::vector<int>& deepKeys);
+
+    /**
+     * Remove subroutine:
+     * Removes the given key from the tree without rebuilding anything, and
+     * returns whether the key was present.
+     * 
+     * Time complexity: O(log N)
+     */
+    bool removeKey(int key);
+
+    /**
+     * RemoveBatch subroutine:
+     * Removes the given keys, then rebuilds the whole tree if necessary. 
+     * Returns how many keys were removed.
+     */
+    size_t removeKeys(const std::vector<int>& keys);
+
+    /**
+     * Remove subroutine:
+     * Rebuilds the whole tree if it has shrunk to alpha * maxSize keys or fewer
+     * since it was last rebuilt.
+     */
+    void rebuildIfShrunk();
+
+    /**
+     * RemoveRange subroutine:
+     * Releases every node of the subtree rooted at the given node to the node
+     * pool, and returns how many there were. Their keys are appended to 
+     * releasedKeys, unless it is nullptr.
+     * 
+     * Time complexity: O(size of subtree)
+     * Space complexity: O(1), besides the released keys
+     */
+    size_t releaseSubtree(NodeRef node, std::vector<int>* releasedKeys);
+
+    /**
+     * RemoveRange subroutine:
+     * Pops every node off the given stack, recomputing the stored subtree 
+     * size of each (if any) from its children's, deepest node first.
+     */
+    void updateSizes(InsertionPath& nodes);
+
+    /**
+     * Search subroutine for the Eytzinger search mode:
+     * Returns whether the given key is in the (current) Eytzinger array.
+     * 
+     * Time complexity: O(log N), in O(log N / 4) cache misses
+     */
+    bool searchEytzinger(int key) const;
+
+    /**
+     * SearchBatch subroutines:
+     * Look up a group of at most kSearchGroupSize keys in lockstep, through
+     * the nodes or through the (current) Eytzinger array.
+     * 
+     * Time complexity: O(count * log N)
+     */
+    void searchGroup(const int* keys, size_t count, bool* out) const;
+    void searchGroupEytzinger(const int* keys, size_t count, bool* out) const;
+
+    /**
+     * Rebuild and assign subroutine:
+     * Copies the tree's keys into the Eytzinger array in Eytzinger search 
+     * mode, walking the tree in order.
+     * 
+     * Time complexity: O(N) in Eytzinger search mode, O(1) otherwise
+     */
+    void syncEytzinger();
+
+    // Returns the key at the given index of the Eytzinger array.
+    int eytzingerKey(size_t index) const {
+      return eytzinger[index / kKeysPerLine].keys[index % kKeysPerLine];
     }
 
+    /**
+     * Lower_bound and upper_bound subroutine:
+     * Returns an iterator to the smallest key >= the given key if inclusive,
+     * or > the given key otherwise, keeping the path to it.
+     * 
+     * Time complexity: O(log N)
+     */
+    const_iterator findBound(int key, bool inclusive) const;
+
+    /**
+     * Sorts the given keys and drops duplicates, unless they are strictly 
+     * increasing already.
+     * 
+     * Time complexity: O(K) for sorted keys, O(K log K) otherwise
+     */
+    static void sortUniqueKeys(std::vector<int>& keys);
+
     /**
      * findScapegoat helper:
      * Returns the number of nodes in the subtree rooted at the given node.
+     * 
+     * Time complexity: O(1) when subtree sizes are tracked, 
+     *    O(size of subtree) otherwise
      */
-    size_t getSubtreeSize(Node *node);
+    size_t getSubtreeSize(NodeRef node);
 
     /**
      * Insert subroutine:
      * Given a stack of nodes representing the ancestors of an inserted node n
      * in order of descending depth in the tree, where n_i is the i-th ancestor
      * of node n, returns the deepest ancestor such that i > the alpha-deep-height
-     * of n_i's subtree, as well as that ancestor's parent and subtree size. 
+     * of n_i's subtree, as well as that ancestor's parent, subtree size and
+     * depth. Only the ancestor's own ancestors (and the root's parent) are
+     * left on the stack.
      * 
      * This ancestor is weight-imbalanced and therefore a suitable scapegoat
      * (see Galperin and Rivest for proof)
      * 
+     * Time complexity: O(log N) when subtree sizes are tracked, 
+     *    O(size of the scapegoat's subtree) otherwise
+     * 
      * Precondition: there is at least one ancestor on the path
      *    (insertionPath contains at least 2 elements)
      */
-    Scapegoat findScapegoat(std::stack<Node *>& insertionPath);
+    Scapegoat findScapegoat(InsertionPath& insertionPath);
 
     /** 
      * Remove subroutine: 
@@ -176,7 +841,7 @@ class ScapegoatTree {
      * Parameters: node has two children.
      * Postcondition: the memory of the node wired out of the tree is freed.
      */
-    void removeNodeWithTwoChildren(Node *node);
+    void removeNodeWithTwoChildren(NodeRef node);
 
     /** 
      * Remove subroutine: 
@@ -187,58 +852,393 @@ class ScapegoatTree {
      *    nullptr if node is the root of the tree.
      * Postcondition: node has been wired out of the tree, and its memory is freed.
      */
-    void removeNodeWithoutChild(Node *node, Node *parent);
+    void removeNodeWithoutChild(NodeRef node, NodeRef parent);
 
     /** 
      * Rebuild the subtree rooted at the given scapegoat node
-     * to be perfectly balanced, and rewire it to its parent.
+     * to be perfectly balanced using the tree's rebuild strategy, 
+     * and rewire it to its parent. The reason is passed on to the 
+     * rebuild listener, if there is one.
+     * 
+     * Under kRelayout, the whole tree is rebuilt instead of a subtree once
+     * the node pool holds more released nodes than the tree has keys.
+     * Returns whether the whole tree was rebuilt, which leaves any other
+     * subtree found beforehand dangling.
+     * 
+     * Time complexity: O(size of subtree to be rebuilt), amortized over 
+     *    the subtrees whose relayouts released the pool's free nodes
+     * Space complexity: O(height of subtree to be rebuilt), in a NodeStack,
+     *    or O(size of subtree to be rebuilt) when relaying out nodes
+     */
+    bool rebuild(Scapegoat scapegoat, RebuildReason reason);
+
+    /**
+     * Rebuild subroutine:
+     * Starts an incremental rebuild of the scapegoat's subtree for the given
+     * reason, unless one of the rebuilds in progress is of the same subtree,
+     * and drops the rebuilds of subtrees within it, which it supersedes.
+     * 
+     * Time complexity: O(R^2 + log N) for R rebuilds in progress
+     */
+    void startRebuild(const Scapegoat& scapegoat, RebuildReason reason);
+
+    /**
+     * Drops the incremental rebuilds of the given subtree and of subtrees 
+     * within it, which is about to be rebuilt at once, leaving the nodes of
+     * their copies to be freed by later operations.
+     * 
+     * Time complexity: O(R^2 + log N) for R rebuilds in progress
+     */
+    void dropRebuildsWithin(NodeRef subtreeRoot);
+
+    /**
+     * Drops the incremental rebuild at the given index of the rebuilds in 
+     * progress, leaving the nodes of its copy to be freed by later 
+     * operations, and reports it as over to the rebuild listener.
+     * 
+     * Time complexity: O(R) for R rebuilds in progress
+     */
+    void dropRebuild(size_t index);
+
+    /**
+     * Remove subroutine:
+     * Moves the incremental rebuild of the given node's subtree, if any, to
+     * the subtree of its only child as the node is spliced out of the tree,
+     * or drops it if there is no child or the child's subtree is rebuilt
+     * already.
+     *
+     * Time complexity: O(R) for R rebuilds in progress
+     */
+    void spliceRebuildRoot(NodeRef node, NodeRef child);
+
+    /**
+     * Returns the keys the subtree rooted at subtreeRoot may hold, which are
+     * any keys for the whole tree if subtreeRoot is nullptr. A node of the
+     * tree lies within the subtree exactly if the subtree may hold its key.
+     * 
+     * Time complexity: O(log N)
+     */
+    KeyBounds boundsOf(NodeRef subtreeRoot) const;
+
+    /**
+     * Returns whether the given key is in the subtree rooted at subtreeRoot,
+     * or in the whole tree if subtreeRoot is nullptr.
+     * 
+     * Time complexity: O(log N)
+     */
+    bool subtreeHolds(NodeRef subtreeRoot, int key) const;
+
+    /**
+     * Does at most the given number of units of work on the incremental 
+     * rebuilds in progress: first on freeing replaced nodes and checking 
+     * keys left too deep, then half on the last rebuild and the rest on the
+     * first one. Puts each shadow subtree in its subtree's place once it is
+     * complete.
+     * 
+     * Time complexity: O(budget log^2 N + R^2 log N) for R rebuilds in 
+     *    progress, plus the rebuilds of scapegoats found too deep
+     */
+    void advanceRebuild(size_t budget);
+
+    /**
+     * AdvanceRebuild subroutine:
+     * Spends units of the given budget on the given rebuild, leaving those
+     * it has no use for, and returns whether its shadow subtree is complete
+     * and caught up with the subtree.
      * 
-     * Time complexity: O(size of subtree to be rebuilt)
-     * Space complexity: O(height of subtree to be rebuilt)
+     * Time complexity: O(budget log N)
      */
-    void rebuild(Scapegoat scapegoat);
+    bool stepRebuild(IncrementalRebuild& current, size_t& budget);
+
+    /**
+     * AdvanceRebuild subroutine:
+     * Rebuilds scapegoats above the node holding the given key, as inserting
+     * the key would have, until the node is no longer too deep or one is 
+     * left to an incremental rebuild. Does nothing if the key has been 
+     * removed since.
+     * 
+     * Time complexity: O(log^2 N), plus the rebuilds'
+     */
+    void rebuildIfDeep(int key);
+
+    /**
+     * Insert and remove subroutine:
+     * Notes that the given key was just inserted, removed or moved out of a 
+     * subtree, so that each incremental rebuild in progress brings it up to
+     * date in its shadow subtree if the key was already copied.
+     * 
+     * Time complexity: O(log N + R log log N), plus O(log N) for each built
+     *    shadow subtree the key is synced into, for R rebuilds in progress
+     */
+    void noteChangedKey(int key);
+
+    /**
+     * AdvanceRebuild subroutine:
+     * Inserts the given key into the shadow subtree of the given rebuild, or
+     * removes it, so that the shadow subtree holds it exactly if the subtree
+     * does. Its insertions and rebuilds are neither counted in stats() nor
+     * reported to the rebuild listener.
+     * 
+     * Time complexity: amortized O(log N)
+     */
+    void syncShadowKey(IncrementalRebuild& current, int key);
+
+    /**
+     * AdvanceRebuild subroutine:
+     * Puts the complete shadow subtree of the rebuild at the given index in 
+     * its subtree's place, leaving the old subtree's nodes to be freed by 
+     * later operations, drops the rebuilds within the subtree, and leaves 
+     * the keys too deep in the copy to be checked.
+     * 
+     * Time complexity: O(R^2 + log N) for R rebuilds in progress, plus O(N)
+     *    in Eytzinger search mode when the whole tree is replaced
+     */
+    void swapInShadow(size_t index);
+
+    /**
+     * Assign subroutine:
+     * Replaces the contents of the tree with the given keys, sorting them 
+     * and dropping duplicates unless they are strictly increasing already, 
+     * and builds a 1/2-weight-balanced tree of them laid out according to 
+     * the tree's rebuild strategy.
+     * 
+     * Time complexity: O(N) for sorted keys, O(N log N) otherwise
+     */
+    void assignKeys(std::vector<int> keys);
+
+    /**
+     * Rebuild subroutine for the kRelayout strategy:
+     * Copies the keys of the subtree rooted at treeRoot, of the given size, 
+     * into a contiguous buffer, releases its nodes, and returns the root 
+     * of an equivalent tree built by layoutKeys.
+     * 
+     * Released nodes are recycled by later insertions. Relaying out the 
+     * whole tree also frees every chunk of the node pool, so that memory
+     * use goes back to what the tree needs; rebuild does so once too many
+     * nodes are waiting to be recycled.
+     * 
+     * Time complexity: O(treeSize)
+     * Space complexity: O(treeSize)
+     */
+    NodeRef relayout(NodeRef treeRoot, size_t treeSize);
+
+    /**
+     * Relayout subroutine:
+     * Given a non-empty list of strictly increasing keys, returns the root 
+     * of a 1/2-weight-balanced tree of them, laid out in contiguous, freshly
+     * allocated nodes in breadth-first order.
+     * 
+     * Time complexity: O(number of keys)
+     * Space complexity: O(number of keys)
+     */
+    NodeRef layoutKeys(const std::vector<int>& keys);
 
     /** 
      * Rebuild subroutine: 
-     * Converts the tree rooted at treeRoot into a linked list
-     * joined by right child pointers, prepends this list to listHead,
-     * and returns the head of the resulting list.
+     * Hands out the nodes of the subtree rooted at treeRoot one at a time, 
+     * in order. Each node's children are read before it is handed out, 
+     * so the caller may rewire it right away.
      * 
-     * Time complexity: O(subtree size of treeRoot)
-     * Space complexity: O(subtree height of treeRoot)
-     * Equivalent to FLATTEN(x, y) in Galperin and Rivest.
+     * Time complexity: amortized O(1) per node
+     * Space complexity: O(subtree height of treeRoot), in a NodeStack
+     * Streaming equivalent of FLATTEN(x, nullptr) in Galperin and Rivest, 
+     * which saves walking the flattened list a second time.
      */ 
-    Node* flatten(Node *treeRoot, Node *listHead);
+    class Flattener {
+      public:
+        Flattener(const ScapegoatTree& tree, NodeRef treeRoot, size_t maxDepth) 
+          : tree(tree), ancestors(maxDepth), rest(treeRoot) {}
+
+        NodeRef next();
+
+      private:
+        const ScapegoatTree& tree;  // The tree the nodes belong to
+        InsertionPath ancestors;    // Visited nodes whose keys are still to come
+        NodeRef rest;               // Root of the subtree not yet visited
+    };
+
+    /**
+     * Assign subroutine:
+     * Hands out freshly made nodes holding the given keys one at a time, in 
+     * order. The nodes are carved out of a single contiguous run of the 
+     * node pool.
+     */
+    class KeyNodeMaker {
+      public:
+        KeyNodeMaker(ScapegoatTree& tree, const int *keys, NodeRef nodes) 
+          : tree(tree), keys(keys), nodes(nodes) {}
+
+        NodeRef next() {
+          NodeRef node = nodes++;
+          tree.at(node).key = *keys++;
+          return node;
+        }
+
+      private:
+        ScapegoatTree& tree;  // The tree the nodes belong to
+        const int* keys;      // The key of the next node to hand out
+        NodeRef nodes;        // Storage for the next node to hand out
+    };
 
     /**
      * Rebuild subroutine:
      * 
-     * Given a size n for the tree to build and the head of a linked list 
-     * joined by right child pointers, constructs a 1/2-weight-balanced tree of
-     * n nodes from the list, in-place. 
-     * 
-     * Returns a pointer to the (n+1)th node in the list whose left child 
-     * holds the root of the equivalent tree.
-     * 
-     * Assumes that listHead's size is at least n+1.
+     * Given a size n for the tree to build and a source of nodes whose next()
+     * returns them in order (see Flattener and KeyNodeMaker), constructs a 1/2-weight-balanced 
+     * tree of the next n nodes, in-place, and returns its root.
      * 
      * Time complexity: O(treeSize)
-     * Space complexity: O(log treeSize)
-     * Equivalent to BUILD-TREE(n, x) in Galperin and Rivest.
+     * Space complexity: O(log treeSize), in a fixed-size array
+     * Equivalent to BUILD-TREE(n, x) in Galperin and Rivest, computed 
+     * iteratively with integer-only size splits.
      */ 
-    Node* buildTree(size_t treeSize, Node *listHead);
+    template<typename NodeSource>
+    NodeRef buildTree(size_t treeSize, NodeSource &nodes);
 
     /**
      * Verify helper function for a specific node.
      * Returns information verifying whether the subtree rooted at the given node 
-     * is loosely alpha-height balanced and a proper BST - see VerificationData struct.
+     * is loosely alpha-height balanced and a proper BST, and whether its stored
+     * subtree sizes (if any) are correct - see VerificationData struct.
      */
-    VerificationData verifyHelper(Node *node) const;
+    VerificationData verifyHelper(NodeRef node) const;
 
     /**
      * PrintDebugInfo helper.
      * Prints information about this root and its subtrees 
      * at the given level of indentation.
      */ 
-    void printDebugInfoRec(Node* root, unsigned indent) const;
+    void printDebugInfoRec(NodeRef root, unsigned indent) const;
+};
+
+/**
+ * Iterator over the keys of a ScapegoatTree. Nodes store no parent pointers,
+ * so the iterator keeps the path from the root down to its node instead, 
+ * which no scapegoat tree can make longer than its alpha-deep height allows.
+ * The path is empty past the largest key.
+ * 
+ * Incrementing or decrementing takes amortized O(1) time over a scan, and 
+ * O(log N) time in the worst case.
+ */
+class ScapegoatTree::const_iterator {
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type        = int;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = const int*;
+    using reference         = const int&;
+
+    const_iterator() = default;
+
+    reference operator*() const  { return tree->at(path.top()).key; }
+    pointer   operator->() const { return &tree->at(path.top()).key; }
+
+    const_iterator& operator++();
+    const_iterator& operator--();
+
+    const_iterator operator++(int) {
+      const_iterator old = *this;
+      ++*this;
+      return old;
+    }
+
+    const_iterator operator--(int) {
+      const_iterator old = *this;
+      --*this;
+      return old;
+    }
+
+    bool operator==(const const_iterator& other) const { return node() == other.node(); }
+    bool operator!=(const const_iterator& other) const { return node() != other.node(); }
+
+  private:
+    friend class ScapegoatTree;
+    friend class ScapegoatTree::const_reverse_iterator;
+
+    /**
+     * Paths up to this many nodes long are kept inside the iterator, which 
+     * covers trees of up to about ten million nodes for alpha up to 0.6, 
+     * and ninety thousand for alpha 0.7. Longer paths are allocated on the 
+     * heap, once per iterator made or copied.
+     */
+    static constexpr size_t kInlinePathCapacity = 32;
+
+    const ScapegoatTree* tree = nullptr;  // The tree iterated over, for --end()
+    NodeStack<Node, kInlinePathCapacity, NodeRef> path;  // From the root to the current node
+
+    const_iterator(const ScapegoatTree* tree, size_t maxDepth) 
+      : tree(tree), path(maxDepth) {}
+
+    // Returns the current node, or nullptr past the largest key.
+    NodeRef node() const { return path.empty() ? nullptr : path.top(); }
+
+    /**
+     * Pushes the given node and its descendants along its left (if toLeft) or
+     * right spine onto the path, ending at its smallest or largest key.
+     */
+    void pushSpine(NodeRef node, bool toLeft);
+};
+
+/**
+ * Iterator over the keys of a ScapegoatTree in decreasing order. Where 
+ * std::reverse_iterator would keep an iterator to the next larger key and 
+ * step back from a copy of it on every dereference, this keeps an iterator
+ * to its own key, whose path is empty past the smallest key.
+ * 
+ * Incrementing or decrementing takes amortized O(1) time over a scan, and 
+ * O(log N) time in the worst case.
+ */
+class ScapegoatTree::const_reverse_iterator {
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type        = int;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = const int*;
+    using reference         = const int&;
+
+    const_reverse_iterator() = default;
+
+    /**
+     * Constructs an iterator to the key before next, as 
+     * std::reverse_iterator(next) refers to.
+     */
+    explicit const_reverse_iterator(const_iterator next) : current(next) {
+      --current;
+    }
+
+    /**
+     * Returns an iterator to the key after this one, as 
+     * std::reverse_iterator::base does.
+     */
+    const_iterator base() const;
+
+    reference operator*() const  { return *current; }
+    pointer   operator->() const { return current.operator->(); }
+
+    const_reverse_iterator& operator++() {
+      --current;
+      return *this;
+    }
+
+    const_reverse_iterator& operator--();
+
+    const_reverse_iterator operator++(int) {
+      const_reverse_iterator old = *this;
+      ++*this;
+      return old;
+    }
+
+    const_reverse_iterator operator--(int) {
+      const_reverse_iterator old = *this;
+      --*this;
+      return old;
+    }
+
+    bool operator==(const const_reverse_iterator& other) const { return current == other.current; }
+    bool operator!=(const const_reverse_iterator& other) const { return current != other.current; }
+
+  private:
+    friend class ScapegoatTree;
+
+    const_iterator current;  // The iterator to this key, or past the smallest one
 };
@@ -0,0 +1,62 @@
+/**
+ * Measures the time to construct an integer ScapegoatTree from sorted keys,
+ * either by inserting the keys one at a time or by bulk loading them through
+ * the range constructor, for several tree sizes and alpha values.
+ *
+ * Build from the repository root with, e.g.:
+ *   g++ -O2 -I. benchmarks/bulk_load.cpp ScapegoatTree.cpp
+ */
+
+#include "ScapegoatTree.h"
+
+#include <chrono>     // for std::chrono::steady_clock
+#include <cstdio>     // for std::printf
+#include <vector>     // for the list of keys
+
+/**
+ * Runs the given tree construction a few times and returns the best observed
+ * time in milliseconds.
+ */
+template<typename Construct>
+static double timeConstruction(Construct construct) {
+  const int kRepetitions = 5;
+
+  double best = 0;
+  for (int repetition = 0; repetition < kRepetitions; repetition++) {
+    auto start = std::chrono::steady_clock::now();
+    construct();
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    if (repetition == 0 || elapsed.count() < best) best = elapsed.count();
+  }
+  return best;
+}
+
+int main() {
+  std::printf("%-8s %-10s %14s %14s %10s\n",
+              "alpha", "keys", "insert ms", "bulk load ms", "speedup");
+
+  for (size_t numKeys : { 100000, 1000000, 4000000 }) {
+    std::vector<int> keys(numKeys);
+    for (size_t i = 0; i < numKeys; i++) {
+      keys[i] = static_cast<int>(i);
+    }
+
+    for (double alpha : { 0.6, 0.75, 0.9 }) {
+      double insertLoop = timeConstruction([&] {
+        ScapegoatTree tree(alpha);
+        for (int key : keys) {
+          tree.insert(key);
+        }
+      });
+      double bulkLoad = timeConstruction([&] {
+        ScapegoatTree tree(alpha, keys.begin(), keys.end());
+      });
+
+      std::printf("%-8.2f %-10zu %14.1f %14.1f %9.1fx\n", alpha, numKeys,
+                  insertLoop, bulkLoad, insertLoop / bulkLoad);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,102 @@
+/**
+ * Counts the calls into the global allocator made per insert into an integer
+ * ScapegoatTree, for several alpha values and key orders.
+ *
+ * Build from the repository root with, e.g.:
+ *   g++ -O2 -I. benchmarks/insert_allocations.cpp ScapegoatTree.cpp
+ */
+
+#include "ScapegoatTree.h"
+
+#include <cstdio>     // for std::printf
+#include <cstdlib>    // for std::malloc, std::aligned_alloc, std::free
+#include <new>        // for std::bad_alloc, std::align_val_t
+#include <random>     // for std::mt19937
+#include <vector>     // for the list of keys
+
+static size_t allocationCount = 0;
+
+/**
+ * Counts an allocation of size bytes and makes it, aligned to the given 
+ * alignment (a power of two) if it is stricter than malloc's.
+ */
+static void* countedAllocate(std::size_t size, std::size_t alignment = 0) {
+  allocationCount++;
+  if (size == 0) size = 1;
+  void* memory;
+  if (alignment == 0) {
+    memory = std::malloc(size);
+  } else {
+    // aligned_alloc takes sizes in multiples of the alignment.
+    memory = std::aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1));
+  }
+  if (! memory) throw std::bad_alloc();
+  return memory;
+}
+
+/**
+ * Frees memory from countedAllocate. Every form of operator delete goes
+ * through here, and so does every form of operator new through 
+ * countedAllocate, so that the compiler sees matching pairs.
+ */
+static void countedRelease(void* memory) noexcept {
+  std::free(memory);
+}
+
+// Every replaceable form of operator new and delete, so that no allocation 
+// bypasses the count. The nothrow forms call these by default.
+void* operator new(std::size_t size) { return countedAllocate(size); }
+void* operator new[](std::size_t size) { return countedAllocate(size); }
+void* operator new(std::size_t size, std::align_val_t alignment) {
+  return countedAllocate(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+  return countedAllocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* memory) noexcept { countedRelease(memory); }
+void operator delete[](void* memory) noexcept { countedRelease(memory); }
+void operator delete(void* memory, std::size_t) noexcept { countedRelease(memory); }
+void operator delete[](void* memory, std::size_t) noexcept { countedRelease(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { countedRelease(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept { countedRelease(memory); }
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept {
+  countedRelease(memory);
+}
+void operator delete[](void* memory, std::size_t, std::align_val_t) noexcept {
+  countedRelease(memory);
+}
+
+/**
+ * Inserts every key into a fresh tree and returns the number of allocations
+ * made by the inserts alone.
+ */
+static size_t countAllocations(double alpha, const std::vector<int>& keys) {
+  ScapegoatTree tree(alpha);
+  size_t before = allocationCount;
+  for (int key : keys) {
+    tree.insert(key);
+  }
+  return allocationCount - before;
+}
+
+int main() {
+  const size_t kNumKeys = 1000000;
+
+  std::vector<int> sequential(kNumKeys);
+  std::vector<int> uniform(kNumKeys);
+  std::mt19937 generator(166);
+  for (size_t i = 0; i < kNumKeys; i++) {
+    sequential[i] = static_cast<int>(i);
+    uniform[i] = static_cast<int>(generator());
+  }
+
+  std::printf("%-8s %-12s %16s\n", "alpha", "keys", "allocs/insert");
+  for (double alpha : { 0.51, 0.6, 0.75, 0.9 }) {
+    std::printf("%-8.2f %-12s %16.6f\n", alpha, "sequential",
+                countAllocations(alpha, sequential) / static_cast<double>(kNumKeys));
+    std::printf("%-8.2f %-12s %16.6f\n", alpha, "uniform",
+                countAllocations(alpha, uniform) / static_cast<double>(kNumKeys));
+  }
+  return 0;
+}
@@ -0,0 +1,58 @@
+/**
+ * Measures the time per insert into an integer ScapegoatTree, for several
+ * alpha values and key orders. Sequential keys keep the insert hot path busy
+ * checking alpha-deep heights and finding scapegoats.
+ *
+ * Build from the repository root with, e.g.:
+ *   g++ -O2 -I. benchmarks/insert_throughput.cpp ScapegoatTree.cpp
+ */
+
+#include "ScapegoatTree.h"
+
+#include <chrono>     // for std::chrono::steady_clock
+#include <cstdio>     // for std::printf
+#include <random>     // for std::mt19937
+#include <vector>     // for the list of keys
+
+/**
+ * Inserts every key into a fresh tree, repeating the experiment a few times,
+ * and returns the best observed time per insert in nanoseconds.
+ */
+static double timeInserts(double alpha, const std::vector<int>& keys) {
+  const int kRepetitions = 5;
+
+  double best = 0;
+  for (int repetition = 0; repetition < kRepetitions; repetition++) {
+    ScapegoatTree tree(alpha);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int key : keys) {
+      tree.insert(key);
+    }
+    std::chrono::duration<double, std::nano> elapsed = 
+        std::chrono::steady_clock::now() - start;
+
+    double perInsert = elapsed.count() / keys.size();
+    if (repetition == 0 || perInsert < best) best = perInsert;
+  }
+  return best;
+}
+
+int main() {
+  const size_t kNumKeys = 1000000;
+
+  std::vector<int> sequential(kNumKeys);
+  std::vector<int> uniform(kNumKeys);
+  std::mt19937 generator(166);
+  for (size_t i = 0; i < kNumKeys; i++) {
+    sequential[i] = static_cast<int>(i);
+    uniform[i] = static_cast<int>(generator());
+  }
+
+  std::printf("%-8s %-12s %16s\n", "alpha", "keys", "ns/insert");
+  for (double alpha : { 0.51, 0.6, 0.75, 0.9 }) {
+    std::printf("%-8.2f %-12s %16.1f\n", alpha, "sequential", timeInserts(alpha, sequential));
+    std::printf("%-8.2f %-12s %16.1f\n", alpha, "uniform", timeInserts(alpha, uniform));
+  }
+  return 0;
+}
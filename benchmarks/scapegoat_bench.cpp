@@ -0,0 +1,547 @@
+/**
+ * Benchmark suite for the integer ScapegoatTree and BlockScapegoatTree, with
+ * std::set as a baseline.
+ *
+ * Measures the time per operation of these workloads, each over N keys drawn
+ * from a key distribution:
+ *   insert        inserting the keys into an empty tree
+ *   search        looking up the keys in a tree holding them
+ *   remove        removing the keys from a tree holding them
+ *   mixed         50% searches, 25% inserts and 25% removals of N more keys
+ *                 from the same distribution, in a tree holding the keys
+ *   insert_pause  the longest single insert while inserting the keys
+ *   remove_pause  the longest single removal while removing them again
+ * The pause workloads show the cost of rebuilding: a partial rebuild after
+ * a deep insertion, and a whole-tree rebuild once removals have shrunk the
+ * tree to alpha times its size.
+ *
+ * Key distributions:
+ *   uniform       random 32-bit keys
+ *   sequential    0, 1, 2, ..., in increasing order
+ *   zipfian       Zipf-distributed ranks (theta = 0.99) among N keys, scattered
+ *                 over the key space, so that a few keys come up very often
+ *   adversarial   sorted keys taken alternately from both ends, 0, N - 1, 1,
+ *                 N - 2, ..., so that every insertion lands at the bottom of
+ *                 the zigzag path the previous ones made
+ *
+ * Every workload runs for tree sizes N of 1e3, 1e4, ... up to --max_size,
+ * on both trees for each alpha in --alphas, and once for std::set. Each measurement is the
+ * best of --repetitions runs. Results are printed as a table, and written as
+ * JSON in Google Benchmark's format to the file given by --benchmark_out, so
+ * that runs can be compared with Google Benchmark's tools/compare.py.
+ *
+ * Flags (defaults in brackets):
+ *   --min_size=N           smallest tree size [1000]
+ *   --max_size=N           largest tree size, up to 1e8 [1000000]
+ *   --alphas=A,B,...       alpha values [0.51,0.6,0.75,0.9,0.99]
+ *   --repetitions=N        runs per measurement [3]
+ *   --rebuild_budget=N     rebuild work per operation, see setRebuildBudget,
+ *                          which needs SCAPEGOAT_TRACK_SUBTREE_SIZES
+ *                          [0, rebuilding at once]
+ *   --benchmark_filter=RE  only run benchmarks whose name matches RE [all]
+ *   --benchmark_out=FILE   where to write JSON results [none]
+ *
+ * Benchmark names read workload/tree/distribution/size, such as
+ * insert/alpha:0.75/uniform/1000000, insert/block:0.75/uniform/1000000 or
+ * insert/std_set/uniform/1000000. Run only the block trees with, e.g.,
+ * --benchmark_filter=/block:
+ * Names do not depend on --rebuild_budget, so that runs with and without
+ * incremental rebuilding can be compared directly.
+ *
+ * Build from the repository root with, e.g.:
+ *   cmake -S . -B build && cmake --build build --target scapegoat_bench
+ *   build/scapegoat_bench --max_size=10000000 --benchmark_out=results.json
+ */
+
+#include "BlockScapegoatTree.h"
+#include "ScapegoatTree.h"
+
+#include <algorithm>  // for std::max, std::min
+#include <chrono>     // for std::chrono::steady_clock
+#include <cmath>      // for std::pow
+#include <cstdint>    // for std::uint32_t
+#include <cstdio>     // for std::printf, std::fprintf, std::FILE
+#include <cstdlib>    // for std::strtod, std::strtoull
+#include <ctime>      // for std::clock, std::time, std::strftime
+#include <memory>     // for std::unique_ptr
+#include <random>     // for std::mt19937, std::uniform_real_distribution
+#include <regex>      // for std::regex, std::regex_search
+#include <set>        // for the std::set baseline
+#include <string>     // for std::string, std::to_string
+#include <thread>     // for std::thread::hardware_concurrency
+#include <utility>    // for std::pair
+#include <vector>     // for lists of keys and results
+
+enum class Distribution { kUniform, kSequential, kZipfian, kAdversarial };
+
+static const Distribution kDistributions[] = {
+  Distribution::kUniform, Distribution::kSequential,
+  Distribution::kZipfian, Distribution::kAdversarial
+};
+
+static const char* distributionName(Distribution distribution) {
+  switch (distribution) {
+    case Distribution::kUniform:     return "uniform";
+    case Distribution::kSequential:  return "sequential";
+    case Distribution::kZipfian:     return "zipfian";
+    case Distribution::kAdversarial: return "adversarial";
+  }
+  return "";
+}
+
+/**
+ * Draws ranks in [0, n) with probability proportional to 1 / (rank + 1)^theta,
+ * in O(1) time per rank after O(n) setup, following "Quickly Generating
+ * Billion-Record Synthetic Databases" by Gray et al., 1994.
+ */
+class ZipfianGenerator {
+  public:
+    ZipfianGenerator(size_t n, double theta) : n(n), theta(theta) {
+      zetaN = zeta(n);
+      exponent = 1 / (1 - theta);
+      eta = (1 - std::pow(2.0 / n, 1 - theta)) / (1 - zeta(2) / zetaN);
+    }
+
+    template<typename Generator>
+    size_t operator()(Generator& generator) const {
+      double u = std::uniform_real_distribution<double>(0, 1)(generator);
+      double uz = u * zetaN;
+      if (uz < 1) return 0;
+      if (uz < 1 + std::pow(0.5, theta)) return 1;
+      size_t rank = static_cast<size_t>(n * std::pow(eta * u - eta + 1, exponent));
+      return std::min(rank, n - 1);
+    }
+
+  private:
+    size_t n;
+    double theta;
+    double zetaN;     // zeta(n)
+    double exponent;  // 1 / (1 - theta)
+    double eta;
+
+    // Returns the sum of 1 / i^theta for i from 1 to count.
+    double zeta(size_t count) const {
+      double sum = 0;
+      for (size_t i = 1; i <= count; i++) {
+        sum += 1 / std::pow(static_cast<double>(i), theta);
+      }
+      return sum;
+    }
+};
+
+/**
+ * Returns n keys drawn from the given distribution. Distinct zipfian ranks
+ * map to distinct keys, spread over the key space by a multiplicative hash.
+ */
+static std::vector<int> makeKeys(Distribution distribution, size_t n, unsigned seed) {
+  std::vector<int> keys(n);
+  std::mt19937 generator(seed);
+  switch (distribution) {
+    case Distribution::kUniform:
+      for (int& key : keys) key = static_cast<int>(generator());
+      break;
+    case Distribution::kSequential:
+      for (size_t i = 0; i < n; i++) keys[i] = static_cast<int>(i);
+      break;
+    case Distribution::kZipfian: {
+      ZipfianGenerator ranks(n, 0.99);
+      for (int& key : keys) {
+        key = static_cast<int>(static_cast<std::uint32_t>(ranks(generator)) * 2654435761u);
+      }
+      break;
+    }
+    case Distribution::kAdversarial:
+      for (size_t i = 0; i < n; i++) {
+        keys[i] = static_cast<int>(i % 2 == 0 ? i / 2 : n - 1 - i / 2);
+      }
+      break;
+  }
+  return keys;
+}
+
+/**
+ * The std::set baseline, with the same interface as ScapegoatTree.
+ */
+class SetTree {
+  public:
+    bool insert(int key)       { return keys.insert(key).second; }
+    bool search(int key) const { return keys.count(key) != 0; }
+    bool remove(int key)       { return keys.erase(key) != 0; }
+
+  private:
+    std::set<int> keys;
+};
+
+/**
+ * The time taken by a workload, per operation.
+ */
+struct Measurement {
+  double realTime;  // Wall-clock nanoseconds
+  double cpuTime;   // Processor nanoseconds
+};
+
+/**
+ * Stopwatch for wall-clock and processor time.
+ */
+class Timer {
+  public:
+    Timer() : realStart(std::chrono::steady_clock::now()), cpuStart(std::clock()) {}
+
+    // Returns the time since the timer started, divided by the given count.
+    Measurement elapsed(size_t count) const {
+      std::chrono::duration<double, std::nano> real =
+          std::chrono::steady_clock::now() - realStart;
+      double cpu = 1e9 * static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+      return { real.count() / count, cpu / count };
+    }
+
+  private:
+    std::chrono::steady_clock::time_point realStart;
+    std::clock_t cpuStart;
+};
+
+// Keeps the results of searches alive, so that they are not optimized away.
+static volatile size_t searchSink;
+
+/**
+ * Workloads. Each runs once on trees made by makeTree and returns the time
+ * per operation (or the longest operation, for pauses).
+ */
+template<typename Tree, typename MakeTree>
+static Measurement runInsert(MakeTree makeTree, const std::vector<int>& keys) {
+  std::unique_ptr<Tree> tree = makeTree();
+  Timer timer;
+  for (int key : keys) tree->insert(key);
+  return timer.elapsed(keys.size());
+}
+
+template<typename Tree, typename MakeTree>
+static Measurement runSearch(MakeTree makeTree, const std::vector<int>& keys) {
+  std::unique_ptr<Tree> tree = makeTree();
+  for (int key : keys) tree->insert(key);
+
+  Timer timer;
+  size_t found = 0;
+  for (int key : keys) found += tree->search(key);
+  Measurement measurement = timer.elapsed(keys.size());
+  searchSink = found;
+  return measurement;
+}
+
+template<typename Tree, typename MakeTree>
+static Measurement runRemove(MakeTree makeTree, const std::vector<int>& keys) {
+  std::unique_ptr<Tree> tree = makeTree();
+  for (int key : keys) tree->insert(key);
+
+  Timer timer;
+  for (int key : keys) tree->remove(key);
+  return timer.elapsed(keys.size());
+}
+
+template<typename Tree, typename MakeTree>
+static Measurement runMixed(MakeTree makeTree, const std::vector<int>& keys,
+                           const std::vector<int>& opKeys) {
+  std::unique_ptr<Tree> tree = makeTree();
+  for (int key : keys) tree->insert(key);
+
+  // Decide each operation ahead of time, so that drawing it is not timed.
+  std::mt19937 generator(166);
+  std::vector<unsigned char> ops(opKeys.size());
+  for (unsigned char& op : ops) op = generator() % 4;
+
+  Timer timer;
+  size_t found = 0;
+  for (size_t i = 0; i < opKeys.size(); i++) {
+    if      (ops[i] <= 1) found += tree->search(opKeys[i]);
+    else if (ops[i] == 2) tree->insert(opKeys[i]);
+    else /*  ops[i] == 3 */ tree->remove(opKeys[i]);
+  }
+  Measurement measurement = timer.elapsed(opKeys.size());
+  searchSink = found;
+  return measurement;
+}
+
+// Returns the wall-clock nanoseconds since the given time.
+static double pauseSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Times every insert of the keys, then every removal of them, and returns the
+ * longest of each. Reading the processor time around every operation would 
+ * cost a system call each, so pauses report wall-clock time as both times.
+ */
+template<typename Tree, typename MakeTree>
+static std::pair<Measurement, Measurement> runPauses(MakeTree makeTree,
+                                                     const std::vector<int>& keys) {
+  std::unique_ptr<Tree> tree = makeTree();
+  Measurement longestInsert = { 0, 0 };
+  for (int key : keys) {
+    auto start = std::chrono::steady_clock::now();
+    tree->insert(key);
+    double pause = pauseSince(start);
+    if (pause > longestInsert.realTime) longestInsert = { pause, pause };
+  }
+
+  Measurement longestRemove = { 0, 0 };
+  for (int key : keys) {
+    auto start = std::chrono::steady_clock::now();
+    tree->remove(key);
+    double pause = pauseSince(start);
+    if (pause > longestRemove.realTime) longestRemove = { pause, pause };
+  }
+  return { longestInsert, longestRemove };
+}
+
+/**
+ * Command-line settings. See the flags above.
+ */
+struct Options {
+  size_t minSize = 1000;
+  size_t maxSize = 1000000;
+  std::vector<double> alphas = { 0.51, 0.6, 0.75, 0.9, 0.99 };
+  int repetitions = 3;
+  size_t rebuildBudget = 0;
+  std::string filter;
+  std::string outputPath;
+};
+
+/**
+ * A finished benchmark, as reported in the JSON output.
+ */
+struct Result {
+  std::string name;
+  size_t iterations;  // The number of operations timed
+  Measurement time;
+  double alpha;       // 0 for std::set
+  size_t size;
+};
+
+/**
+ * Runs benchmarks and collects their results.
+ */
+class Suite {
+  public:
+    explicit Suite(const Options& options)
+      : options(options), filter(options.filter) {}
+
+    /**
+     * Runs every workload on trees of the given keys, made by makeTree,
+     * labeled with the given tree name and alpha (0 for std::set).
+     */
+    template<typename Tree, typename MakeTree>
+    void runWorkloads(const std::string& treeName, double alpha, MakeTree makeTree,
+                      Distribution distribution, const std::vector<int>& keys,
+                      const std::vector<int>& opKeys) {
+      std::string suffix = "/" + treeName + "/" + distributionName(distribution)
+                         + "/" + std::to_string(keys.size());
+      size_t n = keys.size();
+
+      measure("insert" + suffix, n, alpha, [&] { return runInsert<Tree>(makeTree, keys); });
+      measure("search" + suffix, n, alpha, [&] { return runSearch<Tree>(makeTree, keys); });
+      measure("remove" + suffix, n, alpha, [&] { return runRemove<Tree>(makeTree, keys); });
+      measure("mixed" + suffix, n, alpha,
+              [&] { return runMixed<Tree>(makeTree, keys, opKeys); });
+
+      // Both pauses come out of the same runs.
+      bool insertPause = selected("insert_pause" + suffix);
+      bool removePause = selected("remove_pause" + suffix);
+      if (insertPause || removePause) {
+        std::pair<Measurement, Measurement> best;
+        for (int repetition = 0; repetition < options.repetitions; repetition++) {
+          std::pair<Measurement, Measurement> pauses = runPauses<Tree>(makeTree, keys);
+          if (repetition == 0 || pauses.first.realTime < best.first.realTime) {
+            best.first = pauses.first;
+          }
+          if (repetition == 0 || pauses.second.realTime < best.second.realTime) {
+            best.second = pauses.second;
+          }
+        }
+        if (insertPause) report({ "insert_pause" + suffix, 1, best.first, alpha, n });
+        if (removePause) report({ "remove_pause" + suffix, 1, best.second, alpha, n });
+      }
+    }
+
+    /**
+     * Writes the results as JSON in Google Benchmark's format. Returns false
+     * if the file cannot be written.
+     */
+    bool writeJson(const std::string& path, const char* executable) const;
+
+  private:
+    const Options& options;
+    std::regex filter;
+    std::vector<Result> results;
+
+    bool selected(const std::string& name) const {
+      return std::regex_search(name, filter);
+    }
+
+    /**
+     * Runs the given workload the configured number of times, if selected,
+     * and reports the best time per operation.
+     */
+    template<typename Workload>
+    void measure(const std::string& name, size_t iterations, double alpha,
+                 Workload workload) {
+      if (! selected(name)) return;
+
+      Measurement best = { 0, 0 };
+      for (int repetition = 0; repetition < options.repetitions; repetition++) {
+        Measurement measurement = workload();
+        if (repetition == 0 || measurement.realTime < best.realTime) best = measurement;
+      }
+      report({ name, iterations, best, alpha, iterations });
+    }
+
+    void report(const Result& result) {
+      std::printf("%-48s %14.1f %14.1f\n",
+                  result.name.c_str(), result.time.realTime, result.time.cpuTime);
+      std::fflush(stdout);
+      results.push_back(result);
+    }
+};
+
+bool Suite::writeJson(const std::string& path, const char* executable) const {
+  std::FILE* file = std::fopen(path.c_str(), "w");
+  if (! file) return false;
+
+  char date[64];
+  std::time_t now = std::time(nullptr);
+  std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", std::localtime(&now));
+#ifdef NDEBUG
+  const char* buildType = "release";
+#else
+  const char* buildType = "debug";
+#endif
+
+  std::fprintf(file, "{\n  \"context\": {\n");
+  std::fprintf(file, "    \"date\": \"%s\",\n", date);
+  std::fprintf(file, "    \"executable\": \"%s\",\n", executable);
+  std::fprintf(file, "    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+  std::fprintf(file, "    \"library_build_type\": \"%s\"\n", buildType);
+  std::fprintf(file, "  },\n  \"benchmarks\": [");
+
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result& result = results[i];
+    std::fprintf(file, "%s\n    {\n", i == 0 ? "" : ",");
+    std::fprintf(file, "      \"name\": \"%s\",\n", result.name.c_str());
+    std::fprintf(file, "      \"run_name\": \"%s\",\n", result.name.c_str());
+    std::fprintf(file, "      \"run_type\": \"iteration\",\n");
+    std::fprintf(file, "      \"repetitions\": %d,\n", options.repetitions);
+    std::fprintf(file, "      \"iterations\": %zu,\n", result.iterations);
+    std::fprintf(file, "      \"real_time\": %.3f,\n", result.time.realTime);
+    std::fprintf(file, "      \"cpu_time\": %.3f,\n", result.time.cpuTime);
+    std::fprintf(file, "      \"time_unit\": \"ns\",\n");
+    std::fprintf(file, "      \"alpha\": %.2f,\n", result.alpha);
+    std::fprintf(file, "      \"size\": %zu\n", result.size);
+    std::fprintf(file, "    }");
+  }
+  std::fprintf(file, "\n  ]\n}\n");
+  return std::fclose(file) == 0;
+}
+
+/**
+ * Returns the value of the given flag if the argument sets it, or nullptr.
+ */
+static const char* flagValue(const char* argument, const std::string& flag) {
+  std::string prefix = "--" + flag + "=";
+  return std::string(argument).compare(0, prefix.size(), prefix) == 0
+      ? argument + prefix.size() : nullptr;
+}
+
+/**
+ * Parses the command line into options. Returns false on an unknown flag.
+ */
+static bool parseOptions(int argc, char** argv, Options& options) {
+  for (int i = 1; i < argc; i++) {
+    const char* value;
+    if ((value = flagValue(argv[i], "min_size"))) {
+      options.minSize = static_cast<size_t>(std::strtod(value, nullptr));
+    } else if ((value = flagValue(argv[i], "max_size"))) {
+      options.maxSize = static_cast<size_t>(std::strtod(value, nullptr));
+    } else if ((value = flagValue(argv[i], "alphas"))) {
+      options.alphas.clear();
+      std::string list = value;
+      for (size_t start = 0; start < list.size(); ) {
+        size_t end = std::min(list.find(',', start), list.size());
+        options.alphas.push_back(std::strtod(list.substr(start, end - start).c_str(), nullptr));
+        start = end + 1;
+      }
+    } else if ((value = flagValue(argv[i], "repetitions"))) {
+      options.repetitions = std::max(1, static_cast<int>(std::strtoull(value, nullptr, 10)));
+    } else if ((value = flagValue(argv[i], "rebuild_budget"))) {
+      options.rebuildBudget = static_cast<size_t>(std::strtoull(value, nullptr, 10));
+    } else if ((value = flagValue(argv[i], "benchmark_filter"))) {
+      options.filter = value;
+    } else if ((value = flagValue(argv[i], "benchmark_out"))) {
+      options.outputPath = value;
+    } else {
+      std::fprintf(stderr, "Unknown flag %s. See benchmarks/scapegoat_bench.cpp.\n", argv[i]);
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  Options options;
+  if (! parseOptions(argc, argv, options)) return 1;
+  if (options.rebuildBudget == 1) {
+    std::fprintf(stderr, "--rebuild_budget must be 0 or at least 2.\n");
+    return 1;
+  }
+#ifndef SCAPEGOAT_TRACK_SUBTREE_SIZES
+  if (options.rebuildBudget > 0) {
+    std::fprintf(stderr, "--rebuild_budget needs SCAPEGOAT_TRACK_SUBTREE_SIZES.\n");
+    return 1;
+  }
+#endif
+
+  Suite suite(options);
+  std::printf("%-48s %14s %14s\n", "benchmark", "real ns/op", "cpu ns/op");
+
+  for (size_t size = std::max<size_t>(options.minSize, 1); size <= options.maxSize;
+       size *= 10) {
+    for (Distribution distribution : kDistributions) {
+      std::vector<int> keys = makeKeys(distribution, size, 166);
+      std::vector<int> opKeys = makeKeys(distribution, size, 167);
+
+      suite.runWorkloads<SetTree>("std_set", 0,
+          [] { return std::unique_ptr<SetTree>(new SetTree()); },
+          distribution, keys, opKeys);
+
+      for (double alpha : options.alphas) {
+        char treeName[32];
+        std::snprintf(treeName, sizeof(treeName), "alpha:%.2f", alpha);
+        size_t budget = options.rebuildBudget;
+        suite.runWorkloads<ScapegoatTree>(treeName, alpha,
+            [alpha, budget] {
+              std::unique_ptr<ScapegoatTree> tree(new ScapegoatTree(alpha));
+#ifdef SCAPEGOAT_TRACK_SUBTREE_SIZES
+              tree->setRebuildBudget(budget);
+#else
+              (void) budget;
+#endif
+              return tree;
+            },
+            distribution, keys, opKeys);
+
+        // Block trees rebuild at once, whatever --rebuild_budget.
+        std::snprintf(treeName, sizeof(treeName), "block:%.2f", alpha);
+        suite.runWorkloads<BlockScapegoatTree>(treeName, alpha,
+            [alpha] {
+              return std::unique_ptr<BlockScapegoatTree>(new BlockScapegoatTree(alpha));
+            },
+            distribution, keys, opKeys);
+      }
+    }
+  }
+
+  if (! options.outputPath.empty() && ! suite.writeJson(options.outputPath, argv[0])) {
+    std::fprintf(stderr, "Could not write %s\n", options.outputPath.c_str());
+    return 1;
+  }
+  return 0;
+}
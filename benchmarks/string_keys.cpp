@@ -0,0 +1,90 @@
+/**
+ * Measures the time per insert and per search in a generic ScapegoatTree of
+ * long string keys sharing a common prefix, comparing keys either with a
+ * less-than-only comparator (two comparisons per node) or with std::less,
+ * which the tree turns into a single three-way std::string::compare per node.
+ *
+ * Build from the repository root with, e.g.:
+ *   g++ -O2 -std=c++17 -I. benchmarks/string_keys.cpp
+ */
+
+#include "GenericScapegoatTree.h"
+
+#include <chrono>     // for std::chrono::steady_clock
+#include <cstdio>     // for std::printf
+#include <random>     // for std::mt19937
+#include <string>     // for std::string, std::to_string
+#include <vector>     // for the list of keys
+
+/**
+ * Compares strings with < only, so the tree needs two comparisons to tell
+ * that two keys are equal.
+ */
+struct LessOnly {
+  bool operator()(const std::string& lhs, const std::string& rhs) const {
+    return lhs < rhs;
+  }
+};
+
+struct Timings {
+  double insert;  // Best observed time per insert in nanoseconds
+  double search;  // Best observed time per search in nanoseconds
+};
+
+/**
+ * Inserts every key into a fresh tree, then searches for every key,
+ * repeating the experiment a few times, and returns the best observed times.
+ */
+template<typename Compare>
+static Timings timeOperations(double alpha, const std::vector<std::string>& keys) {
+  const int kRepetitions = 5;
+
+  Timings best = { 0, 0 };
+  for (int repetition = 0; repetition < kRepetitions; repetition++) {
+    ScapegoatTree<std::string, Compare> tree(alpha);
+
+    auto start = std::chrono::steady_clock::now();
+    for (const std::string& key : keys) {
+      tree.insert(key);
+    }
+    auto inserted = std::chrono::steady_clock::now();
+    size_t found = 0;
+    for (const std::string& key : keys) {
+      found += tree.search(key);
+    }
+    auto searched = std::chrono::steady_clock::now();
+    if (found != keys.size()) std::printf("search failed!\n");
+
+    std::chrono::duration<double, std::nano> insertTime = inserted - start;
+    std::chrono::duration<double, std::nano> searchTime = searched - inserted;
+    double perInsert = insertTime.count() / keys.size();
+    double perSearch = searchTime.count() / keys.size();
+    if (repetition == 0 || perInsert < best.insert) best.insert = perInsert;
+    if (repetition == 0 || perSearch < best.search) best.search = perSearch;
+  }
+  return best;
+}
+
+int main() {
+  const size_t kNumKeys = 200000;
+
+  // Keys share a long prefix, as URLs or file paths do, so that every
+  // comparison has to scan past it.
+  std::vector<std::string> keys(kNumKeys);
+  std::mt19937 generator(166);
+  const std::string prefix = "https://example.com/some/long/shared/path/";
+  for (size_t i = 0; i < kNumKeys; i++) {
+    keys[i] = prefix + std::to_string(generator());
+  }
+
+  std::printf("%-8s %-12s %14s %14s\n", "alpha", "comparator", "ns/insert", "ns/search");
+  for (double alpha : { 0.6, 0.75, 0.9 }) {
+    Timings lessOnly = timeOperations<LessOnly>(alpha, keys);
+    Timings threeWay = timeOperations<std::less<std::string>>(alpha, keys);
+    std::printf("%-8.2f %-12s %14.1f %14.1f\n", alpha, "less only",
+                lessOnly.insert, lessOnly.search);
+    std::printf("%-8.2f %-12s %14.1f %14.1f\n", alpha, "three-way",
+                threeWay.insert, threeWay.search);
+  }
+  return 0;
+}
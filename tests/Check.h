@@ -0,0 +1,32 @@
+/**
+ * Check.h provides the one assertion macro the tests use. Unlike assert, 
+ * CHECK stays on in release builds and keeps going after a failure, so that
+ * a test reports every failed check before exiting with a nonzero status.
+ *
+ * Authors: Ryan Guan (rzgn) and Tyler Packard (TPackard), 2021
+ */
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <cstdio>   // for std::fprintf
+
+// The number of failed checks so far in this test.
+inline int checkFailures = 0;
+
+#define CHECK(condition)                                                   \
+  do {                                                                     \
+    if (! (condition)) {                                                   \
+      std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n",                    \
+                   __FILE__, __LINE__, #condition);                        \
+      checkFailures++;                                                     \
+    }                                                                      \
+  } while (false)
+
+// Returns the exit status of a test: nonzero if any check failed.
+inline int checkResult() {
+  if (checkFailures > 0) std::fprintf(stderr, "%d checks failed\n", checkFailures);
+  return checkFailures > 0 ? 1 : 0;
+}
+
+#endif // CHECK_H
@@ -0,0 +1,56 @@
+/**
+ * Tests that AlphaDeepHeightTable gives exactly the alpha-deep heights of
+ * the floating point formula the tree used before it, floor(log_{1/alpha}
+ * (size)), for every small size and for the sizes around each threshold.
+ */
+
+#include <cmath>    // for floor, log, pow
+#include <cstddef>  // for std::size_t
+#include <cstdint>  // for SIZE_MAX
+
+#include "AlphaDeepHeightTable.h"
+#include "Check.h"
+
+/**
+ * Returns the alpha-deep height of a subtree of given size, by the formula.
+ */
+static size_t formulaHeight(double alpha, size_t size) {
+  return static_cast<size_t>(floor(log(size) / log(1 / alpha)));
+}
+
+/**
+ * Checks the table's height and exceeds against the formula for one size.
+ */
+static void checkSize(const AlphaDeepHeightTable& table, double alpha, size_t size) {
+  size_t height = formulaHeight(alpha, size);
+  CHECK(table.height(size) == height);
+  CHECK(! table.exceeds(height, size));
+  CHECK(table.exceeds(height + 1, size));
+}
+
+int main() {
+  for (double alpha : { 0.501, 0.55, 0.6, 2.0 / 3, 0.7, 0.75, 0.9, 0.99 }) {
+    AlphaDeepHeightTable table(alpha);
+
+    // Covering grows the table as trees do, a size at a time.
+    for (size_t size = 1; size <= (1 << 16); size++) {
+      table.cover(size);
+      checkSize(table, alpha, size);
+    }
+
+    // Larger sizes are only checked around where the height changes.
+    table.cover(SIZE_MAX);
+    for (size_t height = 1; formulaHeight(alpha, SIZE_MAX) >= height; height++) {
+      double estimate = pow(1 / alpha, static_cast<double>(height));
+      if (estimate < (1 << 16) || estimate > 0x1p63) continue;
+
+      size_t around = static_cast<size_t>(estimate);
+      for (size_t size = around - 4; size <= around + 4; size++) {
+        checkSize(table, alpha, size);
+      }
+    }
+    checkSize(table, alpha, SIZE_MAX);
+  }
+
+  return checkResult();
+}
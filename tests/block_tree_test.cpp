@@ -0,0 +1,150 @@
+/**
+ * Tests BlockScapegoatTree against a std::set, under sequential, reverse and
+ * random insertions and removals, and under removals leaving blocks sparse
+ * enough to rebuild the whole tree, checking every key in range and the
+ * tree's balance along the way.
+ */
+
+#include <algorithm>  // for std::shuffle
+#include <random>     // for std::mt19937
+#include <set>        // for the reference set of keys
+#include <stdexcept>  // for std::invalid_argument
+#include <vector>     // for key orders
+
+#include "Check.h"
+#include "BlockScapegoatTree.h"
+
+// Keys are drawn from [0, kKeyRange), so that insertions and removals meet.
+static constexpr int kKeyRange = 5000;
+
+/**
+ * Checks that the tree is valid and balanced, and holds exactly the
+ * reference keys among the keys in [-1, kKeyRange].
+ */
+static void checkKeys(const BlockScapegoatTree& tree, const std::set<int>& reference) {
+  CHECK(tree.verify());
+  for (int key = -1; key <= kKeyRange; key++) {
+    CHECK(tree.search(key) == (reference.count(key) > 0));
+  }
+}
+
+/**
+ * Inserts the keys in the given order, then removes them in the other given
+ * order, checking the tree against a std::set as it goes.
+ */
+static void checkOrders(double alpha, const std::vector<int>& insertions,
+                        const std::vector<int>& removals) {
+  BlockScapegoatTree tree(alpha);
+  std::set<int> reference;
+
+  for (size_t i = 0; i < insertions.size(); i++) {
+    int key = insertions[i];
+    CHECK(tree.insert(key) == reference.insert(key).second);
+    if (i % 997 == 0) checkKeys(tree, reference);
+  }
+  checkKeys(tree, reference);
+
+  // Inserting a key already present changes nothing.
+  if (! insertions.empty()) {
+    CHECK(! tree.insert(insertions.front()));
+    CHECK(! tree.insert(insertions.back()));
+  }
+
+  for (size_t i = 0; i < removals.size(); i++) {
+    int key = removals[i];
+    CHECK(tree.remove(key) == (reference.erase(key) > 0));
+    if (i % 997 == 0) checkKeys(tree, reference);
+  }
+  checkKeys(tree, reference);
+}
+
+/**
+ * Runs random insertions and removals, mostly removals once the tree has
+ * grown, so that it keeps shrinking and growing back.
+ */
+static void checkRemoveHeavy(double alpha, unsigned seed) {
+  std::mt19937 random(seed);
+  BlockScapegoatTree tree(alpha);
+  std::set<int> reference;
+
+  for (int op = 0; op < 60000; op++) {
+    int key = random() % kKeyRange;
+    bool removing = (op / 10000) % 2 == 1 ? random() % 4 != 0 : random() % 4 == 0;
+    if (removing) {
+      CHECK(tree.remove(key) == (reference.erase(key) > 0));
+    } else {
+      CHECK(tree.insert(key) == reference.insert(key).second);
+    }
+    if (op % 4999 == 0) checkKeys(tree, reference);
+  }
+  checkKeys(tree, reference);
+}
+
+/**
+ * Removes three keys out of every four from a tree of consecutive keys,
+ * which leaves most blocks holding a key or two: the whole tree is rebuilt
+ * once blocks hold less than a quarter of their capacity on average, even
+ * though few nodes go.
+ */
+static void checkSparse(double alpha) {
+  BlockScapegoatTree tree(alpha);
+  std::set<int> reference;
+  for (int key = 0; key < kKeyRange; key++) {
+    tree.insert(key);
+    reference.insert(key);
+  }
+
+  for (int key = 0; key < kKeyRange; key++) {
+    if (key % 4 == 0) continue;
+    CHECK(tree.remove(key));
+    reference.erase(key);
+    if (key % 499 == 0) checkKeys(tree, reference);
+  }
+  checkKeys(tree, reference);
+
+  // The tree carries on as usual after repacking.
+  for (int key = 1; key < kKeyRange; key += 4) {
+    CHECK(tree.insert(key));
+    reference.insert(key);
+  }
+  checkKeys(tree, reference);
+
+  tree.clear();
+  reference.clear();
+  checkKeys(tree, reference);
+  CHECK(! tree.remove(0));
+  CHECK(tree.insert(0));
+}
+
+int main() {
+  std::vector<int> ascending;
+  for (int key = 0; key < kKeyRange; key++) ascending.push_back(key);
+  std::vector<int> descending(ascending.rbegin(), ascending.rend());
+  std::vector<int> shuffled = ascending;
+  std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937(166));
+
+  unsigned seed = 0;
+  for (double alpha : { 0.55, 0.7, 0.9 }) {
+    checkOrders(alpha, ascending, ascending);
+    checkOrders(alpha, ascending, descending);
+    checkOrders(alpha, descending, ascending);
+    checkOrders(alpha, descending, shuffled);
+    checkOrders(alpha, shuffled, shuffled);
+    checkOrders(alpha, shuffled, descending);
+    checkRemoveHeavy(alpha, seed++);
+    checkSparse(alpha);
+  }
+
+  // Alpha must lie within (0.5, 1).
+  for (double alpha : { 0.5, 1.0 }) {
+    bool threw = false;
+    try {
+      BlockScapegoatTree tree(alpha);
+    } catch (const std::invalid_argument&) {
+      threw = true;
+    }
+    CHECK(threw);
+  }
+
+  return checkResult();
+}
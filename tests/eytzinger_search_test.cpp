@@ -0,0 +1,122 @@
+/**
+ * Tests the Eytzinger search mode of the integer tree (see
+ * setEytzingerSearch) against a std::set: searches right after insertions
+ * and removals, before the array is refreshed, after assign and clear, after
+ * toggling the mode on a tree holding keys, and at every size up to a few
+ * hundred keys, where the array's last cache line is only partly filled.
+ * Configure with SCAPEGOAT_SANITIZE to run it under AddressSanitizer.
+ *
+ * CMake builds this test once for every compile-time variant of the tree.
+ */
+
+#include <cstddef>  // for std::size_t
+#include <random>   // for std::mt19937
+#include <set>      // for the reference set of keys
+#include <vector>   // for assigned keys
+
+#include "Check.h"
+#include "ScapegoatTree.h"
+
+// Keys are even, and drawn from [0, 2 * kKeyCount), so that every odd value
+// lies between two keys or beyond them.
+static constexpr int kKeyCount = 2000;
+
+/**
+ * Checks that search agrees with the reference for every value from below
+ * the smallest possible key to above the largest one.
+ */
+static void checkSearch(const ScapegoatTree& tree, const std::set<int>& reference) {
+  for (int value = -3; value <= 2 * kKeyCount + 3; value++) {
+    CHECK(tree.search(value) == (reference.count(value) > 0));
+  }
+}
+
+/**
+ * Builds trees of every size up to a few hundred keys, and some larger
+ * ones, turning the mode on once the keys are in, and checks searches.
+ */
+static void checkSizes() {
+  std::vector<size_t> sizes;
+  for (size_t size = 0; size <= 300; size++) sizes.push_back(size);
+  for (size_t size : { 1023, 1024, 1025, 1999, 2000 }) sizes.push_back(size);
+
+  for (size_t size : sizes) {
+    ScapegoatTree tree(0.7);
+    std::set<int> reference;
+    for (size_t i = 0; i < size; i++) {
+      // 7919 is prime, so this visits every index once.
+      int key = static_cast<int>(2 * ((i * 7919) % size));
+      tree.insert(key);
+      reference.insert(key);
+    }
+    tree.setEytzingerSearch(true);
+    checkSearch(tree, reference);
+  }
+}
+
+/**
+ * Runs random insertions and removals in Eytzinger search mode, each
+ * followed by searches for the changed key and its neighbors, which must
+ * see the change even though the array is stale until the next rebuild of
+ * the whole tree.
+ */
+static void checkChanges(ScapegoatTree& tree, std::set<int>& reference, unsigned seed) {
+  std::mt19937 random(seed);
+  for (int op = 0; op < 20000; op++) {
+    int key = 2 * static_cast<int>(random() % kKeyCount);
+    if (random() % 2) {
+      CHECK(tree.insert(key) == reference.insert(key).second);
+    } else {
+      CHECK(tree.remove(key) == (reference.erase(key) > 0));
+    }
+    for (int probe = key - 3; probe <= key + 3; probe++) {
+      CHECK(tree.search(probe) == (reference.count(probe) > 0));
+    }
+    if (op % 4999 == 0) checkSearch(tree, reference);
+  }
+  checkSearch(tree, reference);
+}
+
+int main() {
+  checkSizes();
+
+  ScapegoatTree tree(0.75);
+  std::set<int> reference;
+  tree.setEytzingerSearch(true);
+  checkSearch(tree, reference);
+
+  // Assigning keys refreshes the array, and changes after it make it stale.
+  std::vector<int> keys;
+  for (int key = 0; key < 2 * kKeyCount; key += 4) keys.push_back(key);
+  tree.assign(keys.begin(), keys.end());
+  reference = std::set<int>(keys.begin(), keys.end());
+  checkSearch(tree, reference);
+  checkChanges(tree, reference, 166);
+
+  // Clearing leaves nothing to find, in the array or in the nodes.
+  tree.clear();
+  reference.clear();
+  checkSearch(tree, reference);
+  checkChanges(tree, reference, 167);
+
+  // Toggling the mode on a tree holding keys, off and on again.
+  tree.setEytzingerSearch(false);
+  checkSearch(tree, reference);
+  checkChanges(tree, reference, 168);
+  tree.setEytzingerSearch(true);
+  checkSearch(tree, reference);
+  tree.setEytzingerSearch(true);
+  checkSearch(tree, reference);
+
+#ifdef SCAPEGOAT_TRACK_SUBTREE_SIZES
+  // An incremental rebuild of the whole tree refreshes the array once its
+  // copy takes the tree's place.
+  tree.setRebuildBudget(4);
+  checkChanges(tree, reference, 169);
+  tree.finishRebuild();
+  checkSearch(tree, reference);
+#endif
+
+  CHECK(tree.verify());
+  return checkResult();
+}
@@ -0,0 +1,118 @@
+/**
+ * Tests snapshots made by ScapegoatTree::freeze() against a sorted vector of
+ * the same keys: iteration in both directions, search, find, lower_bound,
+ * upper_bound and equal_range for present keys, absent keys between them and
+ * keys beyond either end, at sizes where the van Emde Boas layout's levels
+ * split unevenly, under both ascending and descending orders.
+ */
+
+#include <algorithm>   // for std::lower_bound, std::upper_bound
+#include <cstddef>     // for std::size_t
+#include <cstdint>     // for std::uint32_t
+#include <functional>  // for std::less, std::greater
+#include <limits>      // for std::numeric_limits
+#include <vector>      // for the reference keys
+
+#include "Check.h"
+#include "FrozenScapegoatTree.h"
+#include "GenericScapegoatTree.h"
+
+/**
+ * Checks that the snapshot holds exactly the given keys, sorted by Compare,
+ * and that each of its lookups agrees with the same lookup in the vector.
+ * Keys are even, so that every odd value lies between two keys or beyond.
+ */
+template<typename Compare>
+static void checkSnapshot(const FrozenScapegoatTree<int, Compare, std::allocator<int>>& frozen,
+                          const std::vector<int>& keys) {
+  CHECK(frozen.size() == keys.size());
+  CHECK(frozen.empty() == keys.empty());
+  CHECK(std::vector<int>(frozen.begin(), frozen.end()) == keys);
+
+  // Iterators step back through the keys too, from either end.
+  auto it = frozen.end();
+  auto reverse = frozen.rbegin();
+  for (size_t i = keys.size(); i-- > 0; ) {
+    CHECK(*--it == keys[i]);
+    CHECK(*reverse++ == keys[i]);
+  }
+  CHECK(it == frozen.begin());
+  CHECK(reverse == frozen.rend());
+
+  // Probe every key, every value between two keys, and values beyond both
+  // ends, whichever way the keys run.
+  int lo = -3;
+  int hi = 2 * static_cast<int>(keys.size()) + 3;
+  Compare compare;
+  for (int probe = lo; probe <= hi; probe++) {
+    size_t lower = std::lower_bound(keys.begin(), keys.end(), probe, compare) - keys.begin();
+    size_t upper = std::upper_bound(keys.begin(), keys.end(), probe, compare) - keys.begin();
+    bool present = lower != upper;
+
+    CHECK(frozen.search(probe) == present);
+    CHECK(frozen.contains(probe) == present);
+    CHECK(std::distance(frozen.begin(), frozen.lower_bound(probe)) == static_cast<long>(lower));
+    CHECK(std::distance(frozen.begin(), frozen.upper_bound(probe)) == static_cast<long>(upper));
+    CHECK(frozen.find(probe) == (present ? frozen.lower_bound(probe) : frozen.end()));
+
+    auto range = frozen.equal_range(probe);
+    CHECK(range.first == frozen.lower_bound(probe));
+    CHECK(range.second == frozen.upper_bound(probe));
+    if (present) CHECK(*range.first == probe);
+  }
+}
+
+/**
+ * Freezes trees of every size up to a few hundred keys, and some larger
+ * ones, inserted in scrambled order, and checks each snapshot.
+ */
+template<typename Compare>
+static void checkSizes() {
+  std::vector<size_t> sizes;
+  for (size_t size = 0; size <= 300; size++) sizes.push_back(size);
+  for (size_t size : { 1023, 1024, 1025, 4097, 10000 }) sizes.push_back(size);
+
+  for (size_t size : sizes) {
+    ScapegoatTree<int, Compare> tree(0.7);
+    std::vector<int> keys;
+    for (size_t i = 0; i < size; i++) {
+      // 7919 is prime, so this visits every index once.
+      tree.insert(static_cast<int>(2 * ((i * 7919) % size)));
+      keys.push_back(static_cast<int>(2 * i));
+    }
+    std::sort(keys.begin(), keys.end(), Compare());
+    checkSnapshot(tree.freeze(), keys);
+  }
+}
+
+int main() {
+  checkSizes<std::less<int>>();
+  checkSizes<std::greater<int>>();
+
+  // An empty snapshot, whether made by the constructor or frozen from an
+  // empty tree, has no keys and finds none.
+  FrozenScapegoatTree<int, std::less<int>, std::allocator<int>> empty;
+  checkSnapshot(empty, {});
+  CHECK(empty.begin() == empty.end());
+  CHECK(empty.lower_bound(0) == empty.end());
+
+  // A snapshot does not change along with its tree.
+  ScapegoatTree<int> tree(0.75);
+  for (int key = 0; key < 100; key += 2) tree.insert(key);
+  auto frozen = tree.freeze();
+  for (int key = 0; key < 50; key += 2) tree.remove(key);
+  for (int key = 1; key < 100; key += 2) tree.insert(key);
+  std::vector<int> keys;
+  for (int key = 0; key < 100; key += 2) keys.push_back(key);
+  checkSnapshot(frozen, keys);
+  tree.clear();
+  checkSnapshot(frozen, keys);
+  checkSnapshot(tree.freeze(), {});
+
+  // Nodes refer to each other by 32-bit index, which caps the size of a
+  // snapshot; freezing a larger tree throws std::length_error.
+  static_assert(decltype(frozen)::max_size() == std::numeric_limits<std::uint32_t>::max(),
+                "snapshots hold as many keys as 32-bit indices can number");
+
+  return checkResult();
+}
@@ -0,0 +1,128 @@
+/**
+ * Tests the ways a generic tree can be given its ordering: the default 
+ * std::less, a function object, and a function pointer type, deduced from a
+ * comparison function passed to the constructor as the tree took it before
+ * comparators were function objects. Also tests that std::less only goes 
+ * through the compare members of keys which opt in to it.
+ */
+
+#include <cstddef>     // for std::size_t
+#include <string>      // for std::string
+#include <memory>      // for std::allocator
+#include <type_traits> // for std::is_same, std::is_constructible
+#include <vector>      // for expected key orders
+
+#include "Check.h"
+#include "FrozenScapegoatTree.h"
+#include "GenericScapegoatTree.h"
+
+static bool byLength(const std::string& lhs, const std::string& rhs) {
+  return lhs.size() < rhs.size() || (lhs.size() == rhs.size() && lhs < rhs);
+}
+
+struct ByLength {
+  bool operator()(const std::string& lhs, const std::string& rhs) const {
+    return byLength(lhs, rhs);
+  }
+};
+
+/**
+ * A key with a compare member meaning something else than ordering: it tells
+ * whether two versions are compatible.
+ */
+struct Version {
+  int major;
+  int minor;
+
+  bool compare(const Version& other) const { return major == other.major; }
+
+  bool operator<(const Version& other) const {
+    return major < other.major || (major == other.major && minor < other.minor);
+  }
+};
+
+static const std::vector<std::string> kKeys = { "ccc", "a", "bb", "dddd", "ab", "b" };
+
+/**
+ * Inserts kKeys into the tree, and checks that it holds them in the given
+ * order and finds them, and that removing them works.
+ */
+template<typename Tree>
+static void checkOrder(Tree& tree, const std::vector<std::string>& expected) {
+  for (const std::string& key : kKeys) CHECK(tree.insert(key));
+  CHECK(! tree.insert("bb"));
+  CHECK(tree.verify());
+  CHECK(std::vector<std::string>(tree.begin(), tree.end()) == expected);
+  CHECK(std::vector<std::string>(tree.rbegin(), tree.rend())
+        == std::vector<std::string>(expected.rbegin(), expected.rend()));
+  CHECK(*--tree.rend() == expected.front());
+  CHECK(tree.rend().base() == tree.begin() && tree.rbegin().base() == tree.end());
+
+  for (const std::string& key : kKeys) CHECK(tree.search(key));
+  CHECK(! tree.search("zz"));
+
+  // A batch large enough to be merged with the tree's keys, sorting it first.
+  std::vector<std::string> batch = { "eeeee", "c", "ba", "eeeee" };
+  CHECK(tree.insertBatch(batch.begin(), batch.end()) == 3);
+  CHECK(tree.verify());
+  CHECK(tree.search("ba") && tree.search("c"));
+
+  CHECK(tree.remove("ab"));
+  CHECK(! tree.search("ab"));
+  CHECK(tree.verify());
+}
+
+int main() {
+  std::vector<std::string> lexicographic = { "a", "ab", "b", "bb", "ccc", "dddd" };
+  std::vector<std::string> byLengthOrder = { "a", "b", "ab", "bb", "ccc", "dddd" };
+
+  // The default comparator.
+  ScapegoatTree<std::string> byLess(0.75);
+  checkOrder(byLess, lexicographic);
+
+  // A function pointer Compare, deduced from the function.
+  ScapegoatTree deduced(0.75, byLength);
+  static_assert(std::is_same<decltype(deduced), 
+      ScapegoatTree<std::string, bool (*)(const std::string&, const std::string&)>>::value, 
+      "a function passed without template arguments deduces a function pointer Compare");
+  checkOrder(deduced, byLengthOrder);
+
+  // The same, with the allocator given as well.
+  ScapegoatTree deducedWithAllocator(0.75, &byLength, std::allocator<std::string>());
+  checkOrder(deducedWithAllocator, byLengthOrder);
+
+  // Its snapshot keeps the function, and with it the tree's order.
+  auto frozen = deduced.freeze();
+  CHECK(std::vector<std::string>(frozen.begin(), frozen.end())
+        == std::vector<std::string>(deduced.begin(), deduced.end()));
+  CHECK(frozen.contains("c") && ! frozen.contains("ab"));
+
+  // Trees with the default comparator do not take a function.
+  static_assert(! std::is_constructible<ScapegoatTree<std::string>, double, 
+      bool (*)(const std::string&, const std::string&)>::value,
+      "a function cannot order a tree whose Compare is std::less");
+
+  // A function object.
+  ScapegoatTree<std::string, ByLength> byFunctor(0.75);
+  checkOrder(byFunctor, byLengthOrder);
+
+  // Version's compare member is not an ordering, so std::less uses < instead.
+  static_assert(ComparesThroughMember<std::string>::value 
+                && ! ComparesThroughMember<Version>::value,
+                "only strings compare through their compare member by default");
+  ScapegoatTree<Version> versions(0.75);
+  for (int minor : { 2, 0, 1 }) CHECK(versions.insert( { 1, minor } ));
+  CHECK(versions.search( { 1, 0 } ) && versions.search( { 1, 2 } ));
+  CHECK(! versions.search( { 1, 3 } ));
+  int expectedMinor = 0;
+  for (const Version& version : versions) CHECK(version.minor == expectedMinor++);
+  CHECK(expectedMinor == 3);
+
+  // Stateless comparators take up no room, std::less included, while a
+  // function pointer takes a pointer's.
+  CHECK(sizeof(ScapegoatTree<std::string, ByLength>) == sizeof(ScapegoatTree<std::string>));
+  CHECK(sizeof(ScapegoatTree<std::string, ByLength>) + sizeof(void*) 
+        == sizeof(decltype(deduced)));
+
+  return checkResult();
+}
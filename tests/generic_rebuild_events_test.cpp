@@ -0,0 +1,119 @@
+/**
+ * Tests the events the generic tree reports to its rebuild listener (see
+ * setRebuildListener) for partial rebuilds, a batch insertion merged into a
+ * new tree, and a rebuild of a tree shrunk by removals, with and without
+ * stored subtree sizes.
+ */
+
+#include <cstddef>     // for std::size_t
+#include <functional>  // for std::less
+#include <memory>      // for std::allocator
+#include <vector>      // for batches and recorded events
+
+#include "Check.h"
+#include "GenericScapegoatTree.h"
+
+/**
+ * Describes a call to a listener.
+ */
+struct RecordedEvent {
+  bool before;  // Whether it was beforeRebuild rather than afterRebuild
+  RebuildEvent event;
+};
+
+/**
+ * Records every event it receives, in order.
+ */
+class RecordingListener : public RebuildListener {
+  public:
+    std::vector<RecordedEvent> events;
+
+    void beforeRebuild(const RebuildEvent& event) override {
+      events.push_back( { true, event } );
+    }
+
+    void afterRebuild(const RebuildEvent& event) override {
+      events.push_back( { false, event } );
+    }
+};
+
+/**
+ * Returns whether two events have the same payload.
+ */
+static bool sameEvent(const RebuildEvent& a, const RebuildEvent& b) {
+  return a.treeSize == b.treeSize && a.depth == b.depth && a.wholeTree == b.wholeTree
+         && a.reason == b.reason;
+}
+
+/**
+ * Checks that the events come in pairs of a before and an after call with the
+ * same payload, none nested within another, as rebuilds done at once are.
+ */
+static void checkPairs(const std::vector<RecordedEvent>& events) {
+  CHECK(events.size() % 2 == 0);
+  for (size_t i = 0; i + 1 < events.size(); i += 2) {
+    CHECK(events[i].before);
+    CHECK(! events[i + 1].before);
+    CHECK(sameEvent(events[i].event, events[i + 1].event));
+    CHECK(events[i].event.wholeTree == (events[i].event.depth == 0));
+  }
+}
+
+struct EventOptions : DefaultScapegoatOptions {
+  static constexpr bool kRebuildEvents = true;
+};
+
+struct SizedEventOptions : EventOptions {
+  static constexpr bool kTrackSubtreeSizes = true;
+};
+
+/**
+ * Runs insertions, a merged batch and removals on a tree with the given
+ * options, checking the events reported for each.
+ */
+template<typename Options>
+static void checkEvents() {
+  ScapegoatTree<int, std::less<int>, std::allocator<int>, Options> tree(0.75);
+  RecordingListener listener;
+  tree.setRebuildListener(&listener);
+
+  // Keys inserted in order keep making the right spine too deep, which
+  // rebuilds subtrees hanging from it.
+  for (int key = 900; key < 1000; key++) tree.insert(key);
+  CHECK(! listener.events.empty());
+  checkPairs(listener.events);
+  bool partial = false;
+  for (const RecordedEvent& recorded : listener.events) {
+    CHECK(recorded.event.reason == RebuildReason::kInsertTooDeep);
+    CHECK(recorded.event.treeSize > 0 && recorded.event.treeSize <= 100);
+    if (! recorded.event.wholeTree) partial = true;
+  }
+  CHECK(partial);
+
+  // A batch of 900 keys, far larger than the tree, is merged with it into
+  // a new tree of 1000 keys, reported as a single rebuild of the whole tree.
+  listener.events.clear();
+  std::vector<int> batch;
+  for (int key = 0; key < 900; key++) batch.push_back(key);
+  CHECK(tree.insertBatch(batch.begin(), batch.end()) == 900);
+  CHECK(listener.events.size() == 2);
+  checkPairs(listener.events);
+  CHECK(sameEvent(listener.events[0].event, { 1000, 0, true, RebuildReason::kBatchMerge }));
+
+  // Removals shrink the tree to alpha times its size of 1000 at 750 keys,
+  // which rebuilds it whole.
+  listener.events.clear();
+  for (int key = 0; key < 249; key++) tree.remove(key);
+  CHECK(listener.events.empty());
+  tree.remove(249);
+  CHECK(listener.events.size() == 2);
+  checkPairs(listener.events);
+  CHECK(sameEvent(listener.events[0].event, { 750, 0, true, RebuildReason::kRemoveShrunk }));
+  CHECK(tree.verify());
+}
+
+int main() {
+  checkEvents<EventOptions>();
+  checkEvents<SizedEventOptions>();
+  return checkResult();
+}
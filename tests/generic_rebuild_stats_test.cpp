@@ -0,0 +1,91 @@
+/**
+ * Tests the rebuild counters of the generic tree (see stats) after partial
+ * rebuilds, a batch insertion merged into a new tree, and a rebuild of a
+ * tree shrunk by removals, with and without stored subtree sizes.
+ */
+
+#include <cstddef>     // for std::size_t
+#include <functional>  // for std::less
+#include <memory>      // for std::allocator
+#include <vector>      // for batches
+
+#include "Check.h"
+#include "GenericScapegoatTree.h"
+
+/**
+ * Returns how many rebuilds the size histogram counts.
+ */
+static size_t histogramTotal(const RebuildStats& stats) {
+  size_t total = 0;
+  for (size_t count : stats.rebuiltSizes) total += count;
+  return total;
+}
+
+/**
+ * Checks that the histogram counts every rebuild, and that no insertion went
+ * more than a level deeper than the alpha-deep height before its rebuild.
+ */
+static void checkConsistent(const RebuildStats& stats) {
+  CHECK(histogramTotal(stats) == stats.partialRebuilds + stats.fullRebuilds);
+  CHECK(stats.maxDepth <= stats.alphaDeepHeightAtMaxDepth + 1);
+}
+
+struct StatsOptions : DefaultScapegoatOptions {
+  static constexpr bool kCollectStats = true;
+};
+
+struct SizedStatsOptions : StatsOptions {
+  static constexpr bool kTrackSubtreeSizes = true;
+};
+
+/**
+ * Runs insertions, a merged batch and removals on a tree with the given 
+ * options, checking its counters after each.
+ */
+template<typename Options>
+static void checkStats() {
+  ScapegoatTree<int, std::less<int>, std::allocator<int>, Options> tree(0.75);
+  CHECK(histogramTotal(tree.stats()) == 0);
+  CHECK(tree.stats().maxDepth == 0);
+
+  // Keys inserted in order keep making the right spine too deep, which
+  // rebuilds subtrees hanging from it, and finding their scapegoats counts
+  // nodes.
+  for (int key = 900; key < 1000; key++) tree.insert(key);
+  RebuildStats stats = tree.stats();
+  CHECK(stats.partialRebuilds > 0);
+  CHECK(stats.scapegoatSearchNodes > 0);
+  CHECK(stats.maxDepth > 0);
+  checkConsistent(stats);
+
+  // A batch of 900 keys, far larger than the tree, is merged with it into
+  // a new tree of 1000 keys: a single rebuild of the whole tree.
+  std::vector<int> batch;
+  for (int key = 0; key < 900; key++) batch.push_back(key);
+  CHECK(tree.insertBatch(batch.begin(), batch.end()) == 900);
+  CHECK(tree.stats().fullRebuilds == stats.fullRebuilds + 1);
+  CHECK(tree.stats().partialRebuilds == stats.partialRebuilds);
+  CHECK(tree.stats().rebuiltSizes[RebuildStats::sizeBucket(1000)]
+        == stats.rebuiltSizes[RebuildStats::sizeBucket(1000)] + 1);
+  CHECK(tree.stats().rebuildTime >= stats.rebuildTime);
+  checkConsistent(tree.stats());
+
+  // Removals shrink the tree to alpha times its size of 1000 at 750 keys,
+  // which rebuilds it whole.
+  stats = tree.stats();
+  for (int key = 0; key < 249; key++) tree.remove(key);
+  CHECK(tree.stats().fullRebuilds == stats.fullRebuilds);
+  tree.remove(249);
+  CHECK(tree.stats().fullRebuilds == stats.fullRebuilds + 1);
+  CHECK(tree.stats().partialRebuilds == stats.partialRebuilds);
+  CHECK(tree.stats().rebuiltSizes[RebuildStats::sizeBucket(750)]
+        == stats.rebuiltSizes[RebuildStats::sizeBucket(750)] + 1);
+  checkConsistent(tree.stats());
+  CHECK(tree.verify());
+}
+
+int main() {
+  checkStats<StatsOptions>();
+  checkStats<SizedStatsOptions>();
+  return checkResult();
+}
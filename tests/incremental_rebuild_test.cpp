@@ -0,0 +1,222 @@
+/**
+ * Tests incremental rebuilding of the integer tree (see setRebuildBudget)
+ * by running random insertions, removals and batches against a std::set,
+ * under several budgets and both rebuild strategies, and checking that the
+ * tree always holds the same keys and is balanced once rebuilds are done.
+ *
+ * CMake builds this test once for every compile-time variant of the tree,
+ * each storing subtree sizes, which incremental rebuilds need.
+ */
+
+#include <cstddef>    // for std::size_t
+#include <random>     // for std::mt19937
+#include <set>        // for the reference set of keys
+#include <stdexcept>  // for std::invalid_argument
+#include <vector>     // for batches and expected key orders
+
+#include "Check.h"
+#include "ScapegoatTree.h"
+
+using RebuildStrategy = ScapegoatTree::RebuildStrategy;
+
+// Keys are drawn from [0, kKeyRange), so that insertions and removals meet.
+static constexpr int kKeyRange = 4000;
+
+#ifdef SCAPEGOAT_REBUILD_EVENTS
+/**
+ * Checks that events come in pairs, and that whole-tree rebuilds never nest
+ * within each other, though rebuilds of subtrees may nest within them.
+ */
+class PairingListener : public RebuildListener {
+  public:
+    size_t open = 0;        // Rebuilds begun and not finished yet
+    size_t wholeOpen = 0;   // Whole-tree rebuilds among them
+
+    void beforeRebuild(const RebuildEvent& event) override {
+      open++;
+      if (event.wholeTree) wholeOpen++;
+      CHECK(wholeOpen <= 1);
+    }
+
+    void afterRebuild(const RebuildEvent& event) override {
+      CHECK(open > 0);
+      open--;
+      if (event.wholeTree) wholeOpen--;
+    }
+};
+#endif
+
+/**
+ * Checks that the tree holds exactly the reference keys, in order both ways.
+ */
+static void checkKeys(const ScapegoatTree& tree, const std::set<int>& reference) {
+  CHECK(std::vector<int>(tree.begin(), tree.end())
+        == std::vector<int>(reference.begin(), reference.end()));
+  CHECK(std::vector<int>(tree.rbegin(), tree.rend())
+        == std::vector<int>(reference.rbegin(), reference.rend()));
+
+  // Reverse iterators step back past either end, and lead to the next key.
+  if (! reference.empty()) {
+    CHECK(*--tree.rend() == *reference.begin());
+    CHECK(tree.rend().base() == tree.begin());
+    CHECK(tree.rbegin().base() == tree.end());
+    CHECK(ScapegoatTree::const_reverse_iterator(tree.end()) == tree.rbegin());
+  }
+}
+
+/**
+ * Checks that the tree is a valid, balanced scapegoat tree once any
+ * rebuild in progress is done, and that it holds the reference keys.
+ */
+static void checkFinished(ScapegoatTree& tree, const std::set<int>& reference) {
+  tree.finishRebuild();
+  CHECK(! tree.rebuildInProgress());
+  CHECK(tree.verify());
+  checkKeys(tree, reference);
+}
+
+/**
+ * Runs random operations on a tree with the given budget and strategy, in
+ * phases of random insertions, random removals, a mix of both, and
+ * sequential insertions, which make for the deepest trees.
+ */
+static void runOperations(size_t budget, RebuildStrategy strategy, unsigned seed) {
+  std::mt19937 random(seed);
+  ScapegoatTree tree(0.55 + 0.05 * (seed % 7), strategy);
+  tree.setRebuildBudget(budget);
+  std::set<int> reference;
+
+#ifdef SCAPEGOAT_REBUILD_EVENTS
+  PairingListener listener;
+  tree.setRebuildListener(&listener);
+#endif
+
+  for (int op = 0; op < 40000; op++) {
+    int phase = (op / 4000) % 4;
+    int choice = random() % 1000;
+    int key = random() % kKeyRange;
+
+    if (choice < 2) {
+      std::vector<int> batch;
+      for (int i = 0; i < 30; i++) batch.push_back(random() % kKeyRange);
+      tree.insertBatch(batch.begin(), batch.end());
+      reference.insert(batch.begin(), batch.end());
+    } else if (choice < 4) {
+      std::vector<int> batch;
+      for (int i = 0; i < 30; i++) batch.push_back(random() % kKeyRange);
+      tree.removeBatch(batch.begin(), batch.end());
+      for (int removed : batch) reference.erase(removed);
+    } else if (choice < 5) {
+      int hi = key + random() % 50;
+      tree.removeRange(key, hi);
+      reference.erase(reference.lower_bound(key), reference.upper_bound(hi));
+    } else if (phase == 0 || (phase == 2 && choice % 2)) {
+      CHECK(tree.insert(key) == reference.insert(key).second);
+    } else if (phase == 3) {
+      key = op % kKeyRange;
+      CHECK(tree.insert(key) == reference.insert(key).second);
+    } else {
+      CHECK(tree.remove(key) == (reference.erase(key) > 0));
+    }
+
+    // Queries see every change right away, rebuild or not.
+    if (op % 101 == 0) {
+      for (int i = 0; i < 20; i++) {
+        int probe = random() % kKeyRange;
+        CHECK(tree.search(probe) == (reference.count(probe) > 0));
+      }
+    }
+    if (op % 4999 == 0) checkKeys(tree, reference);
+
+    // Turning the budget off finishes a rebuild in progress.
+    if (op == 20000 && budget > 0) {
+      tree.setRebuildBudget(0);
+      CHECK(! tree.rebuildInProgress());
+      CHECK(tree.verify());
+      tree.setRebuildBudget(budget);
+    }
+  }
+  checkFinished(tree, reference);
+
+#ifdef SCAPEGOAT_REBUILD_EVENTS
+  CHECK(listener.open == 0);
+#endif
+}
+
+/**
+ * Inserts keys in order until an incremental rebuild is in progress,
+ * returning whether one started.
+ */
+static bool startRebuild(ScapegoatTree& tree, std::set<int>& reference) {
+  for (int key = 0; key < 100000; key++) {
+    tree.insert(key);
+    reference.insert(key);
+    if (tree.rebuildInProgress()) return true;
+  }
+  return false;
+}
+
+/**
+ * Checks that clearing or assigning to a tree drops its rebuild in progress,
+ * and that the tree carries on as usual.
+ */
+static void checkResetDuringRebuild(RebuildStrategy strategy) {
+  ScapegoatTree tree(0.7, strategy);
+  tree.setRebuildBudget(4);
+  std::set<int> reference;
+
+  CHECK(startRebuild(tree, reference));
+  tree.clear();
+  reference.clear();
+  CHECK(! tree.rebuildInProgress());
+  CHECK(tree.begin() == tree.end());
+  CHECK(startRebuild(tree, reference));
+  checkFinished(tree, reference);
+
+  CHECK(startRebuild(tree, reference));
+  std::vector<int> keys = { 5, 3, 9, -2, 3 };
+  tree.assign(keys.begin(), keys.end());
+  reference = std::set<int>(keys.begin(), keys.end());
+  CHECK(! tree.rebuildInProgress());
+  checkKeys(tree, reference);
+  CHECK(startRebuild(tree, reference));
+  checkFinished(tree, reference);
+}
+
+int main() {
+  for (RebuildStrategy strategy : { RebuildStrategy::kRelink, RebuildStrategy::kRelayout }) {
+    unsigned seed = 0;
+    for (size_t budget : { 0, 2, 3, 7, 64 }) {
+      runOperations(budget, strategy, seed++);
+    }
+    checkResetDuringRebuild(strategy);
+  }
+
+  // A budget of 1 could fall behind insertions forever.
+  ScapegoatTree tree(0.7);
+  bool threw = false;
+  try {
+    tree.setRebuildBudget(1);
+  } catch (const std::invalid_argument&) {
+    threw = true;
+  }
+  CHECK(threw);
+
+  // Finishing with no rebuild in progress does nothing.
+  tree.finishRebuild();
+  CHECK(! tree.rebuildInProgress());
+  CHECK(tree.verify());
+
+#ifdef SCAPEGOAT_COLLECT_STATS
+  // Each incremental rebuild counts as a single rebuild, of a subtree or of
+  // the whole tree, once it is done.
+  std::set<int> reference;
+  tree.setRebuildBudget(4);
+  CHECK(startRebuild(tree, reference));
+  size_t rebuilds = tree.stats().fullRebuilds + tree.stats().partialRebuilds;
+  tree.finishRebuild();
+  CHECK(tree.stats().fullRebuilds + tree.stats().partialRebuilds > rebuilds);
+#endif
+
+  return checkResult();
+}
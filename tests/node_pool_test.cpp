@@ -0,0 +1,75 @@
+/**
+ * Tests IndexedNodePool: that nodes keep their contents while the first
+ * chunk grows and more chunks are added, that runs get consecutive indices
+ * across chunk boundaries, that freed slots are reused by single
+ * allocations, and that clearing starts the pool over.
+ */
+
+#include <cstddef>  // for std::size_t
+#include <set>      // for indices handed out
+#include <vector>   // for indices handed out
+
+#include "Check.h"
+#include "NodePool.h"
+
+/**
+ * A node the size of a compact node with a subtree size.
+ */
+struct TestNode {
+  int key;
+  NodeIndex left;
+  NodeIndex right;
+  unsigned size;
+};
+
+int main() {
+  IndexedNodePool<TestNode> pool;
+
+  // Single nodes, then runs long enough to span several chunks, each node
+  // holding its own index.
+  std::vector<NodeIndex> nodes;
+  for (int i = 0; i < 1000; i++) nodes.push_back(pool.allocate());
+  for (size_t count : { 1, 70000, 3, 150000 }) {
+    NodeIndex run = pool.allocateRun(count);
+    for (size_t i = 0; i < count; i++) nodes.push_back(run + i);
+  }
+  for (NodeIndex node : nodes) {
+    CHECK(node);
+    pool.at(node).key = static_cast<int>(node.value());
+    pool.at(node).size = static_cast<unsigned>(node.value() * 3);
+  }
+
+  // Indices are consecutive, starting after the null index 0.
+  for (size_t i = 0; i < nodes.size(); i++) CHECK(nodes[i].value() == i + 1);
+
+  // Growing the pool kept every node's contents.
+  pool.allocateRun(100000);
+  for (NodeIndex node : nodes) {
+    CHECK(pool.at(node).key == static_cast<int>(node.value()));
+    CHECK(pool.at(node).size == node.value() * 3);
+  }
+
+  // Freed slots are handed out again by single allocations only.
+  std::set<size_t> freed;
+  for (size_t i = 0; i < nodes.size(); i += 997) {
+    pool.deallocate(nodes[i]);
+    freed.insert(nodes[i].value());
+  }
+  CHECK(pool.freeNodes() == freed.size());
+  NodeIndex run = pool.allocateRun(2);
+  CHECK(! freed.count(run.value()) && ! freed.count(run.value() + 1));
+  CHECK(pool.freeNodes() == freed.size());
+  std::set<size_t> reused;
+  while (pool.freeNodes() > 0) reused.insert(pool.allocate().value());
+  CHECK(reused == freed);
+
+  // Clearing starts over at index 1, in a small first chunk again.
+  pool.clear();
+  CHECK(pool.freeNodes() == 0);
+  NodeIndex first = pool.allocate();
+  CHECK(first.value() == 1);
+  pool.at(first).key = 7;
+  CHECK(pool.at(first).key == 7);
+
+  return checkResult();
+}
@@ -0,0 +1,118 @@
+/**
+ * Tests rank, select and countRange of the size-augmented generic tree
+ * against a sorted vector of the same keys, after insertions that rebuild
+ * subtrees, a merged batch, single and batch removals, range removals and
+ * removals that shrink the tree enough to rebuild it whole.
+ */
+
+#include <algorithm>   // for std::lower_bound, std::upper_bound, std::shuffle
+#include <cstddef>     // for std::size_t
+#include <functional>  // for std::less
+#include <iterator>    // for std::next, std::prev
+#include <memory>      // for std::allocator
+#include <random>      // for std::mt19937
+#include <set>         // for the reference set of keys
+#include <vector>      // for batches and the sorted keys
+
+#include "Check.h"
+#include "GenericScapegoatTree.h"
+
+using SizedTree = ScapegoatTree<int, std::less<int>, std::allocator<int>, SizeAugmentedOptions>;
+
+// Keys are even, and drawn from [0, 2 * kKeyCount), so that every odd value
+// lies between two keys or beyond them.
+static constexpr int kKeyCount = 1500;
+
+/**
+ * Checks that select, rank and countRange agree with the sorted keys of the
+ * reference, for every key, every value between two keys and values beyond
+ * either end.
+ */
+static void checkStatistics(const SizedTree& tree, const std::set<int>& reference) {
+  CHECK(tree.verify());
+  std::vector<int> keys(reference.begin(), reference.end());
+  size_t n = keys.size();
+
+  for (size_t i = 0; i < n; i++) CHECK(*tree.select(i) == keys[i]);
+  CHECK(tree.select(n) == tree.end());
+  CHECK(tree.select(n + 7) == tree.end());
+  if (n > 0) {
+    // The last key's iterator leads to end(), and back.
+    CHECK(tree.select(n - 1) == std::prev(tree.end()));
+    CHECK(std::next(tree.select(n - 1)) == tree.end());
+    CHECK(tree.select(0) == tree.begin());
+  }
+
+  for (int value = -3; value <= 2 * kKeyCount + 3; value++) {
+    size_t before = std::lower_bound(keys.begin(), keys.end(), value) - keys.begin();
+    CHECK(tree.rank(value) == before);
+  }
+
+  // Ranges with bounds on keys and between them, equal bounds, and
+  // swapped bounds, which hold nothing.
+  for (int lo = -3; lo <= 2 * kKeyCount + 3; lo += 37) {
+    for (int width : { 0, 1, 2, 5, 64, 1001, 3 * kKeyCount }) {
+      int hi = lo + width;
+      size_t expected = std::upper_bound(keys.begin(), keys.end(), hi)
+                      - std::lower_bound(keys.begin(), keys.end(), lo);
+      CHECK(tree.countRange(lo, hi) == expected);
+      if (width > 0) CHECK(tree.countRange(hi, lo) == 0);
+    }
+  }
+}
+
+int main() {
+  SizedTree tree(0.6);
+  std::set<int> reference;
+  checkStatistics(tree, reference);
+
+  // Keys inserted in order rebuild subtrees over and over.
+  for (int key = 0; key < 2 * kKeyCount / 3; key += 2) {
+    tree.insert(key);
+    reference.insert(key);
+  }
+  checkStatistics(tree, reference);
+
+  // A batch larger than the tree is merged into a new tree.
+  std::vector<int> batch;
+  for (int key = 0; key < 2 * kKeyCount; key += 2) batch.push_back(key);
+  std::shuffle(batch.begin(), batch.end(), std::mt19937(166));
+  tree.insertBatch(batch.begin(), batch.end());
+  reference.insert(batch.begin(), batch.end());
+  checkStatistics(tree, reference);
+
+  // Single removals, enough of them to shrink the tree and rebuild it.
+  std::mt19937 random(167);
+  for (int i = 0; i < kKeyCount / 2; i++) {
+    int key = 2 * static_cast<int>(random() % kKeyCount);
+    CHECK(tree.remove(key) == (reference.erase(key) > 0));
+    if (i % 97 == 0) CHECK(tree.rank(key) == static_cast<size_t>(
+        std::distance(reference.begin(), reference.lower_bound(key))));
+  }
+  checkStatistics(tree, reference);
+
+  // A batch of removals and a range removal.
+  batch.clear();
+  for (int key = 0; key < 2 * kKeyCount; key += 6) batch.push_back(key);
+  tree.removeBatch(batch.begin(), batch.end());
+  for (int key : batch) reference.erase(key);
+  checkStatistics(tree, reference);
+
+  tree.removeRange(501, 1799);
+  reference.erase(reference.lower_bound(501), reference.upper_bound(1799));
+  checkStatistics(tree, reference);
+
+  // Removing all but a few keys leaves a tiny tree.
+  while (reference.size() > 3) {
+    int key = *std::next(reference.begin(), random() % reference.size());
+    CHECK(tree.remove(key));
+    reference.erase(key);
+  }
+  checkStatistics(tree, reference);
+
+  tree.clear();
+  reference.clear();
+  checkStatistics(tree, reference);
+
+  return checkResult();
+}
@@ -0,0 +1,189 @@
+/**
+ * Tests ScapegoatMap: operator[], try_emplace, insert_or_assign, find and 
+ * remove, with and without stored subtree sizes. Also checks that values 
+ * never move or get copied once inserted, so that the pointers find() 
+ * returns stay valid across rebuilds and the removal of other keys: a
+ * removed node with two children is replaced by relinking its successor or
+ * predecessor, in maps and plain trees alike, never by copying a key or 
+ * value into it.
+ */
+
+#include <cstddef>     // for std::size_t
+#include <functional>  // for std::less
+#include <iterator>    // for std::next
+#include <map>         // for the reference map
+#include <memory>      // for std::allocator, std::unique_ptr
+#include <random>      // for std::mt19937
+#include <string>      // for std::string
+#include <utility>     // for std::pair, std::move
+
+#include "Check.h"
+#include "ScapegoatMap.h"
+
+/**
+ * A value counting how many times values were copied or moved, and how many
+ * are alive.
+ */
+struct Tracked {
+  static size_t copies;  // Copy constructions and assignments
+  static size_t moves;   // Move constructions and assignments
+  static size_t alive;
+
+  int value;
+
+  explicit Tracked(int value = 0) : value(value) { alive++; }
+  Tracked(const Tracked& other) : value(other.value) { alive++; copies++; }
+  Tracked(Tracked&& other) : value(other.value) { alive++; moves++; }
+  ~Tracked() { alive--; }
+
+  Tracked& operator=(const Tracked& other) {
+    value = other.value;
+    copies++;
+    return *this;
+  }
+
+  Tracked& operator=(Tracked&& other) {
+    value = other.value;
+    moves++;
+    return *this;
+  }
+
+  bool operator<(const Tracked& other) const { return value < other.value; }
+};
+
+size_t Tracked::copies = 0;
+size_t Tracked::moves = 0;
+size_t Tracked::alive = 0;
+
+template<typename Options>
+using TrackedMap = ScapegoatMap<int, Tracked, std::less<int>,
+                                std::allocator<std::pair<const int, Tracked>>, Options>;
+
+/**
+ * Checks operator[], try_emplace and insert_or_assign on single keys.
+ */
+template<typename Options>
+static void checkAccess() {
+  ScapegoatMap<std::string, std::unique_ptr<int>, std::less<std::string>,
+               std::allocator<std::pair<const std::string, std::unique_ptr<int>>>,
+               Options> map(0.75);
+
+  // operator[] inserts a value-initialized value, and finds it after.
+  CHECK(! map.contains("a"));
+  CHECK(map["a"] == nullptr);
+  CHECK(map.contains("a"));
+  map["a"].reset(new int(1));
+  CHECK(*map["a"] == 1);
+  CHECK(map.find("a") == &map["a"]);
+
+  // try_emplace neither overwrites nor moves from its arguments when the key
+  // is present.
+  std::unique_ptr<int> two(new int(2));
+  std::pair<std::unique_ptr<int>*, bool> emplaced = map.try_emplace("a", std::move(two));
+  CHECK(! emplaced.second);
+  CHECK(emplaced.first == map.find("a"));
+  CHECK(**emplaced.first == 1);
+  CHECK(two != nullptr);
+
+  emplaced = map.try_emplace("b", std::move(two));
+  CHECK(emplaced.second);
+  CHECK(**emplaced.first == 2);
+  CHECK(two == nullptr);
+
+  // insert_or_assign overwrites in place.
+  std::unique_ptr<int>* a = map.find("a");
+  emplaced = map.insert_or_assign("a", std::unique_ptr<int>(new int(3)));
+  CHECK(! emplaced.second);
+  CHECK(emplaced.first == a);
+  CHECK(**a == 3);
+  emplaced = map.insert_or_assign(std::string("c"), std::unique_ptr<int>(new int(4)));
+  CHECK(emplaced.second);
+  CHECK(**map.find("c") == 4);
+
+  // remove drops the key and its value, once.
+  CHECK(map.remove("b"));
+  CHECK(! map.remove("b"));
+  CHECK(map.find("b") == nullptr);
+  CHECK(! map.contains("b"));
+  CHECK(**map.find("a") == 3 && **map.find("c") == 4);
+  CHECK(map.verify());
+}
+
+/**
+ * Inserts keys in order, which rebuilds subtrees over and over, and then 
+ * random keys, and removes keys at random until the map shrinks enough to 
+ * be rebuilt whole. Checks that every value stays where find() first 
+ * returned it, and that no value is ever copied or moved.
+ */
+template<typename Options>
+static void checkStableValues(unsigned seed) {
+  Tracked::copies = Tracked::moves = Tracked::alive = 0;
+  std::mt19937 random(seed);
+  {
+    TrackedMap<Options> map(0.6);
+    std::map<int, const Tracked*> addresses;
+
+    for (int key = 0; key < 2000; key++) {
+      std::pair<Tracked*, bool> emplaced = map.try_emplace(key, key);
+      CHECK(emplaced.second);
+      addresses[key] = emplaced.first;
+    }
+    for (int i = 0; i < 2000; i++) {
+      int key = 2000 + static_cast<int>(random() % 4000);
+      std::pair<Tracked*, bool> emplaced = map.try_emplace(key, key);
+      if (emplaced.second) addresses[key] = emplaced.first;
+      CHECK(emplaced.first == addresses[key]);
+    }
+    CHECK(Tracked::alive == addresses.size());
+
+    // Removals in random order take out plenty of nodes with two children.
+    while (addresses.size() > 100) {
+      auto removed = std::next(addresses.begin(), random() % addresses.size());
+      CHECK(map.remove(removed->first));
+      addresses.erase(removed);
+      CHECK(Tracked::alive == addresses.size());
+
+      if (addresses.size() % 250 == 0) {
+        CHECK(map.verify());
+        for (const auto& [key, address] : addresses) {
+          CHECK(map.find(key) == address);
+          CHECK(address->value == key);
+        }
+      }
+    }
+    CHECK(map.verify());
+    CHECK(Tracked::copies == 0);
+    CHECK(Tracked::moves == 0);
+  }
+  CHECK(Tracked::alive == 0);
+}
+
+/**
+ * Checks that removing keys from a plain tree, which replaces nodes with two
+ * children by their successor or predecessor, never copies or moves a key.
+ */
+static void checkRemovalRelinks(unsigned seed) {
+  std::mt19937 random(seed);
+  ScapegoatTree<Tracked> tree(0.6);
+  for (int i = 0; i < 3000; i++) tree.insert(Tracked(static_cast<int>(random() % 5000)));
+
+  Tracked::copies = Tracked::moves = 0;
+  for (int i = 0; i < 5000; i++) tree.remove(Tracked(static_cast<int>(random() % 5000)));
+  CHECK(tree.verify());
+  CHECK(Tracked::copies == 0);
+  CHECK(Tracked::moves == 0);
+}
+
+int main() {
+  checkAccess<DefaultScapegoatOptions>();
+  checkAccess<SizeAugmentedOptions>();
+
+  unsigned seed = 0;
+  for (int run = 0; run < 3; run++) {
+    checkStableValues<DefaultScapegoatOptions>(seed++);
+    checkStableValues<SizeAugmentedOptions>(seed++);
+    checkRemovalRelinks(seed++);
+  }
+
+  return checkResult();
+}
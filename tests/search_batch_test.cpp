@@ -0,0 +1,92 @@
+/**
+ * Tests searchBatch of the integer tree against a std::set, for batches of
+ * every length around the group size it advances lookups in, including
+ * empty batches, through both the nodes and the Eytzinger array (see
+ * setEytzingerSearch), and while that array is stale.
+ *
+ * CMake builds this test once for every compile-time variant of the tree.
+ */
+
+#include <cstddef>  // for std::size_t
+#include <memory>   // for std::unique_ptr
+#include <random>   // for std::mt19937
+#include <set>      // for the reference set of keys
+#include <vector>   // for batches of keys
+
+#include "Check.h"
+#include "ScapegoatTree.h"
+
+// Keys are even, and drawn from [0, 2 * kKeyCount), so that every odd value
+// lies between two keys or beyond them.
+static constexpr int kKeyCount = 3000;
+
+/**
+ * Checks searchBatch against the reference for batches of every length up to
+ * a few groups, and a long one, each made of random values in and around
+ * the key range, repeated values included.
+ */
+static void checkBatches(const ScapegoatTree& tree, const std::set<int>& reference,
+                         std::mt19937& random) {
+  std::vector<size_t> lengths;
+  for (size_t n = 0; n <= 50; n++) lengths.push_back(n);
+  lengths.push_back(1001);
+
+  for (size_t n : lengths) {
+    std::vector<int> keys(n);
+    for (int& key : keys) key = static_cast<int>(random() % (2 * kKeyCount + 6)) - 3;
+
+    // A guard past the end catches writes beyond the n results.
+    std::unique_ptr<bool[]> out(new bool[n + 1]);
+    out[n] = true;
+    tree.searchBatch(keys.data(), n, out.get());
+    for (size_t i = 0; i < n; i++) CHECK(out[i] == (reference.count(keys[i]) > 0));
+    CHECK(out[n]);
+  }
+
+  // An empty batch reads and writes nothing.
+  tree.searchBatch(nullptr, 0, nullptr);
+}
+
+/**
+ * Fills a tree, then checks batches through the nodes, through a current
+ * Eytzinger array, and through the nodes again once changes make it stale.
+ */
+static void checkTree(size_t numKeys, unsigned seed) {
+  std::mt19937 random(seed);
+  ScapegoatTree tree(0.7);
+  std::set<int> reference;
+  checkBatches(tree, reference, random);
+
+  while (reference.size() < numKeys) {
+    int key = 2 * static_cast<int>(random() % kKeyCount);
+    tree.insert(key);
+    reference.insert(key);
+  }
+  checkBatches(tree, reference, random);
+
+  tree.setEytzingerSearch(true);
+  checkBatches(tree, reference, random);
+
+  for (int i = 0; i < 50; i++) {
+    int key = 2 * static_cast<int>(random() % kKeyCount);
+    if (i % 2) {
+      tree.insert(key);
+      reference.insert(key);
+    } else {
+      tree.remove(key);
+      reference.erase(key);
+    }
+  }
+  checkBatches(tree, reference, random);
+
+  tree.setEytzingerSearch(false);
+  checkBatches(tree, reference, random);
+}
+
+int main() {
+  unsigned seed = 0;
+  for (size_t numKeys : { 1, 2, 15, 16, 17, 100, 2047 }) {
+    checkTree(numKeys, seed++);
+  }
+  return checkResult();
+}